@@ -0,0 +1,165 @@
+#include "arena.h"
+
+// STL
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <algorithm>
+#include <cstdlib>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+// PUT
+#include <put/cxxutils/vterm.h>
+
+// Project
+#include "tracer.h"
+
+#ifndef ARENA_BLOCK_SIZE
+#define ARENA_BLOCK_SIZE  (64 * 1024) // bytes mapped at a time (larger allocations get a block of their own)
+#endif
+
+#ifndef STATM_PATH
+#define STATM_PATH        "/proc/self/statm"
+#endif
+
+namespace Arena
+{
+  struct block_t
+  {
+    block_t* next;
+    posix::size_t size; // mapped bytes including this header
+  };
+
+  static std::mutex s_lock;
+  static block_t* s_blocks = nullptr; // newest first
+  static char* s_pos = nullptr;       // free space in the newest block
+  static char* s_end = nullptr;
+  static posix::size_t s_mapped = 0;  // bytes currently mapped
+  static posix::size_t s_peak = 0;
+
+  // every heap allocation of the process
+  static std::atomic<uint64_t> s_allocations(0);
+  static std::atomic<uint64_t> s_frees(0);
+  static uint64_t s_reported = 0; // allocations at the last report
+
+  posix::size_t resident(void) noexcept;
+}
+
+void* Arena::allocate(posix::size_t size, posix::size_t alignment) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  uintptr_t start = (uintptr_t(s_pos) + alignment - 1) & ~uintptr_t(alignment - 1);
+  if(s_pos == nullptr || start + size > uintptr_t(s_end))
+  {
+    posix::size_t length = std::max(posix::size_t(ARENA_BLOCK_SIZE), sizeof(block_t) + alignment + size);
+    void* memory = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED)
+      std::abort(); // like operator new without exceptions
+
+    block_t* block = static_cast<block_t*>(memory);
+    block->next = s_blocks;
+    block->size = length;
+    s_blocks = block;
+    s_pos = reinterpret_cast<char*>(block + 1);
+    s_end = static_cast<char*>(memory) + length;
+    s_mapped += length;
+    s_peak = std::max(s_peak, s_mapped);
+    start = (uintptr_t(s_pos) + alignment - 1) & ~uintptr_t(alignment - 1);
+  }
+  s_pos = reinterpret_cast<char*>(start + size);
+  return reinterpret_cast<void*>(start);
+}
+
+void Arena::release(void) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  while(s_blocks != nullptr)
+  {
+    block_t* block = s_blocks;
+    s_blocks = block->next;
+    ::munmap(block, block->size);
+  }
+  s_pos = s_end = nullptr;
+  s_mapped = 0;
+}
+
+// bytes of the process in memory right now
+posix::size_t Arena::resident(void) noexcept
+{
+  char buffer[128];
+  posix::fd_t fd = posix::open(STATM_PATH, O_RDONLY | O_CLOEXEC);
+  if(fd == posix::error_response)
+    return 0;
+  posix::ssize_t count = posix::read(fd, buffer, sizeof(buffer) - 1);
+  posix::close(fd);
+  if(count <= 0)
+    return 0;
+  buffer[count] = '\0';
+
+  char* pos = nullptr;
+  posix::strtoul(buffer, &pos, 10); // skip total size
+  return posix::size_t(posix::strtoul(pos, nullptr, 10)) * posix::size_t(::sysconf(_SC_PAGESIZE));
+}
+
+void Arena::report(const char* phase) noexcept
+{
+  struct rusage usage = {};
+  ::getrusage(RUSAGE_SELF, &usage);
+  uint64_t peak = uint64_t(usage.ru_maxrss); // KiB
+  uint64_t current = resident() / 1024;
+  uint64_t allocations = s_allocations;
+  uint64_t frees = s_frees;
+  uint64_t recent = allocations - s_reported;
+  s_reported = allocations;
+
+  posix::size_t arena;
+  {
+    std::lock_guard<std::mutex> guard(s_lock);
+    arena = s_peak / 1024;
+  }
+
+  terminal::write("Memory (%s): %llu KiB resident, %llu KiB peak, %llu KiB arena peak, %llu allocations (%llu since last report), %llu live\n",
+                  phase,
+                  (unsigned long long)current,
+                  (unsigned long long)peak,
+                  (unsigned long long)arena,
+                  (unsigned long long)allocations,
+                  (unsigned long long)recent,
+                  (unsigned long long)(allocations - frees));
+  Tracer::instant("memory", phase, "resident KiB", int64_t(current));
+  Tracer::instant("memory", phase, "peak KiB", int64_t(peak));
+  Tracer::instant("memory", phase, "allocations", int64_t(recent));
+}
+
+// counts heap use for the reports
+void* operator new(std::size_t size)
+{
+  void* memory = std::malloc(size ? size : 1);
+  if(memory == nullptr)
+    std::abort(); // no exceptions
+  Arena::s_allocations.fetch_add(1, std::memory_order_relaxed);
+  return memory;
+}
+
+void* operator new[](std::size_t size)
+  { return operator new(size); }
+
+void operator delete(void* memory) noexcept
+{
+  if(memory != nullptr)
+    Arena::s_frees.fetch_add(1, std::memory_order_relaxed);
+  std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+  { operator delete(memory); }
+
+void operator delete(void* memory, std::size_t) noexcept
+  { operator delete(memory); }
+
+void operator delete[](void* memory, std::size_t) noexcept
+  { operator delete(memory); }
@@ -0,0 +1,48 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+// STL
+#include <list>
+#include <unordered_map>
+
+// PUT
+#include <put/cxxutils/posix_helpers.h>
+
+// Memory for structures that only live until boot settles.  Allocations are
+// carved from large mapped blocks and never freed individually; release()
+// hands every block back at once so nothing from boot stays resident.
+namespace Arena
+{
+  extern void* allocate(posix::size_t size, posix::size_t alignment) noexcept; // aborts when out of memory
+
+  // unmaps every block (lists using the arena must be empty and other containers destroyed by then)
+  extern void release(void) noexcept;
+
+  // logs resident set size and allocation counts (and adds them to the boot trace)
+  // NOTE: phase must be a string literal
+  extern void report(const char* phase) noexcept;
+
+  template<typename T>
+  struct allocator
+  {
+    using value_type = T;
+
+    allocator(void) noexcept = default;
+    template<typename U> allocator(const allocator<U>&) noexcept { }
+
+    T* allocate(posix::size_t count) noexcept
+      { return static_cast<T*>(Arena::allocate(count * sizeof(T), alignof(T))); }
+    void deallocate(T*, posix::size_t) noexcept { } // released with the arena
+
+    template<typename U> bool operator ==(const allocator<U>&) const noexcept { return true; }
+    template<typename U> bool operator !=(const allocator<U>&) const noexcept { return false; }
+  };
+
+  template<typename T>
+  using list = std::list<T, allocator<T>>;
+
+  template<typename K, typename V>
+  using unordered_map = std::unordered_map<K, V, std::hash<K>, std::equal_to<K>, allocator<std::pair<const K, V>>>;
+}
+
+#endif // ARENA_H
@@ -0,0 +1,308 @@
+#include "bootcache.h"
+
+// STL
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+// Project
+#include "timer.h"
+#include "tracer.h"
+
+#ifndef BOOTCACHE_MAX_SIZE
+#define BOOTCACHE_MAX_SIZE        (1 << 20) // larger files are ignored
+#endif
+
+#ifndef BOOTCACHE_SAVE_INTERVAL
+#define BOOTCACHE_SAVE_INTERVAL   10000 // milliseconds
+#endif
+
+#ifndef BOOTCACHE_SAVE_ATTEMPTS
+#define BOOTCACHE_SAVE_ATTEMPTS   30
+#endif
+
+#define BOOTCACHE_MAGIC           0x43425853 // "SXBC"
+#define BOOTCACHE_VERSION         1
+
+namespace BootCache
+{
+  // file layout: header_t then each record_t followed by its name and data
+  struct header_t
+  {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_count;
+    char release[sizeof(utsname::release)]; // kernel the records were made under
+  };
+
+  struct record_t
+  {
+    uint64_t stamp;
+    uint32_t name_size;
+    uint32_t data_size;
+  };
+
+  struct entry_t
+  {
+    uint64_t stamp;
+    std::vector<char> data;
+    bool used;  // this boot (unused records are dropped when saving)
+    bool dirty; // differs from (or is missing in) the file at path
+  };
+
+  static const char* s_path = nullptr;
+  static const char* s_early_path = nullptr;
+  static bool s_read = false;
+  static bool s_early_read = false;
+  static std::unordered_map<std::string, entry_t> s_entries;
+  static std::mutex s_lock;
+  static Timer::id_t s_save_timer = posix::error_response;
+  static uint16_t s_save_attempts = 0;
+
+  void read(void) noexcept;
+  bool load(const char* path, bool early = false) noexcept;
+  bool changed(void) noexcept;
+  bool write(void) noexcept;
+}
+
+void BootCache::open(const char* path, const char* early_path) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  s_path = path;
+  s_early_path = early_path;
+  s_read = false;
+  s_early_read = false;
+}
+
+uint64_t BootCache::stamp(const char* path, uint64_t seed) noexcept
+{
+  struct stat state = {};
+  uint64_t fields[] = { 0, 0, 0, 0, 0 };
+  if(::stat(path, &state) == posix::success_response)
+  {
+    fields[0] = uint64_t(state.st_dev);
+    fields[1] = uint64_t(state.st_ino);
+    fields[2] = uint64_t(state.st_size);
+    fields[3] = uint64_t(state.st_mtim.tv_sec);
+    fields[4] = uint64_t(state.st_mtim.tv_nsec);
+  }
+
+  uint64_t value = seed ^ 0xCBF29CE484222325ULL; // FNV-1a
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(fields);
+  for(posix::size_t pos = 0; pos < sizeof(fields); ++pos)
+    value = (value ^ bytes[pos]) * 0x100000001B3ULL;
+  return value ? value : 1; // a stamp is never 0
+}
+
+// NOTE: s_lock must be held
+void BootCache::read(void) noexcept
+{
+  if(s_read || s_path == nullptr)
+    return;
+
+  if(load(s_path) || errno != ENOENT) // a missing file may just not be mounted yet
+    s_read = true;
+  else if(!s_early_read && s_early_path != nullptr)
+  {
+    s_early_read = true;
+    load(s_early_path, true); // stands in until the root filesystem is mounted
+  }
+}
+
+// NOTE: s_lock must be held
+// returns false only if the file couldn't be opened
+bool BootCache::load(const char* path, bool early) noexcept
+{
+  posix::fd_t fd = posix::open(path, O_RDONLY | O_CLOEXEC);
+  if(fd == posix::error_response)
+    return false;
+
+  uint64_t start = Tracer::now();
+  struct stat state;
+  std::vector<char> buffer;
+  if(::fstat(fd, &state) == posix::success_response &&
+     state.st_size >= posix::ssize_t(sizeof(header_t)) &&
+     state.st_size <= BOOTCACHE_MAX_SIZE)
+  {
+    buffer.resize(posix::size_t(state.st_size));
+    if(posix::read(fd, buffer.data(), buffer.size()) != posix::ssize_t(buffer.size()))
+      buffer.clear();
+  }
+  posix::close(fd);
+
+  struct utsname system;
+  header_t header;
+  if(buffer.empty() || ::uname(&system) == posix::error_response)
+    return true;
+  posix::memcpy(&header, buffer.data(), sizeof(header));
+  if(header.magic != BOOTCACHE_MAGIC ||
+     header.version != BOOTCACHE_VERSION ||
+     std::strncmp(header.release, system.release, sizeof(header.release))) // booted another kernel
+    return true;
+
+  const char* pos = buffer.data() + sizeof(header_t);
+  const char* end = buffer.data() + buffer.size();
+  for(uint16_t count = 0; count < header.record_count; ++count)
+  {
+    record_t record;
+    if(end - pos < posix::ssize_t(sizeof(record_t)))
+      break;
+    posix::memcpy(&record, pos, sizeof(record));
+    pos += sizeof(record_t);
+    if(posix::size_t(end - pos) < posix::size_t(record.name_size) + record.data_size) // truncated
+      break;
+
+    std::string name(pos, record.name_size);
+    pos += record.name_size;
+    auto entry = s_entries.find(name);
+    if(entry == s_entries.end() || !entry->second.used)
+      s_entries[name] = entry_t{ record.stamp, std::vector<char>(pos, pos + record.data_size), false, early };
+    else if(!early) // records used this boot are newer: only keep track of whether they match
+      entry->second.dirty = entry->second.stamp != record.stamp ||
+                            entry->second.data.size() != record.data_size ||
+                            !std::equal(pos, pos + record.data_size, entry->second.data.begin());
+    pos += record.data_size;
+  }
+  Tracer::complete("cache", "read", start, nullptr, int64_t(s_entries.size()));
+  return true;
+}
+
+bool BootCache::get(const char* name, uint64_t stamp, std::vector<char>& data) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  read();
+  auto entry = s_entries.find(name);
+  if(entry == s_entries.end() || entry->second.stamp != stamp)
+    return false;
+  entry->second.used = true;
+  data = entry->second.data;
+  return true;
+}
+
+void BootCache::put(const char* name, uint64_t stamp, const void* data, posix::size_t size) noexcept
+{
+  const char* bytes = static_cast<const char*>(data);
+  std::lock_guard<std::mutex> guard(s_lock);
+  auto inserted = s_entries.emplace(name, entry_t{ stamp, std::vector<char>(), false, true });
+  entry_t& entry = inserted.first->second;
+  if(inserted.second || entry.stamp != stamp || entry.data.size() != size || !std::equal(bytes, bytes + size, entry.data.begin()))
+  {
+    entry.stamp = stamp;
+    entry.data.assign(bytes, bytes + size);
+    entry.dirty = true;
+  }
+  entry.used = true;
+}
+
+// NOTE: s_lock must be held
+// whether the saved file differs from what would be written now
+bool BootCache::changed(void) noexcept
+{
+  for(const auto& pair : s_entries)
+    if(pair.second.used == pair.second.dirty) // new or changed, or saved but no longer used
+      return true;
+  return false;
+}
+
+// NOTE: s_lock must be held
+// writes beside the final name first so a partial cache is never read
+bool BootCache::write(void) noexcept
+{
+  struct utsname system;
+  if(::uname(&system) == posix::error_response)
+    return false;
+
+  header_t header = {};
+  header.magic = BOOTCACHE_MAGIC;
+  header.version = BOOTCACHE_VERSION;
+  posix::strncpy(header.release, system.release, sizeof(header.release));
+
+  std::vector<char> buffer(sizeof(header_t));
+  for(const auto& pair : s_entries)
+  {
+    if(!pair.second.used || header.record_count == UINT16_MAX)
+      continue;
+    record_t record = { pair.second.stamp, uint32_t(pair.first.size()), uint32_t(pair.second.data.size()) };
+    const char* bytes = reinterpret_cast<const char*>(&record);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(record));
+    buffer.insert(buffer.end(), pair.first.begin(), pair.first.end());
+    buffer.insert(buffer.end(), pair.second.data.begin(), pair.second.data.end());
+    ++header.record_count;
+  }
+  posix::memcpy(buffer.data(), &header, sizeof(header));
+
+  char temporary[PATH_MAX];
+  char directory[PATH_MAX];
+  posix::snprintf(temporary, sizeof(temporary), "%s.new", s_path);
+  posix::strncpy(directory, s_path, sizeof(directory) - 1);
+  directory[sizeof(directory) - 1] = '\0';
+  char* slash = std::strrchr(directory, '/');
+  if(slash != nullptr && slash != directory)
+  {
+    *slash = '\0';
+    ::mkdir(directory, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH); // create directory (if it doesn't exist)
+  }
+
+  posix::fd_t fd = posix::open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  bool saved = fd != posix::error_response &&
+               posix::write(fd, buffer.data(), buffer.size()) == posix::ssize_t(buffer.size());
+  if(fd != posix::error_response)
+    posix::close(fd);
+  saved = saved && ::rename(temporary, s_path) == posix::success_response;
+  int error = errno;
+  if(!saved && fd != posix::error_response)
+    ::unlink(temporary);
+  errno = error;
+  return saved;
+}
+
+void BootCache::save(void) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  if(s_path == nullptr)
+    return;
+
+  read(); // compare with the saved copy once it can be reached
+  if(!changed())
+  {
+    Timer::stop(s_save_timer);
+    return;
+  }
+
+  if(write())
+  {
+    for(auto pos = s_entries.begin(); pos != s_entries.end();)
+    {
+      if(pos->second.used)
+        (pos++)->second.dirty = false;
+      else
+        pos = s_entries.erase(pos);
+    }
+    s_read = true; // the file now matches
+    Timer::stop(s_save_timer);
+    return;
+  }
+
+  if(errno != EROFS && errno != ENOENT && errno != EACCES) // not a problem that mounting will solve
+  {
+    Timer::stop(s_save_timer);
+    terminal::write("%s Unable to save boot cache to %s: %s\n", terminal::warning, s_path, posix::strerror(errno));
+    return;
+  }
+
+  if(s_save_timer == posix::error_response && s_save_attempts < BOOTCACHE_SAVE_ATTEMPTS)
+    s_save_timer = Timer::start(BOOTCACHE_SAVE_INTERVAL,
+                                []() noexcept
+                                {
+                                  if(++s_save_attempts >= BOOTCACHE_SAVE_ATTEMPTS)
+                                    Timer::stop(s_save_timer); // give up
+                                  save();
+                                }, true);
+}
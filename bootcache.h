@@ -0,0 +1,33 @@
+#ifndef BOOTCACHE_H
+#define BOOTCACHE_H
+
+// STL
+#include <vector>
+
+// PUT
+#include <put/cxxutils/posix_helpers.h>
+
+// Results of expensive probing kept from one boot to the next.  Each record
+// is stored with a stamp of whatever it was derived from and is only handed
+// back while the stamp (and the kernel release) still match, so callers
+// fall back to probing as soon as anything changes.
+namespace BootCache
+{
+  // where the records are kept (read lazily since it may be on a filesystem that isn't mounted yet)
+  // early_path (optional) is read instead while path is missing, e.g. a copy placed in the initramfs
+  // NOTE: paths must outlive the boot (string literals or static storage)
+  extern void open(const char* path, const char* early_path = nullptr) noexcept;
+
+  // cheap stamp of a file from its device, inode, size and modification time (missing files are stamped too)
+  // seed chains stamps of several files into one
+  extern uint64_t stamp(const char* path, uint64_t seed = 0) noexcept;
+
+  // copies the record named name if it was stored with the same stamp
+  extern bool get(const char* name, uint64_t stamp, std::vector<char>& data) noexcept;
+  extern void put(const char* name, uint64_t stamp, const void* data, posix::size_t size) noexcept;
+
+  // writes the records used this boot if they differ from the file at path, now or once the filesystem becomes writable
+  extern void save(void) noexcept;
+}
+
+#endif // BOOTCACHE_H
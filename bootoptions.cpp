@@ -0,0 +1,132 @@
+#include "bootoptions.h"
+
+// STL
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+// POSIX
+#include <fcntl.h>
+
+// PUT
+#include <put/cxxutils/hashing.h>
+
+#ifndef CMDLINE_CAPACITY
+#define CMDLINE_CAPACITY  0x2000 // 8KB (longer command lines are truncated)
+#endif
+
+namespace BootOptions
+{
+  static char s_arena[CMDLINE_CAPACITY + 1]; // unquoted, NUL separated copy of the command line
+  static const char* s_values[size_t(Option::Count)]; // slices of s_arena
+
+  void tokenize(posix::size_t length) noexcept;
+  void assign(const char* key, posix::size_t length, const char* value) noexcept;
+}
+
+bool BootOptions::load(const char* path) noexcept
+{
+  posix::fd_t fd = posix::open(path, O_RDONLY);
+  if(fd == posix::error_response)
+    return false;
+
+  posix::size_t length = 0;
+  posix::ssize_t count = 0;
+  while(length < CMDLINE_CAPACITY &&
+        (count = posix::read(fd, s_arena + length, CMDLINE_CAPACITY - length)) > 0)
+    length += posix::size_t(count);
+  posix::close(fd);
+
+  tokenize(length); // parse in place
+  return count != posix::error_response;
+}
+
+void BootOptions::parse(const char* text, posix::size_t length) noexcept
+{
+  length = std::min(length, posix::size_t(CMDLINE_CAPACITY));
+  std::memcpy(s_arena, text, length);
+  tokenize(length);
+}
+
+const char* BootOptions::get(Option option) noexcept
+{
+  return option < Option::Count ? s_values[size_t(option)] : nullptr;
+}
+
+// single pass over s_arena: unquoted tokens are compacted toward the front (the write cursor never passes the read cursor)
+void BootOptions::tokenize(posix::size_t length) noexcept
+{
+  std::fill(std::begin(s_values), std::end(s_values), nullptr);
+
+  char* end = std::find(s_arena, s_arena + length, '\0'); // embedded NUL ends the command line
+  char* r = s_arena;
+  char* w = s_arena;
+
+  while(r < end)
+  {
+    while(r < end && posix::isspace(*r))
+      ++r;
+    if(r == end)
+      break;
+
+    char* key = w;
+    char* key_end = nullptr;
+    char* value = nullptr;
+    bool quoted = false;
+    for(; r < end && (quoted || !posix::isspace(*r)); ++r)
+    {
+      if(*r == '"') // quotes may wrap the value or the whole parameter and are dropped
+        quoted = !quoted;
+      else if(value == nullptr && *r == '=')
+      {
+        key_end = w;
+        *w++ = '\0';
+        value = w;
+      }
+      else
+        *w++ = value == nullptr ? char(std::tolower(uint8_t(*r))) : *r; // options must be lowercase
+    }
+    if(key_end == nullptr)
+      key_end = w;
+
+    if(r < end) // step over the separator before it can be overwritten
+      ++r;
+    *w++ = '\0';
+
+    if(value == nullptr && key_end - key == 2 && key[0] == '-' && key[1] == '-')
+      break; // everything after "--" is for init
+    assign(key, posix::size_t(key_end - key), value);
+  }
+}
+
+// later occurrences override earlier ones, as they do for the kernel
+void BootOptions::assign(const char* key, posix::size_t length, const char* value) noexcept
+{
+  auto set = [value](Option option, const char* implied = nullptr) noexcept
+  {
+    const char* result = value != nullptr && *value ? value : implied; // empty values are as good as none
+    if(result != nullptr)
+      s_values[size_t(option)] = result;
+  };
+
+  switch(hash(key, length))
+  {
+    case "root"_hash:         set(Option::Root);                    break;
+    case "rootdelay"_hash:    set(Option::RootDelay);               break;
+    case "rootwait"_hash:     set(Option::RootWait, "yes");         break;
+    case "rootfstype"_hash:   set(Option::RootFsType);              break;
+    case "rootflags"_hash:    set(Option::RootFlags);               break;
+    case "ro"_hash:           s_values[size_t(Option::Mode)] = "ro"; break;
+    case "rw"_hash:           s_values[size_t(Option::Mode)] = "rw"; break;
+    case "init"_hash:         set(Option::Init);                    break;
+    case "debug"_hash:        set(Option::Debug, "yes");            break;
+    case "break"_hash:        set(Option::Break, "premount");       break;
+    case "noresume"_hash:     set(Option::NoResume, "premount");    break;
+    case "fsck.mode"_hash:    set(Option::FsckMode);                break;
+    case "fastboot"_hash:     set(Option::FsckMode, "skip");        break;
+    case "forcefsck"_hash:    set(Option::FsckMode, "force");       break;
+    case "fsck.repair"_hash:  set(Option::FsckRepair);              break;
+    case "fsckfix"_hash:      set(Option::FsckRepair, "yes");       break;
+    default: break; // not ours
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef BOOTOPTIONS_H
+#define BOOTOPTIONS_H
+
+// STL
+#include <cstdint>
+
+// PUT
+#include <put/cxxutils/posix_helpers.h>
+
+namespace BootOptions
+{
+  enum class Option : uint8_t
+  {
+    Root,       // root=
+    RootDelay,  // rootdelay=
+    RootWait,   // rootwait
+    RootFsType, // rootfstype=
+    RootFlags,  // rootflags=
+    Mode,       // ro or rw
+    Init,       // init=
+    Debug,      // debug
+    Break,      // break or break=
+    NoResume,   // noresume
+    FsckMode,   // fsck.mode=, fastboot or forcefsck
+    FsckRepair, // fsck.repair= or fsckfix
+    Count,
+  };
+
+  // reads and parses a kernel command line file (e.g. /proc/cmdline), replacing any previous options
+  extern bool load(const char* path) noexcept;
+
+  // parses length bytes of text as a kernel command line, replacing any previous options
+  extern void parse(const char* text, posix::size_t length) noexcept;
+
+  // value of a recognized option or nullptr if it wasn't given
+  extern const char* get(Option option) noexcept;
+
+  static inline bool has(Option option) noexcept
+    { return get(option) != nullptr; }
+}
+
+#endif // BOOTOPTIONS_H
@@ -0,0 +1,468 @@
+#include "console.h"
+
+// STL
+#include <list>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <algorithm>
+
+// POSIX
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+
+// Linux
+#if defined(__linux__)
+# include <sys/sysmacros.h>
+# include <linux/kd.h>
+#endif
+
+// PUT
+#include <put/specialized/eventbackend.h>
+
+#ifndef CONSOLE_BUFFER_SIZE
+#define CONSOLE_BUFFER_SIZE   0x8000 // 32KB: the most the screen model emits at once
+#endif
+
+#ifndef CONSOLE_STATE_LENGTH
+#define CONSOLE_STATE_LENGTH  16
+#endif
+
+#ifndef CONSOLE_LINE_LENGTH
+#define CONSOLE_LINE_LENGTH   512
+#endif
+
+#ifndef CONSOLE_CMDLINE_SIZE
+#define CONSOLE_CMDLINE_SIZE  4096
+#endif
+
+namespace Console
+{
+  enum {
+    Read = 0,
+    Write = 1,
+  };
+
+  struct console_t
+  {
+    posix::fd_t fd;
+    dev_t device;
+    int flags;                // file status flags before O_NONBLOCK was added
+    bool compact;
+    bool behind;              // full: output was dropped, redraw once it drains
+    bool watched;             // waiting for the console to accept more
+    bool resync;              // watched no longer matches what is pending (the event loop updates it)
+    uint32_t dropped;         // compact: messages lost since the last one written
+    std::vector<bool> dirty;  // compact: items whose latest state hasn't been written
+    posix::size_t used;
+    std::array<char, CONSOLE_BUFFER_SIZE> buffer;
+  };
+
+  struct item_t
+  {
+    string_literal name;
+    char state[CONSOLE_STATE_LENGTH];
+  };
+
+  static std::mutex s_lock; // display updates come from worker threads, draining happens on the event loop
+  static std::list<console_t> s_consoles; // stable addresses for the writable callbacks
+  static std::vector<item_t> s_items;
+  static redraw_slot_t s_redraw;
+  static posix::fd_t s_wakeup[2] = { posix::error_response, posix::error_response }; // asks the event loop to resync
+
+  bool add(posix::fd_t fd) noexcept;
+  dev_t identify(posix::fd_t fd, const struct stat& state) noexcept;
+  bool append(console_t& console, const char* data, posix::size_t length) noexcept;
+  bool flush(console_t& console) noexcept;
+  void drain(console_t& console) noexcept;
+  void writable(console_t* console) noexcept;
+  void resync(posix::fd_t fd, native_flags_t) noexcept;
+}
+
+bool Console::init(void) noexcept
+{
+  if(s_wakeup[Read] != posix::error_response)
+    return true;
+  if(::pipe2(s_wakeup, O_CLOEXEC | O_NONBLOCK) == posix::error_response)
+    return false;
+  if(!EventBackend::add(s_wakeup[Read], EventFlags::Readable, resync))
+  {
+    posix::close(s_wakeup[Read]);
+    posix::close(s_wakeup[Write]);
+    s_wakeup[Read] = s_wakeup[Write] = posix::error_response;
+    return false;
+  }
+  return true;
+}
+
+bool Console::attach(posix::fd_t fd) noexcept
+{
+  posix::fd_t copy = ::fcntl(fd, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+  return copy != posix::error_response && add(copy);
+}
+
+bool Console::open(const char* name) noexcept
+{
+  char path[PATH_MAX];
+  if(*name == '/')
+    posix::strncpy(path, name, sizeof(path) - 1);
+  else
+    posix::snprintf(path, sizeof(path), "/dev/%s", name);
+  path[sizeof(path) - 1] = '\0';
+
+  posix::fd_t fd = posix::open(path, O_WRONLY | O_NOCTTY | O_CLOEXEC);
+  return fd != posix::error_response && add(fd);
+}
+
+posix::size_t Console::discover(const char* path) noexcept
+{
+  char cmdline[CONSOLE_CMDLINE_SIZE];
+  posix::fd_t fd = posix::open(path, O_RDONLY | O_CLOEXEC);
+  if(fd == posix::error_response)
+    return 0;
+  posix::ssize_t length = posix::read(fd, cmdline, sizeof(cmdline) - 1);
+  posix::close(fd);
+  if(length <= 0)
+    return 0;
+  cmdline[length] = '\0';
+
+  posix::size_t count = 0;
+  char* next = nullptr;
+  for(char* token = ::strtok_r(cmdline, " \t\n", &next); token != nullptr; token = ::strtok_r(nullptr, " \t\n", &next))
+  {
+    if(posix::strncmp(token, "console=", sizeof("console=") - 1))
+      continue;
+    char* name = token + sizeof("console=") - 1;
+    char* options = posix::strchr(name, ','); // e.g. ttyS0,115200n8
+    if(options != nullptr)
+      *options = '\0';
+    if(*name && open(name))
+      ++count;
+  }
+  return count;
+}
+
+void Console::setRedraw(redraw_slot_t func) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  s_redraw = func;
+}
+
+bool Console::getSize(uint16_t& rows, uint16_t& columns) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  for(console_t& console : s_consoles)
+  {
+    struct winsize size = {};
+    if(!console.compact &&
+       ::ioctl(console.fd, TIOCGWINSZ, &size) == posix::success_response &&
+       size.ws_row && size.ws_col)
+    {
+      rows = size.ws_row;
+      columns = size.ws_col;
+      return true;
+    }
+  }
+  return false;
+}
+
+// the terminal that fd really writes to
+dev_t Console::identify(posix::fd_t fd, const struct stat& state) noexcept
+{
+  dev_t device = state.st_rdev;
+#if defined(__linux__)
+  unsigned int real = 0;
+  if(major(device) == 5 && minor(device) == 1 && // /dev/console
+     ::ioctl(fd, TIOCGDEV, &real) == posix::success_response)
+    device = makedev((real >> 8) & 0xfff, (real & 0xff) | ((real >> 12) & 0xfff00)); // kernel encoding
+  if(major(device) == 4 && minor(device) < 64) // virtual terminals share one screen
+    device = makedev(4, 0);
+#else
+  (void)fd;
+#endif
+  return device;
+}
+
+// takes ownership of fd
+bool Console::add(posix::fd_t fd) noexcept
+{
+  struct stat state;
+  if(::fstat(fd, &state) == posix::error_response ||
+     !S_ISCHR(state.st_mode) ||
+     !::isatty(fd))
+  {
+    posix::close(fd);
+    errno = ENOTTY;
+    return false;
+  }
+
+  dev_t device = identify(fd, state);
+  bool compact = true;
+#if defined(__linux__)
+  char type = 0;
+  compact = ::ioctl(fd, KDGKBTYPE, &type) == posix::error_response && // not a virtual terminal
+            (major(device) < 136 || major(device) > 143); // nor a pseudo terminal
+#endif
+
+  redraw_slot_t redraw;
+  {
+    std::lock_guard<std::mutex> guard(s_lock);
+    for(console_t& console : s_consoles)
+      if(console.device == device) // e.g. /dev/console and the console= it refers to
+      {
+        posix::close(fd);
+        return true;
+      }
+
+    int flags = ::fcntl(fd, F_GETFL);
+    if(flags == posix::error_response ||
+       ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == posix::error_response)
+    {
+      int error = errno;
+      posix::close(fd);
+      errno = error;
+      return false;
+    }
+
+    s_consoles.emplace_back();
+    console_t& console = s_consoles.back();
+    console.fd = fd;
+    console.device = device;
+    console.flags = flags;
+    console.compact = compact;
+    if(compact) // catch up on the current state of everything
+    {
+      console.dirty.resize(s_items.size());
+      for(posix::size_t index = 0; index < s_items.size(); ++index)
+        console.dirty[index] = *s_items[index].state;
+      drain(console);
+    }
+    else
+    {
+      constexpr char reset[] = CSI "?25l" CSI "2J"; // hide cursor, clear screen
+      append(console, reset, sizeof(reset) - 1);
+      flush(console);
+      redraw = s_redraw;
+    }
+  }
+
+  if(redraw)
+    redraw();
+  return true;
+}
+
+bool Console::append(console_t& console, const char* data, posix::size_t length) noexcept
+{
+  if(length > console.buffer.size() - console.used)
+    return false;
+  posix::memcpy(console.buffer.data() + console.used, data, length);
+  console.used += length;
+  return true;
+}
+
+// writes as much as the console accepts right now, true once nothing is pending
+bool Console::flush(console_t& console) noexcept
+{
+  posix::size_t offset = 0;
+  while(offset < console.used)
+  {
+    posix::ssize_t count = ::write(console.fd, console.buffer.data() + offset, console.used - offset);
+    if(count == posix::error_response)
+    {
+      if(errno == EINTR)
+        continue;
+      if(errno != EAGAIN && errno != EWOULDBLOCK) // hung up: nothing will ever get through
+        offset = console.used;
+      break;
+    }
+    offset += posix::size_t(count);
+  }
+  console.used -= offset;
+  std::memmove(console.buffer.data(), console.buffer.data() + offset, console.used);
+
+  bool waiting = console.used || console.behind;
+  if(waiting != console.watched && !console.resync && // registration is left to the event loop thread
+     s_wakeup[Write] != posix::error_response)
+  {
+    console.resync = true;
+    posix::write(s_wakeup[Write], "!", 1);
+  }
+  return !console.used;
+}
+
+// on the event loop: watches the consoles with pending output and stops watching the rest
+void Console::resync(posix::fd_t fd, native_flags_t) noexcept
+{
+  char buffer[64];
+  while(posix::read(fd, buffer, sizeof(buffer)) > 0) // one pass covers every request so far
+    continue;
+
+  std::lock_guard<std::mutex> guard(s_lock);
+  for(console_t& console : s_consoles)
+  {
+    if(!console.resync)
+      continue;
+    console.resync = false;
+    bool waiting = console.used || console.behind;
+    if(waiting == console.watched)
+      continue;
+    if(waiting)
+    {
+      console_t* target = &console;
+      console.watched = EventBackend::add(console.fd, EventFlags::Writeable,
+                                          [target](posix::fd_t, native_flags_t) noexcept { writable(target); });
+    }
+    else
+      console.watched = !EventBackend::remove(console.fd, EventFlags::Writeable);
+  }
+}
+
+// writes the latest state of every changed item that fits (intermediate states are never queued)
+// and how many messages didn't fit
+void Console::drain(console_t& console) noexcept
+{
+  char line[CONSOLE_LINE_LENGTH];
+  do
+  {
+    if(console.dropped)
+    {
+      int length = posix::snprintf(line, sizeof(line), "(%u messages dropped)\n", console.dropped);
+      if(!append(console, line, posix::size_t(length)))
+        continue; // full: flush and stop
+      console.dropped = 0;
+    }
+
+    for(posix::size_t index = 0; index < console.dirty.size(); ++index)
+    {
+      if(!console.dirty[index])
+        continue;
+      int length = posix::snprintf(line, sizeof(line), "%s: %s\n", s_items[index].name, s_items[index].state);
+      if(length < 0 || !append(console, line, std::min(posix::size_t(length), sizeof(line) - 1)))
+        break; // full
+      console.dirty[index] = false;
+    }
+  } while(flush(console) &&
+          (console.dropped || std::find(console.dirty.begin(), console.dirty.end(), true) != console.dirty.end()));
+}
+
+void Console::writable(console_t* console) noexcept
+{
+  redraw_slot_t redraw;
+  {
+    std::lock_guard<std::mutex> guard(s_lock);
+    if(console->compact)
+      drain(*console);
+    else if(flush(*console) && console->behind) // caught up
+    {
+      console->behind = false;
+      append(*console, "\x18", 1); // cancel an escape sequence that was cut short
+      flush(*console);
+      redraw = s_redraw;
+    }
+  }
+
+  if(redraw)
+    redraw();
+}
+
+void Console::write(const struct iovec* iov, int count) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  for(console_t& console : s_consoles)
+  {
+    if(console.compact || console.behind)
+      continue;
+
+    posix::size_t skip = 0; // bytes the terminal took directly
+    if(!console.used) // nothing queued: hand it straight to the terminal
+    {
+      posix::ssize_t written = ::writev(console.fd, iov, count);
+      if(written > 0)
+        skip = posix::size_t(written);
+    }
+
+    for(int index = 0; index < count; ++index)
+    {
+      posix::size_t done = std::min(skip, posix::size_t(iov[index].iov_len));
+      skip -= done;
+      if(!append(console, static_cast<const char*>(iov[index].iov_base) + done, iov[index].iov_len - done))
+      {
+        console.used = 0; // drop it all and redraw the whole screen once the console catches up
+        console.behind = true;
+        break;
+      }
+    }
+    flush(console);
+  }
+}
+
+void Console::report(string_literal item, const char* state) noexcept
+{
+  while(*state == ' ') // states are padded to fill their slot
+    ++state;
+  posix::size_t length = posix::strlen(state);
+  while(length && state[length - 1] == ' ')
+    --length;
+  length = std::min(length, posix::size_t(CONSOLE_STATE_LENGTH - 1));
+
+  std::lock_guard<std::mutex> guard(s_lock);
+  auto pos = std::find_if(s_items.begin(), s_items.end(),
+                          [item](const item_t& entry) noexcept { return entry.name == item; });
+  if(pos == s_items.end())
+  {
+    pos = s_items.insert(s_items.end(), item_t{ item, {} });
+    for(console_t& console : s_consoles)
+      if(console.compact)
+        console.dirty.push_back(false);
+  }
+
+  if(!posix::strncmp(pos->state, state, length) && !pos->state[length]) // unchanged
+    return;
+  posix::memcpy(pos->state, state, length);
+  pos->state[length] = '\0';
+  if(!length) // cleared
+    return;
+
+  posix::size_t index = posix::size_t(pos - s_items.begin());
+  for(console_t& console : s_consoles)
+    if(console.compact)
+    {
+      console.dirty[index] = true;
+      drain(console);
+    }
+}
+
+void Console::message(const char* line) noexcept
+{
+  char text[CONSOLE_LINE_LENGTH];
+  int length = posix::snprintf(text, sizeof(text), "%s\n", line);
+  if(length < 0)
+    return;
+  length = std::min(length, int(sizeof(text) - 1));
+
+  std::lock_guard<std::mutex> guard(s_lock);
+  for(console_t& console : s_consoles)
+  {
+    if(!console.compact)
+      continue;
+    drain(console); // makes room and reports earlier losses
+    if(console.dropped || !append(console, text, posix::size_t(length)))
+      ++console.dropped;
+    flush(console);
+  }
+}
+
+void Console::release(void) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  for(console_t& console : s_consoles)
+  {
+    console.behind = false;
+    console.used = 0;
+    flush(console); // the event loop stops watching it
+    ::fcntl(console.fd, F_SETFL, console.flags);
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+// PUT
+#include <put/object.h>
+#include <put/cxxutils/vterm.h>
+
+struct iovec;
+
+// Fans display output out to every console without ever blocking.  Full
+// consoles (virtual terminals, ptys) receive the screen model's output while
+// compact consoles (serial lines) receive one plain line per status change.
+// A console that falls behind loses its pending output instead of queueing
+// it: compact ones only get the latest state of each item and full ones are
+// redrawn once they drain.
+namespace Console
+{
+  using redraw_slot_t = Object::fslot_t<void>;
+
+  // lets the event loop watch consoles that fall behind (everything else may be called from any thread)
+  // NOTE: call from the event loop thread before any other thread starts
+  extern bool init(void) noexcept;
+
+  // adopts an open terminal (e.g. /dev/console on stdout at boot)
+  extern bool attach(posix::fd_t fd) noexcept;
+
+  // opens a console by name ("ttyS0") or path, consoles already open are ignored
+  extern bool open(const char* name) noexcept;
+
+  // opens every console= of a kernel command line file, returns how many were added
+  extern posix::size_t discover(const char* path) noexcept;
+
+  // invoked without locks held when full consoles need the whole screen again
+  extern void setRedraw(redraw_slot_t func) noexcept;
+
+  // size of the first full console
+  extern bool getSize(uint16_t& rows, uint16_t& columns) noexcept;
+
+  extern void write(const struct iovec* iov, int count) noexcept; // screen output for full consoles
+  extern void report(string_literal item, const char* state) noexcept; // status change for compact consoles
+  extern void message(const char* line) noexcept; // for compact consoles
+
+  // drops pending output and makes the consoles blocking again (before handing a terminal to a shell)
+  extern void release(void) noexcept;
+}
+
+#endif // CONSOLE_H
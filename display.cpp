@@ -1,58 +1,146 @@
 #include "display.h"
 
 // STL
-#include <map>
-#include <array>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
 
 // PUT
 #include <put/cxxutils/hashing.h>
 
 // Project
+#include "screen.h"
+#include "console.h"
 #ifdef WANT_SPLASH
 #include "splash.h"
 #include "framebuffer.h"
 #endif
 
+#ifndef DISPLAY_DEFAULT_ROWS
+#define DISPLAY_DEFAULT_ROWS     25
+#endif
+
+#ifndef DISPLAY_DEFAULT_COLUMNS
+#define DISPLAY_DEFAULT_COLUMNS  80
+#endif
+
 namespace Display
 {
   static bool kernel_called = posix::getpid() == 1;
+  static std::mutex s_lock; // init steps report from worker threads
+  static uint16_t s_frame_depth = 0;
 #ifdef WANT_SPLASH
-  static Framebuffer fb;
+  static FrameBuffer fb;
+  static bool s_graphics = false; // the screen is drawn into the framebuffer rather than sent to consoles
+
+  struct colors_t
+  {
+    string_literal style;
+    uint32_t foreground; // 0xRRGGBB
+    uint32_t background;
+  };
+  static std::vector<colors_t> s_colors; // styles already parsed
+
+  void paintText(uint16_t row, uint16_t column, const char* text, uint16_t count, string_literal style) noexcept;
+  const colors_t& colors(string_literal style) noexcept;
 #endif
-  constexpr posix::size_t maxRows = 10;
-  constexpr posix::size_t maxColumns = 10;
+  constexpr uint16_t stateWidth = 8; // between the brackets
+  constexpr uint16_t columnPadding = 16; // name padding, brackets and the gap to the next column
+
+  struct item_t
+  {
+    string_literal name;
+    uint16_t length;    // of name
+    uint16_t row;       // within its column
+    uint16_t column;
+    bool placed;        // by setItem() rather than addItem()
+    string_literal style;
+    char state[stateWidth + 1];
+  };
 
   static uint16_t screenRows = 0;
   static uint16_t screenColumns = 0;
   static uint16_t offsetRows = 0;
   static uint16_t offsetColumns = 0;
-  static std::map<string_literal, std::pair<uint16_t, uint16_t>> itempos;
-  static std::array<std::array<const char*, maxRows>, maxColumns> items;
-  static std::array<uint16_t, maxColumns> item_column_widths;
+  static char s_bailout[512] = { 0 };
+
+  static std::vector<item_t> s_items;
+  static std::unordered_map<string_literal, uint32_t> s_index; // keyed by pointer like the step ids
+  static std::vector<uint16_t> s_widths;  // longest name of each column
+  static std::vector<uint32_t> s_offsets = { 0 }; // of each column from the first one (one more entry than columns)
+  static uint16_t s_rows_per_column = 1;
+  static uint32_t s_added = 0;            // items placed by addItem()
+  static uint16_t s_first_column = 0;     // leftmost column in view
+  static bool s_layout_changed = false;   // the whole item area must be redrawn
 
-  constexpr uint16_t getColumnOffset(uint16_t column) noexcept
-    { return !column ? 0 : item_column_widths.at(column - 1) + 16 + getColumnOffset(column - 1); }
+  // terminal coordinates are one based
+  static inline uint16_t toScreen(uint16_t pos) noexcept
+    { return pos ? pos - 1 : 0; }
+
+  static inline void present(void) noexcept
+  {
+    if(s_frame_depth) // changes are coalesced until the outermost frame ends
+      return;
+#ifdef WANT_SPLASH
+    if(s_graphics) // compact consoles still get reports
+    {
+      Screen::paint(paintText);
+      return;
+    }
+#endif
+    Screen::flush(Console::write);
+  }
+
+  void redraw(void) noexcept;
+  void drawTitle(void) noexcept;
+  void drawBailout(void) noexcept;
+  void place(item_t& item, uint16_t row, uint16_t column) noexcept;
+  void updateOffsets(uint16_t column) noexcept;
+  void layout(void) noexcept;
+  bool visible(const item_t& item) noexcept;
+  bool scrollTo(uint16_t column) noexcept;
+  void drawItem(const item_t& item) noexcept;
+  void drawItems(void) noexcept;
+  bool checkSize(void) noexcept;
 }
 
 void Display::init(void) noexcept
 {
   clearItems();
 
-  terminal::hideCursor();
-  terminal::clearScreen();
+  Console::init();
+  Console::attach(STDOUT_FILENO); // hides the cursor and clears the screen
+  Console::setRedraw(redraw);
+  if(!Console::getSize(screenRows, screenColumns)) // only serial consoles: draw for a terminal that may come later
+  {
+    screenRows = DISPLAY_DEFAULT_ROWS;
+    screenColumns = DISPLAY_DEFAULT_COLUMNS;
+  }
+  {
+    std::lock_guard<std::mutex> guard(s_lock);
+    Screen::resize(screenRows, screenColumns);
+    layout();
+  }
+
   if(true || kernel_called)
   {
 #ifdef WANT_SPLASH
-    fb.open("/dev/fb0");
-    fb.load(data, width, height);
+    if(fb.open("/dev/fb0") &&
+       fb.loadRLE(splash::data, sizeof(splash::data), splash::width, splash::height) &&
+       fb.textRows() && fb.textColumns())
+    {
+      std::lock_guard<std::mutex> guard(s_lock);
+      s_graphics = true; // the text console would draw over the splash
+      screenRows = uint16_t(std::min<uint32_t>(fb.textRows(), UINT16_MAX));
+      screenColumns = uint16_t(std::min<uint32_t>(fb.textColumns(), UINT16_MAX));
+      Screen::resize(screenRows, screenColumns); // cells left blank keep showing the splash
+      layout();
+    }
 #else
-    terminal::getWindowSize(screenRows, screenColumns);
-    terminal::setCursorPosition(1, 1);
-    terminal::write(CSI "0;47;30m");// reset; white background; black foreground
-    for(uint16_t pos = 0; pos < screenColumns;)
-      pos += terminal::write(' ');
-    setText(1, (screenColumns - string_length("SYSTEM X")) / 2, "", "SYSTEM X"); // print in the middle of the line
-    terminal::write(terminal::style::reset); // reset
+    std::lock_guard<std::mutex> guard(s_lock);
+    drawTitle();
+    present();
 #endif
   }
   else
@@ -60,103 +148,313 @@ void Display::init(void) noexcept
 }
 
 
+// a console was added or caught up after dropping output
+void Display::redraw(void) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+#ifdef WANT_SPLASH
+  if(s_graphics) // full consoles aren't drawn to
+    return;
+#endif
+  if(!checkSize()) // resizing redraws everything anyway
+    Screen::invalidate();
+  if(s_layout_changed)
+    drawItems();
+  present();
+}
+
+void Display::drawTitle(void) noexcept
+{
+#ifndef WANT_SPLASH
+  constexpr string_literal title_style = CSI "0;47;30m"; // reset; white background; black foreground
+  Screen::fill(0, 0, title_style, ' ', screenColumns);
+  Screen::put(0, toScreen((screenColumns - string_length("SYSTEM X")) / 2), title_style, "SYSTEM X"); // print in the middle of the line
+#endif
+}
+
+void Display::drawBailout(void) noexcept
+{
+  uint16_t row = toScreen(screenRows - 1);
+  uint16_t length = Screen::put(row, 0, terminal::critical, s_bailout);
+  Screen::fill(row, length, terminal::style::reset, ' ', screenColumns - length); // clear remains of previous message
+}
+
+// follows the size of the first full console (there is no SIGWINCH without a controlling terminal)
+bool Display::checkSize(void) noexcept
+{
+  uint16_t rows = 0;
+  uint16_t columns = 0;
+#ifdef WANT_SPLASH
+  if(s_graphics) // sized by the framebuffer
+    return false;
+#endif
+  if(!Console::getSize(rows, columns) ||
+     (rows == screenRows && columns == screenColumns))
+    return false;
+
+  screenRows = rows;
+  screenColumns = columns;
+  Screen::resize(screenRows, screenColumns);
+  Screen::invalidate(); // the terminal may have reflowed what it showed
+  drawTitle();
+  drawBailout();
+  layout();
+  return true;
+}
+
+#ifdef WANT_SPLASH
+// VGA colors for SGR styles, bold brightens the foreground
+const Display::colors_t& Display::colors(string_literal style) noexcept
+{
+  static const uint32_t palette[16] =
+  {
+    0x000000, 0xAA0000, 0x00AA00, 0xAA5500, 0x0000AA, 0xAA00AA, 0x00AAAA, 0xAAAAAA,
+    0x555555, 0xFF5555, 0x55FF55, 0xFFFF55, 0x5555FF, 0xFF55FF, 0x55FFFF, 0xFFFFFF,
+  };
+
+  for(const colors_t& entry : s_colors)
+    if(entry.style == style)
+      return entry;
+
+  uint8_t foreground = 7;
+  uint8_t background = 0;
+  bool bold = false;
+  uint32_t code = 0;
+  bool in_sequence = false;
+  for(const char* pos = style; pos != nullptr && *pos; ++pos)
+  {
+    if(*pos == '[')
+    {
+      in_sequence = true;
+      code = 0;
+    }
+    else if(in_sequence && posix::isdigit(*pos))
+      code = code * 10 + uint32_t(*pos - '0');
+    else if(in_sequence && (*pos == ';' || *pos == 'm'))
+    {
+      if(!code)                           { foreground = 7; background = 0; bold = false; }
+      else if(code == 1)                  bold = true;
+      else if(code == 22)                 bold = false;
+      else if(code >= 30 && code <= 37)   foreground = uint8_t(code - 30);
+      else if(code == 39)                 foreground = 7;
+      else if(code >= 40 && code <= 47)   background = uint8_t(code - 40);
+      else if(code == 49)                 background = 0;
+      else if(code >= 90 && code <= 97)   foreground = uint8_t(code - 90 + 8);
+      else if(code >= 100 && code <= 107) background = uint8_t(code - 100 + 8);
+      code = 0;
+      in_sequence = *pos == ';';
+    }
+  }
+  if(bold && foreground < 8)
+    foreground += 8;
+
+  s_colors.push_back(colors_t{ style, palette[foreground], palette[background] });
+  return s_colors.back();
+}
+
+void Display::paintText(uint16_t row, uint16_t column, const char* text, uint16_t count, string_literal style) noexcept
+{
+  const colors_t& pair = colors(style);
+  fb.drawText(row, column, text, count, pair.foreground, pair.background);
+}
+#endif
+
 void Display::setText(uint16_t row, uint16_t column, string_literal style, const char* text) noexcept
 {
-  terminal::setCursorPosition(row, column);
-  terminal::write(style);
-  terminal::write(text);
-  terminal::write('\n');
+  std::lock_guard<std::mutex> guard(s_lock);
+  Screen::put(toScreen(row), toScreen(column), style, text);
+  present();
+}
+
+void Display::beginFrame(void) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  ++s_frame_depth;
+}
+
+void Display::endFrame(void) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  if(s_frame_depth)
+    --s_frame_depth;
+  if(!s_frame_depth)
+    checkSize();
+  if(s_layout_changed)
+    drawItems();
+  present();
 }
 
 void Display::clearItems(void) noexcept
 {
+  std::lock_guard<std::mutex> guard(s_lock);
   offsetRows = 0;
   offsetColumns = 0;
-  for(auto& rowitems : items)
-    rowitems.fill(nullptr);
-  item_column_widths.fill(0);
-  itempos.clear();
+  s_items.clear();
+  s_index.clear();
+  s_added = 0;
+  layout();
 }
 
 bool Display::setItemsLocation(uint16_t row, uint16_t column) noexcept
 {
-  if(row >= maxRows || column == maxColumns)
+  std::lock_guard<std::mutex> guard(s_lock);
+  if(row >= screenRows || column >= screenColumns)
     return false;
   offsetRows = row;
   offsetColumns = column;
+  layout();
   return true;
 }
 
 bool Display::addItem(string_literal item) noexcept
 {
-  uint16_t column = 0;
-  uint16_t row = 0;
-  while(items.at(column).at(row) != nullptr)
-  {
-    if(row == maxRows)
-    {
-      row = 0;
-      ++column;
-    }
-    else
-      ++row;
-    if(column == maxColumns)
-      return false;
-  }
-  return setItem(item, row, column);
+  std::lock_guard<std::mutex> guard(s_lock);
+  posix::size_t length = posix::strlen(item);
+  if(length > UINT16_MAX || !s_index.emplace(item, uint32_t(s_items.size())).second)
+    return false;
+
+  s_items.push_back(item_t{ item, uint16_t(length), 0, 0, false, terminal::style::reset, { 0 } });
+  place(s_items.back(), uint16_t(s_added % s_rows_per_column), uint16_t(s_added / s_rows_per_column));
+  ++s_added;
+  return true;
 }
 
 bool Display::setItem(string_literal item, uint16_t row, uint16_t column) noexcept
 {
-  if(row >= maxRows || column == maxColumns)
-    return false;
-  size_t len = posix::strlen(item);
-  if(len > UINT16_MAX)
+  std::lock_guard<std::mutex> guard(s_lock);
+  posix::size_t length = posix::strlen(item);
+  if(length > UINT16_MAX || !s_index.emplace(item, uint32_t(s_items.size())).second)
     return false;
-  uint16_t& current = item_column_widths.at(column);
-  if(len > current)
-    current = uint16_t(len);
 
-  items.at(column).at(row) = item;
-  return itempos.emplace(item, std::make_pair(row, column)).second;
+  s_items.push_back(item_t{ item, uint16_t(length), 0, 0, true, terminal::style::reset, { 0 } });
+  place(s_items.back(), row, column);
+  return true;
 }
 
-bool Display::setItemState(string_literal item, string_literal style, string_literal state) noexcept
+// records the position of item and widens its column if needed
+void Display::place(item_t& item, uint16_t row, uint16_t column) noexcept
 {
-  auto pos = itempos.find(item);
-  if(pos == itempos.end())
-    return false;
+  item.row = row;
+  item.column = column;
+  if(column >= s_widths.size())
+  {
+    s_widths.resize(column + 1, 0);
+    s_offsets.resize(column + 2, s_offsets.back());
+  }
+  if(item.length > s_widths[column])
+  {
+    s_widths[column] = item.length;
+    updateOffsets(column);
+  }
+}
 
-  uint16_t rowpos = offsetRows + pos->second.first + 1;
-  uint16_t colpos = offsetColumns + getColumnOffset(pos->second.second) + 1;
-  terminal::write(terminal::style::reset); // reset
+// columns after column moved because it changed width
+void Display::updateOffsets(uint16_t column) noexcept
+{
+  for(posix::size_t pos = column; pos < s_widths.size(); ++pos)
+    s_offsets[pos + 1] = s_offsets[pos] + s_widths[pos] + columnPadding;
+  s_layout_changed = true;
+}
 
-  terminal::setCursorPosition(rowpos, colpos);
-  terminal::write(item);
+// fills columns as tall as the screen allows (below the items location, above the bailout line)
+void Display::layout(void) noexcept
+{
+  s_rows_per_column = screenRows > offsetRows + 3 ? uint16_t(screenRows - offsetRows - 3) : 1;
+  s_widths.clear();
+  s_offsets.assign(1, 0);
+  s_first_column = 0;
 
-  uint16_t col_width = item_column_widths.at(pos->second.second) + 2;
-  colpos += col_width;
-  while(col_width--)
-    terminal::write(' ');
+  uint32_t added = 0;
+  for(item_t& item : s_items)
+    if(item.placed)
+      place(item, item.row, item.column);
+    else
+    {
+      place(item, uint16_t(added % s_rows_per_column), uint16_t(added / s_rows_per_column));
+      ++added;
+    }
+  s_layout_changed = true;
+}
 
+bool Display::visible(const item_t& item) noexcept
+{
+  return item.column >= s_first_column &&
+         item.row < s_rows_per_column &&
+         (item.column == s_first_column || // clipped if wider than the screen
+          offsetColumns + s_offsets[item.column + 1] - s_offsets[s_first_column] <= screenColumns);
+}
+
+// moves the view the least so column is entirely on screen, true if it moved
+bool Display::scrollTo(uint16_t column) noexcept
+{
+  uint16_t first = s_first_column;
+  if(column < first)
+    first = column;
+  while(first < column &&
+        offsetColumns + s_offsets[column + 1] - s_offsets[first] > screenColumns)
+    ++first;
+  if(first == s_first_column)
+    return false;
+  s_first_column = first;
+  s_layout_changed = true;
+  return true;
+}
 
-  terminal::setCursorPosition(rowpos, colpos);
-  terminal::write("[        ]");
+void Display::drawItem(const item_t& item) noexcept
+{
+  uint16_t rowpos = uint16_t(offsetRows + item.row);
+  uint16_t colpos = uint16_t(offsetColumns + s_offsets[item.column] - s_offsets[s_first_column]);
+  uint16_t col_width = s_widths[item.column] + 2;
+
+  uint16_t length = Screen::put(rowpos, colpos, terminal::style::reset, item.name);
+  Screen::fill(rowpos, colpos + length, terminal::style::reset, ' ', col_width - length);
+  colpos += col_width;
+
+  Screen::put(rowpos, colpos, terminal::style::reset, "[        ]");
   ++colpos;
 
-  terminal::setCursorPosition(rowpos, colpos);
-  terminal::write(style);
-  terminal::write(state);
-  terminal::write(terminal::style::reset); // reset
-  terminal::write('\n');
+  Screen::put(rowpos, colpos, item.style, item.state);
+}
+
+// redraws the item area after the layout or the view changed
+void Display::drawItems(void) noexcept
+{
+  for(uint16_t row = 0; row < s_rows_per_column; ++row)
+    Screen::fill(offsetRows + row, 0, terminal::style::reset, ' ', screenColumns);
+  for(const item_t& item : s_items)
+    if(*item.state && visible(item)) // items are only drawn once they have a state
+      drawItem(item);
+  s_layout_changed = false;
+}
+
+bool Display::setItemState(string_literal item, string_literal style, string_literal state) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  auto pos = s_index.find(item);
+  if(pos == s_index.end())
+    return false;
+
+  item_t& entry = s_items[pos->second];
+  entry.style = style;
+  posix::strncpy(entry.state, state, stateWidth);
+  entry.state[stateWidth] = '\0';
+
+  if(entry.row < s_rows_per_column) // the view follows the latest change
+    scrollTo(entry.column);
+  if(s_layout_changed)
+    drawItems();
+  else if(visible(entry))
+    drawItem(entry);
+  present();
+  Console::report(item, state);
   return true;
 }
 
 void Display::bailoutLine(string_literal fmt, const char* arg1, const char* arg2, const char* arg3) noexcept
 {
-  terminal::setCursorPosition(screenRows - 1, 0);
-  terminal::write(terminal::critical);
-  terminal::write(fmt, arg1, arg2, arg3);
-  terminal::write(terminal::style::reset); // reset
-  terminal::write('\n');
+  std::lock_guard<std::mutex> guard(s_lock);
+  posix::snprintf(s_bailout, sizeof(s_bailout), fmt, arg1, arg2, arg3);
+  drawBailout();
+  present();
+  Console::message(s_bailout);
 }
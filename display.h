@@ -8,6 +8,11 @@ namespace Display
 {
   extern void init(void) noexcept;
   extern void setText (uint16_t row, uint16_t column, string_literal style, const char* text) noexcept;
+
+  // changes made between beginFrame() and endFrame() are written to the terminal at once
+  extern void beginFrame(void) noexcept;
+  extern void endFrame(void) noexcept;
+
   extern void clearItems(void) noexcept;
   extern bool setItemsLocation(uint16_t row, uint16_t column) noexcept;
   extern bool addItem(string_literal item) noexcept;
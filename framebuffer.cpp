@@ -2,6 +2,10 @@
 
 #if defined(__linux__)
 
+// STL
+#include <algorithm>
+#include <new>
+
 // Linux
 #include <linux/fb.h>
 
@@ -13,10 +17,131 @@
 #include <put/cxxutils/error_helpers.h>
 #include <put/cxxutils/vterm.h>
 
+// Project
+#include "font.h"
+
+// SIMD
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define HAVE_NEON
+#endif
+
+namespace pixels
+{
+  // NOTE: gray has identical red, green and blue values so RGB and BGR orderings share kernels
+
+  static void gray_to_8888(uint8_t* dest, const uint8_t* source, uint32_t count) noexcept
+  {
+    uint32_t pos = 0;
+#if defined(__SSE2__)
+    const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+    for(; pos + 16 <= count; pos += 16)
+    {
+      __m128i gray  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + pos));
+      __m128i lo    = _mm_unpacklo_epi8(gray, gray); // gg pairs
+      __m128i hi    = _mm_unpackhi_epi8(gray, gray);
+      __m128i* out  = reinterpret_cast<__m128i*>(dest + pos * 4);
+      _mm_storeu_si128(out + 0, _mm_or_si128(_mm_unpacklo_epi16(lo, lo), alpha)); // gggg -> Xggg
+      _mm_storeu_si128(out + 1, _mm_or_si128(_mm_unpackhi_epi16(lo, lo), alpha));
+      _mm_storeu_si128(out + 2, _mm_or_si128(_mm_unpacklo_epi16(hi, hi), alpha));
+      _mm_storeu_si128(out + 3, _mm_or_si128(_mm_unpackhi_epi16(hi, hi), alpha));
+    }
+#elif defined(HAVE_NEON)
+    for(; pos + 16 <= count; pos += 16)
+    {
+      uint8x16_t gray = vld1q_u8(source + pos);
+      uint8x16x4_t out = { { gray, gray, gray, vdupq_n_u8(0xFF) } };
+      vst4q_u8(dest + pos * 4, out); // interleaved store
+    }
+#endif
+    for(; pos < count; ++pos)
+    {
+      uint32_t value = 0xFF000000 | uint32_t(source[pos]) * 0x010101;
+      posix::memcpy(dest + pos * 4, &value, 4);
+    }
+  }
+
+  static void gray_to_888(uint8_t* dest, const uint8_t* source, uint32_t count) noexcept
+  {
+    uint32_t pos = 0;
+#if defined(HAVE_NEON)
+    for(; pos + 16 <= count; pos += 16)
+    {
+      uint8x16_t gray = vld1q_u8(source + pos);
+      uint8x16x3_t out = { { gray, gray, gray } };
+      vst3q_u8(dest + pos * 3, out);
+    }
+#endif
+    for(; pos < count; ++pos, dest += 3)
+      dest[0] = dest[1] = dest[2] = source[pos];
+  }
+
+  static void gray_to_565(uint8_t* dest, const uint8_t* source, uint32_t count) noexcept
+  {
+    uint32_t pos = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask5 = _mm_set1_epi16(0xF8);
+    const __m128i mask6 = _mm_set1_epi16(0xFC);
+    for(; pos + 16 <= count; pos += 16)
+    {
+      __m128i gray = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + pos));
+      __m128i halves[2] = { _mm_unpacklo_epi8(gray, zero), _mm_unpackhi_epi8(gray, zero) };
+      for(int half = 0; half < 2; ++half)
+      {
+        __m128i g = halves[half];
+        __m128i value = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(_mm_and_si128(g, mask5), 8),  // red
+                                                  _mm_slli_epi16(_mm_and_si128(g, mask6), 3)), // green
+                                     _mm_srli_epi16(g, 3));                                    // blue
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + (pos + uint32_t(half) * 8) * 2), value);
+      }
+    }
+#elif defined(HAVE_NEON)
+    for(; pos + 8 <= count; pos += 8)
+    {
+      uint16x8_t g = vmovl_u8(vld1_u8(source + pos));
+      uint16x8_t value = vorrq_u16(vorrq_u16(vshlq_n_u16(vandq_u16(g, vdupq_n_u16(0xF8)), 8),
+                                             vshlq_n_u16(vandq_u16(g, vdupq_n_u16(0xFC)), 3)),
+                                   vshrq_n_u16(g, 3));
+      vst1q_u16(reinterpret_cast<uint16_t*>(dest + pos * 2), value);
+    }
+#endif
+    for(; pos < count; ++pos)
+    {
+      uint16_t g = source[pos];
+      uint16_t value = uint16_t(((g & 0xF8) << 8) | ((g & 0xFC) << 3) | (g >> 3));
+      posix::memcpy(dest + pos * 2, &value, 2);
+    }
+  }
+}
+
+FrameBuffer::FrameBuffer(void) noexcept
+  : m_bufwidth(0),
+    m_bufheight(0),
+    m_fd(posix::error_response),
+    m_buffer(nullptr),
+    m_xres(0),
+    m_yres(0),
+    m_yoffset(0),
+    m_bytes_per_pixel(0),
+    m_format(PixelFormat::Unknown),
+    m_red{ 0, 0 },
+    m_green{ 0, 0 },
+    m_blue{ 0, 0 },
+    m_atlas_next(0)
+{
+}
+
+FrameBuffer::~FrameBuffer(void) noexcept
+{
+  close();
+}
 
 bool FrameBuffer::open(const char* device)
 {
-  m_fd = posix::open(device, O_RDWR);
+  m_fd = posix::open(device, O_RDWR | O_CLOEXEC);
 
   flaw(m_fd < 0,
        terminal::warning,,
@@ -24,17 +149,48 @@ bool FrameBuffer::open(const char* device)
        "Unable to open framebuffer device: %s", posix::strerror(errno))
 
   struct fb_var_screeninfo screen_info;
-  flaw(posix::ioctl(m_fd, FBIOGET_VSCREENINFO, &screen_info),
+  flaw(!posix::ioctl(m_fd, FBIOGET_VSCREENINFO, &screen_info),
        terminal::warning,,
        false,
        "Unable to get virtual screen info from framebuffer: %s", posix::strerror(errno))
 
+  if(screen_info.yres_virtual < screen_info.yres * 2) // ask for a second page to draw into
+  {
+    struct fb_var_screeninfo doubled = screen_info;
+    doubled.yres_virtual = screen_info.yres * 2;
+    doubled.yoffset = 0;
+    if(posix::ioctl(m_fd, FBIOPUT_VSCREENINFO, &doubled))
+      posix::ioctl(m_fd, FBIOGET_VSCREENINFO, &screen_info);
+  }
+
   struct fb_fix_screeninfo fixed_info;
-  flaw(posix::ioctl(m_fd, FBIOGET_FSCREENINFO, &fixed_info),
+  flaw(!posix::ioctl(m_fd, FBIOGET_FSCREENINFO, &fixed_info),
        terminal::warning,,
        false,
        "Unable to get fixed screen info from framebuffer: %s", posix::strerror(errno))
 
+  m_xres = screen_info.xres;
+  m_yres = screen_info.yres;
+  m_yoffset = screen_info.yoffset;
+  m_bytes_per_pixel = uint8_t((screen_info.bits_per_pixel + 7) / 8);
+  m_red   = { uint8_t(screen_info.red.offset  ), uint8_t(screen_info.red.length  ) };
+  m_green = { uint8_t(screen_info.green.offset), uint8_t(screen_info.green.length) };
+  m_blue  = { uint8_t(screen_info.blue.offset ), uint8_t(screen_info.blue.length ) };
+
+  bool red_first = m_red.offset > m_blue.offset; // red in the high bits
+  switch(screen_info.bits_per_pixel)
+  {
+    case 16: m_format = m_green.length == 6 ? (red_first ? PixelFormat::RGB565 : PixelFormat::BGR565) : PixelFormat::Other; break;
+    case 24: m_format = red_first ? PixelFormat::RGB888   : PixelFormat::BGR888  ; break;
+    case 32: m_format = red_first ? PixelFormat::XRGB8888 : PixelFormat::XBGR8888; break;
+    default: m_format = m_bytes_per_pixel <= 4 ? PixelFormat::Other : PixelFormat::Unknown; break;
+  }
+
+  flaw(m_format == PixelFormat::Unknown,
+       terminal::warning,,
+       false,
+       "Unsupported framebuffer pixel format: %u bits per pixel", screen_info.bits_per_pixel)
+
   m_bufheight = screen_info.yres_virtual;
   m_bufwidth  = fixed_info.line_length;
   m_buffer = ::mmap(nullptr, m_bufwidth * m_bufheight, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
@@ -42,15 +198,41 @@ bool FrameBuffer::open(const char* device)
   return m_buffer != nullptr &&
          m_buffer != MAP_FAILED;
 }
-// FBIOPUT_VSCREENINFO
+
+bool FrameBuffer::attach(uint8_t* buffer, uint32_t width, uint32_t height, PixelFormat format) noexcept
+{
+  close();
+  switch(format)
+  {
+    case PixelFormat::XRGB8888: m_bytes_per_pixel = 4; m_red = { 16, 8 }; m_green = { 8, 8 }; m_blue = {  0, 8 }; break;
+    case PixelFormat::XBGR8888: m_bytes_per_pixel = 4; m_red = {  0, 8 }; m_green = { 8, 8 }; m_blue = { 16, 8 }; break;
+    case PixelFormat::RGB888:   m_bytes_per_pixel = 3; m_red = { 16, 8 }; m_green = { 8, 8 }; m_blue = {  0, 8 }; break;
+    case PixelFormat::BGR888:   m_bytes_per_pixel = 3; m_red = {  0, 8 }; m_green = { 8, 8 }; m_blue = { 16, 8 }; break;
+    case PixelFormat::RGB565:   m_bytes_per_pixel = 2; m_red = { 11, 5 }; m_green = { 5, 6 }; m_blue = {  0, 5 }; break;
+    case PixelFormat::BGR565:   m_bytes_per_pixel = 2; m_red = {  0, 5 }; m_green = { 5, 6 }; m_blue = { 11, 5 }; break;
+    default: return false; // the channels of the others are only known from a driver
+  }
+
+  m_format = format;
+  m_xres = width;
+  m_yres = height;
+  m_yoffset = 0;
+  m_bufwidth = width * m_bytes_per_pixel;
+  m_bufheight = height; // no second page: drawn in place
+  m_buffer = buffer;
+  return m_buffer != nullptr;
+}
+
 void FrameBuffer::close(void)
 {
-  if(m_buffer != nullptr &&
+  for(atlas_t& entry : m_atlases) // baked for this pixel format
+    entry.pixels.reset();
+
+  if(m_fd != posix::error_response && // attached memory isn't ours
+     m_buffer != nullptr &&
      m_buffer != MAP_FAILED)
-  {
     ::munmap(m_buffer, m_bufwidth * m_bufheight);
-    m_buffer = nullptr;
-  }
+  m_buffer = nullptr;
 
   if(m_fd != posix::error_response)
   {
@@ -59,6 +241,264 @@ void FrameBuffer::close(void)
   }
 }
 
+void FrameBuffer::fill(uint8_t* dest, uint32_t value, uint32_t count) const noexcept
+{
+  switch(m_bytes_per_pixel) // fixed size copies compile to plain stores
+  {
+    case 4: for(uint8_t* stop = dest + count * 4; dest < stop; dest += 4) posix::memcpy(dest, &value, 4); break;
+    case 3: for(uint8_t* stop = dest + count * 3; dest < stop; dest += 3) posix::memcpy(dest, &value, 3); break;
+    case 2: for(uint8_t* stop = dest + count * 2; dest < stop; dest += 2) posix::memcpy(dest, &value, 2); break;
+    default: posix::memset(dest, int(value), count); break;
+  }
+}
+
+void FrameBuffer::convert(uint8_t* dest, const uint8_t* source, uint32_t count) const noexcept
+{
+  switch(m_format)
+  {
+    case PixelFormat::XRGB8888:
+    case PixelFormat::XBGR8888:
+      pixels::gray_to_8888(dest, source, count);
+      break;
+    case PixelFormat::RGB888:
+    case PixelFormat::BGR888:
+      pixels::gray_to_888(dest, source, count);
+      break;
+    case PixelFormat::RGB565:
+    case PixelFormat::BGR565:
+      pixels::gray_to_565(dest, source, count);
+      break;
+    case PixelFormat::Other:
+      for(uint32_t pos = 0; pos < count; ++pos, dest += m_bytes_per_pixel)
+      {
+        uint32_t g = source[pos];
+        uint32_t value = ((g >> (8 - std::min<uint8_t>(m_red  .length, 8))) << m_red  .offset) |
+                         ((g >> (8 - std::min<uint8_t>(m_green.length, 8))) << m_green.offset) |
+                         ((g >> (8 - std::min<uint8_t>(m_blue .length, 8))) << m_blue .offset);
+        posix::memcpy(dest, &value, m_bytes_per_pixel); // little endian
+      }
+      break;
+    case PixelFormat::Unknown:
+      break;
+  }
+}
+
+bool FrameBuffer::flip(uint32_t yoffset) noexcept
+{
+  struct fb_var_screeninfo screen_info;
+  if(!posix::ioctl(m_fd, FBIOGET_VSCREENINFO, &screen_info))
+    return false;
+  screen_info.xoffset = 0;
+  screen_info.yoffset = yoffset;
+  if(!posix::ioctl(m_fd, FBIOPAN_DISPLAY, &screen_info))
+    return false;
+  m_yoffset = yoffset;
+  return true;
+}
+
+bool FrameBuffer::prepare(placement_t& placement, uint32_t width, uint32_t height) noexcept
+{
+  if(m_buffer == nullptr || m_buffer == MAP_FAILED || m_format == PixelFormat::Unknown)
+    return false;
+
+  bool paged = m_bufheight >= m_yres * 2;
+  placement.page = paged ? (m_yoffset ? 0 : m_yres) : m_yoffset; // draw where it can't be seen
+  placement.columns = std::min(width, m_xres);
+  placement.rows = std::min(height, m_yres);
+  placement.crop_x = (width - placement.columns) / 2; // crop centered
+  placement.crop_y = (height - placement.rows) / 2;
+
+  uint8_t* page = static_cast<uint8_t*>(m_buffer) + placement.page * m_bufwidth;
+  placement.target = page +
+                     ((m_yres - placement.rows) / 2) * m_bufwidth +
+                     ((m_xres - placement.columns) / 2) * m_bytes_per_pixel;
+
+  posix::memset(page, 0, m_bufwidth * m_yres); // black in every pixel format
+  return true;
+}
+
+bool FrameBuffer::present(const placement_t& placement) noexcept
+{
+  if(placement.page == m_yoffset) // drew on the visible page
+    return true;
+
+  if(flip(placement.page))
+    return true;
+
+  // panning is unsupported: show the drawn page by copying it
+  posix::memcpy(static_cast<uint8_t*>(m_buffer) + m_yoffset * m_bufwidth,
+                static_cast<uint8_t*>(m_buffer) + placement.page * m_bufwidth,
+                m_bufwidth * m_yres);
+  return true;
+}
+
+bool FrameBuffer::load(const uint8_t* data, uint32_t width, uint32_t height) noexcept
+{
+  placement_t placement;
+  if(!prepare(placement, width, height))
+    return false;
+
+  const uint8_t* source = data + placement.crop_x + placement.crop_y * width;
+  uint8_t* dest = placement.target;
+  for(uint32_t row = 0; row < placement.rows; ++row, source += width, dest += m_bufwidth)
+    convert(dest, source, placement.columns);
+
+  return present(placement);
+}
+
+bool FrameBuffer::loadRLE(const uint8_t* data, size_t length, uint32_t width, uint32_t height) noexcept
+{
+  placement_t placement;
+  if(!prepare(placement, width, height))
+    return false;
+
+  const uint8_t* end = data + length;
+  uint32_t visible_end = placement.crop_x + placement.columns;
+  for(uint32_t row = 0; row < height && row < placement.crop_y + placement.rows; ++row)
+  {
+    uint8_t* dest = row >= placement.crop_y ? placement.target + (row - placement.crop_y) * m_bufwidth : nullptr;
+    for(uint32_t x = 0; x < width;)
+    {
+      if(data >= end)
+        return false; // truncated
+
+      bool repeat = *data >= 0x80;
+      uint32_t count = repeat ? uint32_t(*data) - 0x7D : uint32_t(*data) + 1;
+      const uint8_t* source = ++data;
+      data += repeat ? 1 : count;
+      if(data > end || x + count > width)
+        return false; // corrupt
+
+      // clip the run to the visible columns
+      uint32_t first = std::max(x, placement.crop_x);
+      uint32_t last = std::min(x + count, visible_end);
+      if(dest != nullptr && first < last)
+      {
+        uint8_t* pixel = dest + (first - placement.crop_x) * m_bytes_per_pixel;
+        if(!repeat)
+          convert(pixel, source + (first - x), last - first);
+        else
+        {
+          convert(pixel, source, 1);
+          uint32_t value = 0;
+          posix::memcpy(&value, pixel, m_bytes_per_pixel);
+          if(value) // page is already zeroed
+            fill(pixel, value, last - first);
+        }
+      }
+      x += count;
+    }
+  }
+
+  return present(placement);
+}
+
+uint32_t FrameBuffer::textRows(void) const noexcept
+  { return m_buffer != nullptr && m_buffer != MAP_FAILED ? m_yres / font::height : 0; }
+
+uint32_t FrameBuffer::textColumns(void) const noexcept
+  { return m_buffer != nullptr && m_buffer != MAP_FAILED ? m_xres / font::width : 0; }
+
+uint32_t FrameBuffer::native(uint32_t rgb) const noexcept
+{
+  auto channel = [](uint32_t value, channel_t channel) noexcept
+    { return channel.length ? (value >> (8 - std::min<uint8_t>(channel.length, 8))) << channel.offset : 0; };
+  uint32_t value = channel((rgb >> 16) & 0xFF, m_red) |
+                   channel((rgb >>  8) & 0xFF, m_green) |
+                   channel( rgb        & 0xFF, m_blue);
+  if(m_format == PixelFormat::XRGB8888 || m_format == PixelFormat::XBGR8888)
+    value |= 0xFF000000; // matches the splash
+  return value;
+}
+
+// the glyphs in a color pair, converted to the native pixel format the first time the pair is used
+const uint8_t* FrameBuffer::atlas(uint32_t foreground, uint32_t background) noexcept
+{
+  for(atlas_t& entry : m_atlases)
+    if(entry.pixels && entry.foreground == foreground && entry.background == background)
+      return entry.pixels.get();
+
+  atlas_t& entry = m_atlases[m_atlas_next];
+  m_atlas_next = (m_atlas_next + 1) % atlasCount;
+
+  const uint32_t glyph_count = uint32_t(font::last - font::first + 1);
+  const uint32_t row_bytes = font::width * m_bytes_per_pixel;
+  if(!entry.pixels)
+    entry.pixels.reset(new (std::nothrow) uint8_t[glyph_count * font::height * row_bytes]);
+  if(!entry.pixels)
+    return nullptr;
+  entry.foreground = foreground;
+  entry.background = background;
+
+  uint32_t colors[2] = { native(background), native(foreground) };
+  uint8_t* dest = entry.pixels.get();
+  for(uint32_t pos = 0; pos < glyph_count * font::height; ++pos) // every row of every glyph
+    for(uint32_t column = 0; column < font::width; ++column, dest += m_bytes_per_pixel)
+      posix::memcpy(dest, &colors[(font::glyphs[pos] >> (7 - column)) & 1], m_bytes_per_pixel); // little endian
+  return entry.pixels.get();
+}
+
+bool FrameBuffer::drawText(uint32_t row, uint32_t column, const char* text, uint32_t count, uint32_t foreground, uint32_t background) noexcept
+{
+  if(row >= textRows() || column >= textColumns())
+    return false;
+  count = std::min(count, textColumns() - column);
+
+  const uint8_t* glyphs = atlas(foreground, background);
+  if(glyphs == nullptr)
+    return false;
+
+  const uint32_t row_bytes = font::width * m_bytes_per_pixel;
+  const uint32_t glyph_bytes = font::height * row_bytes;
+  uint8_t* origin = static_cast<uint8_t*>(m_buffer) +
+                    (m_yoffset + row * font::height) * m_bufwidth +
+                    column * row_bytes;
+  for(uint32_t line = 0; line < font::height; ++line, origin += m_bufwidth) // left to right along each scanline
+  {
+    uint8_t* dest = origin;
+    for(uint32_t pos = 0; pos < count; ++pos, dest += row_bytes)
+    {
+      char ch = text[pos] < font::first || text[pos] > font::last ? '?' : text[pos];
+      posix::memcpy(dest, glyphs + uint32_t(ch - font::first) * glyph_bytes + line * row_bytes, row_bytes);
+    }
+  }
+  return true;
+}
+
 #else
 
+FrameBuffer::FrameBuffer(void) noexcept
+  : m_bufwidth(0),
+    m_bufheight(0),
+    m_fd(posix::error_response),
+    m_buffer(nullptr),
+    m_xres(0),
+    m_yres(0),
+    m_yoffset(0),
+    m_bytes_per_pixel(0),
+    m_format(PixelFormat::Unknown),
+    m_red{ 0, 0 },
+    m_green{ 0, 0 },
+    m_blue{ 0, 0 },
+    m_atlas_next(0)
+{
+}
+
+FrameBuffer::~FrameBuffer(void) noexcept { }
+bool FrameBuffer::open(const char*) { return false; }
+bool FrameBuffer::attach(uint8_t*, uint32_t, uint32_t, PixelFormat) noexcept { return false; }
+void FrameBuffer::close(void) { }
+bool FrameBuffer::load(const uint8_t*, uint32_t, uint32_t) noexcept { return false; }
+bool FrameBuffer::loadRLE(const uint8_t*, size_t, uint32_t, uint32_t) noexcept { return false; }
+bool FrameBuffer::prepare(placement_t&, uint32_t, uint32_t) noexcept { return false; }
+bool FrameBuffer::present(const placement_t&) noexcept { return false; }
+void FrameBuffer::convert(uint8_t*, const uint8_t*, uint32_t) const noexcept { }
+void FrameBuffer::fill(uint8_t*, uint32_t, uint32_t) const noexcept { }
+bool FrameBuffer::flip(uint32_t) noexcept { return false; }
+uint32_t FrameBuffer::textRows(void) const noexcept { return 0; }
+uint32_t FrameBuffer::textColumns(void) const noexcept { return 0; }
+uint32_t FrameBuffer::native(uint32_t) const noexcept { return 0; }
+const uint8_t* FrameBuffer::atlas(uint32_t, uint32_t) noexcept { return nullptr; }
+bool FrameBuffer::drawText(uint32_t, uint32_t, const char*, uint32_t, uint32_t, uint32_t) noexcept { return false; }
+
 #endif
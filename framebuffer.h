@@ -1,21 +1,87 @@
 #ifndef FRAMEBUFFER_H
 #define FRAMEBUFFER_H
 
+// STL
+#include <memory>
+
 // PUT
 #include <put/cxxutils/posix_helpers.h>
 
 class FrameBuffer
 {
 public:
+  enum class PixelFormat : uint8_t
+  {
+    Unknown,
+    RGB565,
+    BGR565,
+    RGB888,
+    BGR888,
+    XRGB8888,
+    XBGR8888,
+    Other, // converted using the channel offsets reported by the driver
+  };
+
+  FrameBuffer(void) noexcept;
+  ~FrameBuffer(void) noexcept;
+
   bool open(const char* device = "/dev/fb0");
+  // draws into a single page of memory instead of a device (see tools/bootbench.cpp)
+  bool attach(uint8_t* buffer, uint32_t width, uint32_t height, PixelFormat format) noexcept;
   void close(void);
 
+  // draws a grayscale image centered on the off-screen page and flips to it
+  bool load(const uint8_t* data, uint32_t width, uint32_t height) noexcept;
+  // same as load() but decodes a run length encoded image (see tools/splashgen.cpp) row by row
+  bool loadRLE(const uint8_t* data, size_t length, uint32_t width, uint32_t height) noexcept;
+
+  PixelFormat format(void) const noexcept { return m_format; }
+
+  // text is drawn with the built-in font (see font.txt) straight onto the visible page
+  uint32_t textRows(void) const noexcept;
+  uint32_t textColumns(void) const noexcept;
+  // draws count characters starting at a text cell, colors are 0xRRGGBB
+  bool drawText(uint32_t row, uint32_t column, const char* text, uint32_t count, uint32_t foreground, uint32_t background) noexcept;
 
 private:
+  struct placement_t
+  {
+    uint8_t* target; // top left pixel of the drawn image
+    uint32_t page;
+    uint32_t columns, rows; // visible portion
+    uint32_t crop_x, crop_y;
+  };
+
+  bool prepare(placement_t& placement, uint32_t width, uint32_t height) noexcept;
+  bool present(const placement_t& placement) noexcept;
+  void convert(uint8_t* dest, const uint8_t* source, uint32_t count) const noexcept;
+  void fill(uint8_t* dest, uint32_t value, uint32_t count) const noexcept; // repeat a native pixel
+  bool flip(uint32_t yoffset) noexcept;
+  uint32_t native(uint32_t rgb) const noexcept; // 0xRRGGBB as a pixel of this framebuffer
+  const uint8_t* atlas(uint32_t foreground, uint32_t background) noexcept;
+
+  // every glyph prerendered in one color pair: glyph after glyph, row after row
+  struct atlas_t
+  {
+    uint32_t foreground;
+    uint32_t background;
+    std::unique_ptr<uint8_t[]> pixels;
+  };
+  static const uint32_t atlasCount = 8; // color pairs kept, the oldest is rebaked when another is needed
+
   size_t m_bufwidth;
   size_t m_bufheight;
   posix::fd_t m_fd;
   void* m_buffer;
+
+  uint32_t m_xres;
+  uint32_t m_yres;
+  uint32_t m_yoffset; // visible page
+  uint8_t m_bytes_per_pixel;
+  PixelFormat m_format;
+  struct channel_t { uint8_t offset; uint8_t length; } m_red, m_green, m_blue;
+  atlas_t m_atlases[atlasCount];
+  uint32_t m_atlas_next;
 };
 
 #endif // FRAMEBUFFER_H
@@ -0,0 +1,290 @@
+#include "fsck.h"
+
+// STL
+#include <mutex>
+#include <condition_variable>
+#include <unordered_set>
+#include <cstdlib>
+#include <cstring>
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Linux
+#if defined(__linux__)
+# include <sched.h>
+# include <sys/sysmacros.h>
+#endif
+
+// PUT
+#include <put/cxxutils/hashing.h>
+
+// Project
+#include "tracer.h"
+
+#ifndef FSCK_BIN
+#define FSCK_BIN          "/sbin/fsck"
+#endif
+
+#ifndef SYSFS_PATH
+#define SYSFS_PATH        "/sys"
+#endif
+
+#ifndef FSCK_PROGRESS_FD
+#define FSCK_PROGRESS_FD  3 // descriptor the checker writes "pass current maximum device" lines to
+#endif
+
+#if !defined(__WALL)
+#define __WALL            0 // children always have an exit signal
+#endif
+
+extern char** environ;
+
+namespace Fsck
+{
+  enum class Mode : uint8_t
+  {
+    Auto,   // let the checker decide (clean filesystems are skipped quickly)
+    Force,
+    Skip,
+  };
+
+  static Mode s_mode = Mode::Auto;
+  static const char* s_repair = "-a"; // preen
+
+  static std::mutex s_lock;
+  static std::condition_variable s_idle;
+  static std::unordered_set<uint32_t> s_busy; // disks being checked
+
+  struct child_t
+  {
+    const char* const* argv;
+    posix::fd_t progress;
+  };
+
+  uint32_t disk_of(const struct stat& state) noexcept;
+  int percent(int pass, unsigned long current, unsigned long maximum) noexcept;
+  void read_progress(posix::fd_t fd, const char* path, progress_slot_t& progress) noexcept;
+  int run(const char* path, const char* device, const char* fstype, progress_slot_t& progress) noexcept;
+  int child_main(void* arg) noexcept;
+}
+
+void Fsck::configure(const char* mode, const char* repair) noexcept
+{
+  if(mode != nullptr)
+    switch(hash(mode, posix::strlen(mode)))
+    {
+      case "force"_hash: s_mode = Mode::Force; break;
+      case "skip"_hash:  s_mode = Mode::Skip;  break;
+      default:           s_mode = Mode::Auto;  break;
+    }
+
+  if(repair != nullptr)
+    switch(hash(repair, posix::strlen(repair)))
+    {
+      case "yes"_hash: s_repair = "-y"; break;
+      case "no"_hash:  s_repair = "-n"; break;
+      default:         s_repair = "-a"; break;
+    }
+}
+
+// partitions share the key of the disk they are on
+uint32_t Fsck::disk_of(const struct stat& state) noexcept
+{
+  char path[PATH_MAX];
+  char resolved[PATH_MAX];
+  posix::snprintf(path, sizeof(path), SYSFS_PATH "/dev/block/%u:%u", major(state.st_rdev), minor(state.st_rdev));
+  if(::realpath(path, resolved) == nullptr) // no sysfs: treat every device as a disk of its own
+    return hash(path, posix::strlen(path));
+
+  posix::snprintf(path, sizeof(path), "%s/partition", resolved);
+  char* slash = posix::strrchr(resolved, '/');
+  if(::access(path, F_OK) == posix::success_response && slash != nullptr)
+    *slash = '\0'; // the disk is the parent directory
+  return hash(resolved, posix::strlen(resolved));
+}
+
+// e2fsck reports five passes, which take roughly this share of the time
+int Fsck::percent(int pass, unsigned long current, unsigned long maximum) noexcept
+{
+  static const int start[] = { 0, 0, 70, 90, 92, 95, 100 };
+  if(pass < 1 || pass > 5 || !maximum)
+    return -1;
+  return start[pass] + int((start[pass + 1] - start[pass]) * current / maximum);
+}
+
+void Fsck::read_progress(posix::fd_t fd, const char* path, progress_slot_t& progress) noexcept
+{
+  char buffer[256];
+  posix::size_t length = 0;
+  posix::ssize_t count;
+  int last = -1;
+  while((count = posix::read(fd, buffer + length, sizeof(buffer) - 1 - length)) > 0)
+  {
+    length += posix::size_t(count);
+    buffer[length] = '\0';
+
+    char* line = buffer;
+    for(char* eol; (eol = posix::strchr(line, '\n')) != nullptr; line = eol + 1)
+    {
+      *eol = '\0';
+      int pass = int(posix::strtoul(line, &line, 10));
+      unsigned long current = posix::strtoul(line, &line, 10);
+      unsigned long maximum = posix::strtoul(line, &line, 10);
+      int done = percent(pass, current, maximum);
+      if(done > last) // lines arrive far more often than the percentage changes
+      {
+        last = done;
+        if(progress)
+          progress(path, done);
+      }
+    }
+
+    length -= posix::size_t(line - buffer); // keep the partial line
+    std::memmove(buffer, line, length);
+    if(length == sizeof(buffer) - 1) // not progress output
+      length = 0;
+  }
+}
+
+int Fsck::child_main(void* arg) noexcept
+{
+  child_t* child = static_cast<child_t*>(arg);
+  sigset_t mask;
+  ::sigemptyset(&mask);
+  ::sigaddset(&mask, SIGCHLD); // blocked here only for the reaper's signalfd
+  ::sigprocmask(SIG_UNBLOCK, &mask, nullptr);
+  ::dup2(child->progress, FSCK_PROGRESS_FD);
+  ::execve(FSCK_BIN, const_cast<char* const*>(child->argv), environ);
+  return 8; // operational error
+}
+
+// returns the exit status of the checker or posix::error_response
+int Fsck::run(const char* path, const char* device, const char* fstype, progress_slot_t& progress) noexcept
+{
+  enum {
+    Read = 0,
+    Write = 1,
+  };
+
+  if(::access(FSCK_BIN, X_OK) == posix::error_response) // e.g. ENOENT: no checker installed
+    return posix::error_response;
+
+  posix::fd_t pipe_fds[2];
+  if(::pipe2(pipe_fds, O_CLOEXEC) == posix::error_response)
+    return posix::error_response;
+
+  char progress_fd[16];
+  posix::snprintf(progress_fd, sizeof(progress_fd), "%d", FSCK_PROGRESS_FD);
+
+  // fsck -T -C <fd> [-t <fstype>] <device> -- <repair> [-f]
+  const char* argv[12];
+  int argc = 0;
+  argv[argc++] = FSCK_BIN;
+  argv[argc++] = "-T"; // no title
+  argv[argc++] = "-C"; // progress
+  argv[argc++] = progress_fd;
+  if(fstype != nullptr && *fstype && posix::strcmp(fstype, "auto"))
+  {
+    argv[argc++] = "-t";
+    argv[argc++] = fstype;
+  }
+  argv[argc++] = device;
+  argv[argc++] = "--";
+  argv[argc++] = s_repair;
+  if(s_mode == Mode::Force)
+    argv[argc++] = "-f";
+  argv[argc] = nullptr;
+
+  if(pipe_fds[Write] == FSCK_PROGRESS_FD) // dup2 onto itself would keep close-on-exec
+  {
+    posix::fd_t moved = ::fcntl(pipe_fds[Write], F_DUPFD_CLOEXEC, FSCK_PROGRESS_FD + 1);
+    posix::close(pipe_fds[Write]);
+    pipe_fds[Write] = moved;
+  }
+
+  // a copy of this process rather than Spawn::start: this thread waits for the checker itself instead of the event loop
+  child_t child = { argv, pipe_fds[Write] };
+#if defined(__linux__)
+  alignas(16) char stack[16384]; // the child runs on its own copy of it
+  pid_t pid = ::clone(child_main, stack + sizeof(stack), 0, &child); // no exit signal: the reaper leaves it alone
+#else
+  pid_t pid = ::fork();
+  if(pid == 0)
+    ::_exit(child_main(&child));
+#endif
+  int error = errno;
+  posix::close(pipe_fds[Write]);
+  if(pid == posix::error_response)
+  {
+    posix::close(pipe_fds[Read]);
+    errno = error;
+    return posix::error_response;
+  }
+
+  read_progress(pipe_fds[Read], path, progress); // until the checker exits
+  posix::close(pipe_fds[Read]);
+
+  int status = 0;
+  while(::waitpid(pid, &status, __WALL) == posix::error_response)
+    if(errno != EINTR)
+      return posix::error_response;
+
+  if(WIFSIGNALED(status))
+  {
+    errno = EINTR;
+    return posix::error_response;
+  }
+  return WEXITSTATUS(status);
+}
+
+Fsck::Result Fsck::check(const char* path, const char* device, const char* fstype, uint8_t pass, progress_slot_t progress) noexcept
+{
+  struct stat state;
+  if(!pass ||
+     s_mode == Mode::Skip ||
+     ::stat(device, &state) == posix::error_response ||
+     !S_ISBLK(state.st_mode)) // e.g. tmpfs or a bind mount
+    return Result::Skipped;
+
+  uint32_t disk = disk_of(state);
+  {
+    std::unique_lock<std::mutex> guard(s_lock);
+    s_idle.wait(guard, [disk]() noexcept { return !s_busy.count(disk); }); // one check per spindle
+    s_busy.insert(disk);
+  }
+
+  uint64_t start = Tracer::now();
+  int status = run(path, device, fstype, progress);
+  int error = errno;
+  Tracer::complete("fsck", path, start, nullptr, status);
+
+  {
+    std::lock_guard<std::mutex> guard(s_lock);
+    s_busy.erase(disk);
+  }
+  s_idle.notify_all();
+
+  errno = error;
+  if(status == posix::error_response)
+    return Result::Error;
+  if(status & (8 | 16 | 32 | 128)) // operational error, usage, canceled or library error
+  {
+    errno = ECANCELED;
+    return Result::Error;
+  }
+  if(status & 4)
+  {
+    errno = EUCLEAN;
+    return Result::Uncorrected;
+  }
+  if(status & 2)
+    return Result::Reboot;
+  if(status & 1)
+    return Result::Repaired;
+  return Result::Clean;
+}
@@ -0,0 +1,32 @@
+#ifndef FSCK_H
+#define FSCK_H
+
+// PUT
+#include <put/object.h>
+#include <put/cxxutils/posix_helpers.h>
+
+namespace Fsck
+{
+  enum class Result : uint8_t
+  {
+    Skipped,      // pass 0, fsck.mode=skip or not a block device
+    Clean,
+    Repaired,
+    Reboot,       // repaired but the kernel may hold stale data (mounted filesystem)
+    Uncorrected,  // errors left: do not mount
+    Error,        // checker missing or failed to run (errno is set)
+  };
+
+  // percentage of the check of the filesystem mounted at path that is done
+  using progress_slot_t = Object::fslot_t<void, const char*, int>;
+
+  // applies fsck.mode= (auto, force, skip) and fsck.repair= (preen, yes, no), either may be nullptr
+  extern void configure(const char* mode, const char* repair) noexcept;
+
+  // checks the filesystem on device and blocks until the checker exits (called from worker threads)
+  // checks of filesystems on the same disk wait for each other, different disks are checked at once
+  // NOTE: path (where it will be mounted) must outlive the boot trace
+  extern Result check(const char* path, const char* device, const char* fstype, uint8_t pass, progress_slot_t progress) noexcept;
+}
+
+#endif // FSCK_H
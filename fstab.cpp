@@ -0,0 +1,448 @@
+#include "fstab.h"
+
+// STL
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// PUT
+#include <put/cxxutils/hashing.h>
+#include <put/specialized/mount.h>
+#if defined(WANT_MOUNT_ROOT)
+# include <put/specialized/blockdevices.h>
+#endif
+
+// Project
+#include "display.h"
+#include "tracer.h"
+#include "mounttable.h"
+#include "bootcache.h"
+
+#ifndef FSTAB_PATH
+#define FSTAB_PATH      "/etc/fstab"
+#endif
+
+#ifndef MOUNT_WORKERS
+#define MOUNT_WORKERS   4
+#endif
+
+namespace FsTab
+{
+  struct job_t
+  {
+    const entry_t* entry;
+    std::string device;           // with UUID=, LABEL=, etc resolved
+    std::vector<job_t*> dependents;
+    uint16_t waiting;             // parent not yet mounted
+    int error;
+    bool failed;
+    bool orphaned;                // parent failed to mount
+    bool optional;                // "nofail"
+  };
+
+  static bool s_loaded = false;
+  static std::unique_ptr<char[]> s_arena; // fstab with every field unescaped and NUL terminated in place
+  static std::vector<entry_t> s_entries;
+  static std::unordered_multimap<uint32_t, uint16_t> s_by_device;
+  static std::unordered_multimap<uint32_t, uint16_t> s_by_path;
+
+  static std::mutex s_lock;
+#if defined(WANT_MOUNT_ROOT)
+  static std::mutex s_probe_lock; // the block device table isn't thread safe
+#endif
+  static std::condition_variable s_wakeup;
+  static std::list<job_t*> s_ready;
+  static posix::size_t s_remaining = 0;
+  static check_slot_t s_check;
+
+  char* next_field(char*& pos, char* end) noexcept;
+  uint16_t find(const std::unordered_multimap<uint32_t, uint16_t>& index, const char* value, bool last) noexcept;
+  bool has_option(const char* options, const char* option) noexcept;
+  bool is_local(const entry_t& entry) noexcept;
+  void resolve(const char* device, std::string& resolved) noexcept;
+  void finish(job_t* job) noexcept;
+  void worker(void) noexcept;
+}
+
+bool FsTab::load(void) noexcept
+{
+  if(s_loaded)
+    return true;
+
+  uint64_t stamp = BootCache::stamp(FSTAB_PATH); // before reading so an edit made meanwhile isn't cached
+  posix::fd_t fd = posix::open(FSTAB_PATH, O_RDONLY | O_CLOEXEC);
+  if(fd == posix::error_response)
+    return false;
+
+  struct stat state;
+  if(::fstat(fd, &state) == posix::error_response)
+  {
+    posix::close(fd);
+    return false;
+  }
+
+  posix::size_t length = 0;
+  posix::ssize_t count = 0;
+  s_arena.reset(new char[posix::size_t(state.st_size) + 1]);
+  while(length < posix::size_t(state.st_size) &&
+        (count = posix::read(fd, s_arena.get() + length, posix::size_t(state.st_size) - length)) > 0)
+    length += posix::size_t(count);
+  posix::close(fd);
+  if(count == posix::error_response)
+    return false;
+  s_arena[length] = '\0';
+
+  // each line is: <device> <path> [fstype [options [dump [pass]]]]
+  char* end = s_arena.get() + length;
+  for(char* pos = s_arena.get(); pos < end;)
+  {
+    char* eol = std::find(pos, end, '\n');
+    *eol = '\0';
+
+    char* device = next_field(pos, eol);
+    if(device != nullptr && *device != '#') // not blank or a comment
+    {
+      char* path    = next_field(pos, eol);
+      char* fstype  = next_field(pos, eol);
+      char* options = next_field(pos, eol);
+      char* dump    = next_field(pos, eol);
+      char* pass    = next_field(pos, eol);
+      if(path != nullptr && s_entries.size() < entry_t::npos)
+        s_entries.push_back(entry_t{ device, path,
+                                     fstype  != nullptr ? fstype  : "auto",
+                                     options != nullptr ? options : "defaults",
+                                     entry_t::npos,
+                                     uint8_t(dump != nullptr ? posix::strtoul(dump, nullptr, 10) : 0),
+                                     uint8_t(pass != nullptr ? posix::strtoul(pass, nullptr, 10) : 0) });
+    }
+    pos = eol + 1;
+  }
+
+  for(uint16_t index = 0; index < s_entries.size(); ++index)
+  {
+    s_by_device.emplace(hash(s_entries[index].device, posix::strlen(s_entries[index].device)), index);
+    s_by_path  .emplace(hash(s_entries[index].path  , posix::strlen(s_entries[index].path  )), index);
+  }
+
+  // find the parent of each entry by walking up its path one directory at a time (unless fstab is unchanged)
+  std::vector<char> parents;
+  bool cached = BootCache::get("fstab", stamp, parents) &&
+                parents.size() == s_entries.size() * sizeof(uint16_t);
+  for(uint16_t index = 0; cached && index < s_entries.size(); ++index)
+  {
+    uint16_t parent;
+    posix::memcpy(&parent, parents.data() + index * sizeof(uint16_t), sizeof(parent));
+    cached = parent == entry_t::npos ||
+             (parent < s_entries.size() && // a shorter path that leads to this one (so there are no cycles)
+              posix::strlen(s_entries[parent].path) < posix::strlen(s_entries[index].path) &&
+              !posix::strncmp(s_entries[parent].path, s_entries[index].path, posix::strlen(s_entries[parent].path)));
+    s_entries[index].parent = parent;
+  }
+
+  if(!cached)
+  {
+    for(entry_t& entry : s_entries)
+      entry.parent = entry_t::npos;
+    char directory[PATH_MAX];
+    for(entry_t& entry : s_entries)
+    {
+      posix::strncpy(directory, entry.path, sizeof(directory) - 1);
+      directory[sizeof(directory) - 1] = '\0';
+      for(char* slash = posix::strrchr(directory, '/');
+          slash != nullptr && entry.parent == entry_t::npos && *entry.path == '/' && entry.path[1];
+          slash = posix::strrchr(directory, '/'))
+      {
+        if(slash == directory) // reached "/"
+          slash[1] = '\0';
+        else
+          *slash = '\0';
+        entry.parent = find(s_by_path, directory, true);
+        if(slash == directory)
+          break;
+      }
+    }
+
+    parents.resize(s_entries.size() * sizeof(uint16_t));
+    for(uint16_t index = 0; index < s_entries.size(); ++index)
+      posix::memcpy(parents.data() + index * sizeof(uint16_t), &s_entries[index].parent, sizeof(uint16_t));
+    BootCache::put("fstab", stamp, parents.data(), parents.size());
+  }
+
+  s_loaded = true;
+  return true;
+}
+
+const std::vector<FsTab::entry_t>& FsTab::entries(void) noexcept
+  { return s_entries; }
+
+const FsTab::entry_t* FsTab::findByDevice(const char* device) noexcept
+{
+  uint16_t index = find(s_by_device, device, false);
+  return index == entry_t::npos ? nullptr : &s_entries[index];
+}
+
+const FsTab::entry_t* FsTab::findByPath(const char* path) noexcept
+{
+  uint16_t index = find(s_by_path, path, true);
+  return index == entry_t::npos ? nullptr : &s_entries[index];
+}
+
+// the first (or last) entry in file order with a matching field
+uint16_t FsTab::find(const std::unordered_multimap<uint32_t, uint16_t>& index, const char* value, bool last) noexcept
+{
+  uint16_t match = entry_t::npos;
+  auto range = index.equal_range(hash(value, posix::strlen(value)));
+  for(auto pos = range.first; pos != range.second; ++pos)
+  {
+    const entry_t& entry = s_entries[pos->second];
+    if(!posix::strcmp(&index == &s_by_device ? entry.device : entry.path, value) && // not a hash collision
+       (match == entry_t::npos || (last ? pos->second > match : pos->second < match)))
+      match = pos->second;
+  }
+  return match;
+}
+
+// splits off a whitespace delimited field, unescaping octal sequences ("\040" for space) in place
+char* FsTab::next_field(char*& pos, char* end) noexcept
+{
+  while(pos < end && posix::isspace(*pos))
+    ++pos;
+  if(pos >= end)
+    return nullptr;
+
+  char* start = pos;
+  char* write = pos;
+  for(; pos < end && !posix::isspace(*pos); ++pos)
+  {
+    if(*pos == '\\' && end - pos > 3 &&
+       pos[1] >= '0' && pos[1] <= '3' &&
+       pos[2] >= '0' && pos[2] <= '7' &&
+       pos[3] >= '0' && pos[3] <= '7')
+    {
+      *write++ = char(((pos[1] - '0') << 6) | ((pos[2] - '0') << 3) | (pos[3] - '0'));
+      pos += 3;
+    }
+    else
+      *write++ = *pos;
+  }
+  if(pos < end)
+    ++pos; // step over the separator before it can be overwritten
+  *write = '\0';
+  return start;
+}
+
+bool FsTab::has_option(const char* options, const char* option) noexcept
+{
+  posix::size_t length = posix::strlen(option);
+  for(const char* pos = options; pos != nullptr; pos = posix::strchr(pos, ','))
+  {
+    if(*pos == ',')
+      ++pos;
+    if(!posix::strncmp(pos, option, length) && (pos[length] == ',' || !pos[length]))
+      return true;
+  }
+  return false;
+}
+
+// filesystems that are mounted by other means (root, swap, network and on demand mounts)
+bool FsTab::is_local(const entry_t& entry) noexcept
+{
+  if(*entry.path != '/' || !entry.path[1] || // not a path or the root
+     has_option(entry.options, "noauto") ||
+     has_option(entry.options, "_netdev"))
+    return false;
+
+  switch(hash(entry.fstype, posix::strlen(entry.fstype)))
+  {
+    case "swap"_hash:
+    case "nfs"_hash:
+    case "nfs4"_hash:
+    case "cifs"_hash:
+    case "smbfs"_hash:
+    case "smb3"_hash:
+    case "ncpfs"_hash:
+    case "ceph"_hash:
+    case "glusterfs"_hash:
+    case "fuse.sshfs"_hash:
+    case "davfs"_hash:
+      return false;
+    default:
+      return true;
+  }
+}
+
+// NOTE: runs on a scheduler worker: block device lookups are serialized by s_probe_lock
+// (RootDevice uses the same table but is done with it before "/" is provided, which mounting waits for)
+void FsTab::resolve(const char* device, std::string& resolved) noexcept
+{
+  static const struct { const char* tag; const char* directory; } tags[] =
+  {
+    { "UUID="     , "/dev/disk/by-uuid/"      },
+    { "LABEL="    , "/dev/disk/by-label/"     },
+    { "PARTUUID=" , "/dev/disk/by-partuuid/"  },
+    { "PARTLABEL=", "/dev/disk/by-partlabel/" },
+  };
+
+  resolved = device;
+  for(const auto& tag : tags)
+  {
+    posix::size_t length = posix::strlen(tag.tag);
+    if(posix::strncmp(device, tag.tag, length))
+      continue;
+
+    resolved = tag.directory; // as udev names them
+    resolved.append(device + length);
+#if defined(WANT_MOUNT_ROOT)
+    std::lock_guard<std::mutex> guard(s_probe_lock);
+    static bool probed = false;
+    auto lookup = [&tag, device, length]() noexcept -> blockdevice_t*
+      {
+        if(&tag == &tags[0])
+          return blockdevices::lookupByUUID(device + length);
+        if(&tag == &tags[1])
+          return blockdevices::lookupByLabel(device + length);
+        return nullptr;
+      };
+    blockdevice_t* block = lookup();
+    if(block == nullptr && !probed && &tag <= &tags[1] &&
+       ::access(resolved.c_str(), F_OK) == posix::error_response) // no udev link either
+    {
+      probed = true; // the root device came from the boot cache so nothing else was probed
+      uint64_t start = Tracer::now();
+      blockdevices::init();
+      Tracer::complete("probe", "blockdevices", start);
+      block = lookup();
+    }
+    if(block != nullptr) // already probed while finding the root device
+      resolved = block->path;
+#endif
+    return;
+  }
+}
+
+// NOTE: s_lock must be held
+void FsTab::finish(job_t* job) noexcept
+{
+  --s_remaining;
+  for(job_t* dependent : job->dependents)
+  {
+    if(--dependent->waiting)
+      continue;
+    if(job->failed) // never mount over the directory of a missing parent
+    {
+      dependent->failed = true;
+      dependent->orphaned = true;
+      finish(dependent);
+    }
+    else
+      s_ready.push_back(dependent);
+  }
+  s_wakeup.notify_all();
+}
+
+void FsTab::worker(void) noexcept
+{
+  std::unique_lock<std::mutex> guard(s_lock);
+  for(;;)
+  {
+    s_wakeup.wait(guard, []() noexcept { return !s_ready.empty() || !s_remaining; });
+    if(s_ready.empty())
+      break;
+
+    job_t* job = s_ready.front();
+    s_ready.pop_front();
+    guard.unlock();
+
+    const entry_t* entry = job->entry;
+    int error = 0;
+    if(s_check && !s_check(*entry, job->device.c_str()))
+      error = errno;
+    else
+    {
+      ::mkdir(entry->path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH); // create directory (if it doesn't exist)
+      uint64_t start = Tracer::now();
+      int rval = mount(job->device.c_str(), entry->path, entry->fstype, entry->options);
+      error = rval == posix::success_response ? 0 : errno;
+      Tracer::complete("mount", entry->path, start, error ? "failed" : "mounted", error);
+    }
+
+    guard.lock();
+    job->error = error;
+    job->failed = error != 0;
+    finish(job);
+  }
+}
+
+int FsTab::mountAll(Object::fslot_t<bool, const entry_t&> wanted, check_slot_t check) noexcept
+{
+  s_check = check;
+  std::vector<job_t> jobs(s_entries.size());
+  std::vector<job_t*> by_entry(s_entries.size(), nullptr);
+  for(uint16_t index = 0; index < s_entries.size(); ++index)
+  {
+    const entry_t& entry = s_entries[index];
+    if(is_local(entry) &&
+       wanted(entry) &&
+       !MountTable::findByPath(entry.path)) // not mounted already
+    {
+      job_t* job = by_entry[index] = &jobs[index];
+      job->entry = &entry;
+      job->optional = has_option(entry.options, "nofail");
+      resolve(entry.device, job->device);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(s_lock);
+    s_ready.clear();
+    s_remaining = 0;
+    for(uint16_t index = 0; index < s_entries.size(); ++index)
+    {
+      job_t* job = by_entry[index];
+      if(job == nullptr)
+        continue;
+      ++s_remaining;
+
+      // wait for the nearest ancestor being mounted (the caller waits for unwanted ones, see mountAll)
+      for(uint16_t parent = s_entries[index].parent; parent != entry_t::npos; parent = s_entries[parent].parent)
+        if(by_entry[parent] != nullptr)
+        {
+          by_entry[parent]->dependents.push_back(job);
+          job->waiting = 1;
+          break;
+        }
+      if(!job->waiting)
+        s_ready.push_back(job);
+    }
+    s_ready.sort([](const job_t* a, const job_t* b) noexcept { return a->entry->pass < b->entry->pass; }); // stable
+  }
+
+  std::vector<std::thread> workers;
+  uint16_t count = uint16_t(std::min(posix::size_t(MOUNT_WORKERS), s_ready.size()));
+  count = std::min(count, uint16_t(std::max(1U, std::thread::hardware_concurrency())));
+  while(workers.size() < count)
+    workers.emplace_back(worker);
+  for(std::thread& thread : workers)
+    thread.join();
+  s_check = nullptr;
+
+  int failures = 0;
+  for(job_t* job : by_entry)
+    if(job != nullptr && job->failed)
+    {
+      Display::bailoutLine("Unable to mount %s on %s: %s", job->entry->device, job->entry->path,
+                           job->orphaned ? "parent not mounted" : posix::strerror(job->error));
+      if(!job->optional) // "nofail" mounts are reported but don't fail the step
+        ++failures;
+    }
+  return failures;
+}
@@ -0,0 +1,43 @@
+#ifndef FSTAB_H
+#define FSTAB_H
+
+// STL
+#include <vector>
+
+// PUT
+#include <put/object.h>
+#include <put/cxxutils/posix_helpers.h>
+
+namespace FsTab
+{
+  struct entry_t
+  {
+    const char* device;
+    const char* path;
+    const char* fstype;
+    const char* options;
+    uint16_t parent;  // entry mounted on the nearest directory above this one (npos if none)
+    uint8_t dump;
+    uint8_t pass;     // fsck order (0 = never)
+
+    static constexpr uint16_t npos = UINT16_MAX;
+  };
+
+  // parses /etc/fstab once (entries stay valid for the life of the process)
+  extern bool load(void) noexcept;
+
+  extern const std::vector<entry_t>& entries(void) noexcept;
+  extern const entry_t* findByDevice(const char* device) noexcept;
+  extern const entry_t* findByPath  (const char* path  ) noexcept;
+
+  // called on a worker thread before an entry is mounted with its resolved device (false with errno set to skip it)
+  using check_slot_t = Object::fslot_t<bool, const entry_t&, const char*>;
+
+  // mounts every local entry that is wanted concurrently, each waiting only for the entry its mountpoint lives on
+  // entries are started in fsck pass order and checked first if check is set
+  // returns the number of entries that failed to mount
+  // NOTE: entries that aren't wanted are taken to be in place already: mount them first
+  extern int mountAll(Object::fslot_t<bool, const entry_t&> wanted, check_slot_t check = nullptr) noexcept;
+}
+
+#endif // FSTAB_H
@@ -12,18 +12,21 @@
 #include <list>
 #include <algorithm>
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdlib>
+#include <array>
+#include <random>
+#include <vector>
 
 // PUT
 #include <put/object.h>
-#include <put/childprocess.h>
 #include <put/cxxutils/posix_helpers.h>
 #include <put/cxxutils/hashing.h>
 #include <put/specialized/mount.h>
 #include <put/specialized/fstable.h>
 
-#if defined(WANT_MODULES)
-# include <put/specialized/module.h>
-#endif
 
 #if defined(WANT_MOUNT_ROOT)
 # include <put/specialized/mountpoints.h>
@@ -31,8 +34,33 @@
 # include <put/specialized/blockinfo.h>
 #endif
 
+#if defined(__linux__)
+// Linux
+# include <sys/inotify.h>
+#endif
+
 // Project
 #include "display.h"
+#include "timer.h"
+#include "tracer.h"
+#include "journal.h"
+#include "mounttable.h"
+#include "fstab.h"
+#include "supervisor.h"
+#include "manifest.h"
+#include "readahead.h"
+#include "bootcache.h"
+#include "arena.h"
+#include "reaper.h"
+#include "bootoptions.h"
+#include "fsck.h"
+#include "console.h"
+#if defined(WANT_MODULES)
+# include "modules.h"
+#endif
+#if defined(WANT_MOUNT_ROOT)
+# include "rootdevice.h"
+#endif
 
 #ifndef CONFIG_SERVICE
 #define CONFIG_SERVICE      "sxconfig"
@@ -54,6 +82,10 @@
 #define SBIN_PATH           "/sbin"
 #endif
 
+#ifndef MODULES_PATH
+#define MODULES_PATH        "/modules"
+#endif
+
 #ifndef PROCFS_PATH
 #define PROCFS_PATH         "/proc"
 #endif
@@ -102,6 +134,72 @@
 #define DIRECTOR_SOCKET     "/" DIRECTOR_USERNAME "/io"
 #endif
 
+#ifndef PROVIDER_DEADLINE
+#define PROVIDER_DEADLINE       5000 // milliseconds
+#endif
+
+#ifndef PROVIDER_POLL_INTERVAL
+#define PROVIDER_POLL_INTERVAL  250 // milliseconds
+#endif
+
+#ifndef PROVIDER_RESTART_DELAY_MIN
+#define PROVIDER_RESTART_DELAY_MIN  100 // milliseconds
+#endif
+
+#ifndef PROVIDER_RESTART_DELAY_MAX
+#define PROVIDER_RESTART_DELAY_MAX  30000 // milliseconds
+#endif
+
+#ifndef PROVIDER_RESTART_BUDGET
+#define PROVIDER_RESTART_BUDGET     5 // restarts allowed per window
+#endif
+
+#ifndef PROVIDER_RESTART_WINDOW
+#define PROVIDER_RESTART_WINDOW     60000 // milliseconds
+#endif
+
+#ifndef PROVIDER_CRASH_HISTORY
+#define PROVIDER_CRASH_HISTORY      8
+#endif
+
+static_assert(PROVIDER_CRASH_HISTORY > PROVIDER_RESTART_BUDGET, "crash history must be able to hold more crashes than the restart budget");
+
+#ifndef PROVIDER_NOTIFY_ENV
+#define PROVIDER_NOTIFY_ENV "NOTIFY_FD"
+#endif
+
+#ifndef MANIFEST_PATH
+#define MANIFEST_PATH       "/etc/sxinit.manifest" // read before any step runs (with WANT_MOUNT_ROOT it must be in the initramfs)
+#endif
+
+#ifndef READAHEAD_PATH
+#define READAHEAD_PATH      "/var/lib/sxinit/readahead.pack"
+#endif
+
+#ifndef BOOTCACHE_PATH
+#define BOOTCACHE_PATH      "/var/lib/sxinit/boot.cache"
+#endif
+
+#ifndef BOOTCACHE_EARLY_PATH
+#define BOOTCACHE_EARLY_PATH "/lib/sxinit/boot.cache" // copy of BOOTCACHE_PATH placed in the initramfs when it's built
+#endif
+
+#ifndef TRACE_PATH
+#define TRACE_PATH          "/var/log/sxinit-boot.json"
+#endif
+
+#ifndef JOURNAL_PATH
+#define JOURNAL_PATH        "/var/log/sxinit.log"
+#endif
+
+#ifndef MEMORY_REPORT_DELAY
+#define MEMORY_REPORT_DELAY 60000 // milliseconds after boot to report steady state memory use
+#endif
+
+#ifndef SCHEDULER_WORKERS
+#define SCHEDULER_WORKERS   4
+#endif
+
 #ifdef __linux__
 # define PROCFS_NAME    "proc"
 # define PROCFS_OPTIONS "default"
@@ -111,9 +209,10 @@
 # define PROCFS_OPTIONS "linux"
 #endif
 
+extern char** environ;
+
 namespace Initializer
 {
-  static std::unordered_map<const char*, ChildProcess> s_procs;
 
   enum class State
   {
@@ -124,9 +223,20 @@ namespace Initializer
     Canceled,
     Retrying,
   };
+  // NOTE: a step function that returns State::Starting has not finished and must call completeStep() later
+
+  enum class Context
+  {
+    Worker,     // blocking work (mounts, module loading, probing) run on the worker pool
+    EventLoop,  // work that touches PUT objects, run on the event loop thread
+  };
 
-  void addInitStep(string_literal name, Object::fslot_t<State> func, bool fatal) noexcept;
+  void addInitStep(string_literal name, Object::fslot_t<State> func, bool fatal,
+                   std::list<string_literal> depends = {},
+                   std::list<string_literal> provides = {},
+                   Context context = Context::Worker) noexcept;
   void setStepState(string_literal step_id, State state) noexcept;
+  void completeStep(string_literal step_id, State result) noexcept;
 
   struct step_t
   {
@@ -135,8 +245,38 @@ namespace Initializer
     bool fatal;
     bool have_result;
     State result;
+    Context context;
+    Arena::list<string_literal> depends;  // step names or resources that must settle before this step runs
+    Arena::list<string_literal> provides; // resources (mount paths, sockets) this step makes available
+    Arena::list<step_t*> dependents;      // steps waiting on this step
+    uint16_t waiting;                   // number of unsettled dependencies
+    bool running;
+    bool settled;
   };
-  static std::list<step_t> s_steps;
+  static Arena::list<step_t> s_steps; // released with the other boot structures once every step settles
+
+  // scheduler
+  static std::mutex s_schedule_lock;
+  static std::condition_variable s_worker_wakeup;
+  static Arena::list<step_t*> s_worker_queue;
+  static Arena::list<step_t*> s_loop_queue;
+  static posix::fd_t s_loop_wakeup[2] = { posix::error_response, posix::error_response };
+  static uint16_t s_unsettled = 0;
+  static bool s_aborted = false;
+  static bool s_serial = false; // no wakeup pipe: every step runs on the event loop thread
+  static bool s_finish = false;  // every step has settled: finishBoot() is due on the event loop
+
+  bool resolveDependencies(void) noexcept;
+  void dispatchStep(step_t* step) noexcept;
+  void settleStep(step_t* step, State result) noexcept;
+  void abortBoot(void) noexcept;
+  void bootSettled(void) noexcept;
+  void wakeLoop(void) noexcept;
+  void runLoopSteps(posix::fd_t fd, native_flags_t) noexcept;
+  void finishBoot(bool aborted) noexcept;
+  void runWorker(void) noexcept;
+  State executeStep(step_t* step) noexcept;
+  void releaseBoot(void) noexcept;
 
 #if defined(WANT_MODULES)
   State load_modules(void) noexcept;
@@ -144,7 +284,7 @@ namespace Initializer
 
 #if defined(WANT_MOUNT_ROOT)
   static fsentry_t root_entry;
-  static std::map<std::string, std::string> boot_options;
+  constexpr string_literal mount_root_step = "Mount Root";
   State mount_root(void) noexcept;
 #endif
 
@@ -152,14 +292,23 @@ namespace Initializer
   {
     string_literal step_id;
     int rval;
-    const fsentry_t* fstab_entry;
+    const FsTab::entry_t* fstab_entry;
     fsentry_t defaults;
     bool fatal;
   };
 
+  State start_readahead(void) noexcept;
+  State find_consoles(void) noexcept;
   State read_vfs_paths(void) noexcept;
   State mount_vfs(vfs_mount* vfs) noexcept;
+  State mount_fstab(void) noexcept;
+  bool check_filesystem(string_literal step_id, const char* path, const char* device, const char* fstype, uint8_t pass) noexcept;
+
+  // NOTE: path must outlive the boot trace
+  int traced_mount(const char* device, const char* path, const char* filesystem, const char* options) noexcept;
+  int traced_unmount(const char* path) noexcept;
 
+  // NOTE: not in the arena and never released: the boot trace keeps pointers to the paths (see traced_mount)
   static std::list<vfs_mount> s_vfses = {
 #if defined(WANT_PROCFS)
     { "Mount ProcFS", posix::error_response, nullptr, { "proc", PROCFS_PATH, PROCFS_NAME, PROCFS_OPTIONS }, false },
@@ -172,6 +321,13 @@ namespace Initializer
 #endif
   };
 
+  struct crash_t
+  {
+    uint64_t when;          // monotonic milliseconds
+    posix::error_t status;  // exit status (or errno if it could not be started)
+    int signal;             // terminating signal (0 if exited)
+  };
+
   struct provider_data_t
   {
     const char* step_id;
@@ -180,16 +336,52 @@ namespace Initializer
     const char* username;
     Object::fslot_t<bool> test;
     bool fatal;
+    std::list<string_literal> depends;
+    std::list<string_literal> provides;
+    const char* socket_path; // directory is watched for the socket to appear (optional)
+    uint32_t deadline; // milliseconds allowed to become ready
+
+    // runtime state
+    Supervisor::id_t id = 0; // slot in the supervision table
+    bool awaiting = false;
+    bool supervised = false;
+    posix::fd_t notify = posix::error_response;
+    Timer::id_t deadline_timer = posix::error_response;
+    Timer::id_t poll_timer = posix::error_response;
+    Timer::id_t restart_timer = posix::error_response;
+    int watch = posix::error_response;
+    uint32_t crash_count = 0; // total crashes recorded
+    std::array<crash_t, PROVIDER_CRASH_HISTORY> crashes = {}; // ring buffer indexed by crash_count
   };
 
-  State provider_run   (provider_data_t* data) noexcept;
-  void restart_provider(provider_data_t* data) noexcept;
-  bool start_provider  (provider_data_t* data) noexcept;
+  State provider_run    (provider_data_t* data) noexcept;
+  State await_provider  (provider_data_t* data) noexcept;
+  void restart_provider (provider_data_t* data) noexcept;
+  void schedule_restart (provider_data_t* data) noexcept;
+  bool start_provider   (provider_data_t* data) noexcept;
+  void provider_exited  (provider_data_t* data, posix::error_t status, int signal) noexcept;
+  void check_provider   (provider_data_t* data) noexcept;
+  void settle_provider  (provider_data_t* data, State result) noexcept;
+  void watch_provider   (provider_data_t* data) noexcept;
+  void unwatch_provider (provider_data_t* data) noexcept;
+  void provider_notified(provider_data_t* data, posix::fd_t fd) noexcept;
+
+  void load_manifest    (void) noexcept;
+  bool test_manifest    (const Manifest::provider_t& entry) noexcept;
+
+#if defined(__linux__)
+  static posix::fd_t s_inotify = posix::error_response;
+  void provider_watch_event(posix::fd_t fd, native_flags_t) noexcept;
+#endif
+
+  // ours without PROVIDER_NOTIFY_ENV followed by s_notify_variable (built by the first start, our own is never changed)
+  static std::vector<char*> s_provider_environment;
+  static char s_notify_variable[sizeof(PROVIDER_NOTIFY_ENV) + 16];
 
 // TESTS
   // SXConfig
 #if defined(WANT_CONFIG_SERVICE)
-  static char config_socket_path[PATH_MAX] = { 0 };
+  static char config_socket_path[PATH_MAX] = SCFS_PATH CONFIG_SOCKET;
   bool test_config_service(void) noexcept
   {
     struct stat data;
@@ -199,7 +391,7 @@ namespace Initializer
 #endif
 
   // SXDirector
-  static char director_socket_path[PATH_MAX] = { 0 };
+  static char director_socket_path[PATH_MAX] = SCFS_PATH DIRECTOR_SOCKET;
   bool test_director_service(void) noexcept
   {
     struct stat data;
@@ -212,35 +404,38 @@ namespace Initializer
   static char scfs_mountpoint[PATH_MAX] = { 0 };
   bool test_scfs(void) noexcept
   {
-    std::list<fsentry_t> mtab;
-    if(mount_table(mtab)) // parse mount table
-      for(auto pos = mtab.begin(); pos != mtab.end(); ++pos) // iterate newly parsed mount table
-        if(!posix::strcmp(pos->device, "scfs")) // if scfs is mounted
-        {
-          posix::strncpy(scfs_mountpoint, pos->path, sizeof(scfs_mountpoint));
-          posix::snprintf(config_socket_path  , PATH_MAX, "%s%s", scfs_mountpoint, CONFIG_SOCKET  );
-          posix::snprintf(director_socket_path, PATH_MAX, "%s%s", scfs_mountpoint, DIRECTOR_SOCKET);
-          return true;
-        }
-    return false;
+    fsentry_t entry;
+    if(!MountTable::findBySource("scfs", &entry)) // if scfs isn't mounted
+      return false;
+
+    posix::strncpy(scfs_mountpoint, entry.path, sizeof(scfs_mountpoint));
+    posix::snprintf(config_socket_path  , PATH_MAX, "%s%s", scfs_mountpoint, CONFIG_SOCKET  );
+    posix::snprintf(director_socket_path, PATH_MAX, "%s%s", scfs_mountpoint, DIRECTOR_SOCKET);
+    return true;
   }
 #endif
 
  static std::list<provider_data_t> s_providers = {
 #if defined(WANT_FUSE_SCFS)
-   { "Mount FUSE SCFS", SCFS_BIN, SCFS_ARGS, nullptr, test_scfs, false },
+   { "Mount FUSE SCFS", SCFS_BIN, SCFS_ARGS, nullptr, test_scfs, false, { "/", PROCFS_PATH }, { SCFS_PATH }, nullptr, PROVIDER_DEADLINE },
 #endif
 #if defined(WANT_CONFIG_SERVICE)
-   { "Config Service", CONFIG_BIN, CONFIG_ARGS, CONFIG_USERNAME, test_config_service, false },
+   { "Config Service", CONFIG_BIN, CONFIG_ARGS, CONFIG_USERNAME, test_config_service, false, { "/", SCFS_PATH }, { CONFIG_SOCKET }, config_socket_path, PROVIDER_DEADLINE },
 #endif
-   { "Director Service", DIRECTOR_BIN, DIRECTOR_ARGS, DIRECTOR_USERNAME, test_director_service, true },
+   { "Director Service", DIRECTOR_BIN, DIRECTOR_ARGS, DIRECTOR_USERNAME, test_director_service, true, { "/", SCFS_PATH, CONFIG_SOCKET }, { DIRECTOR_SOCKET }, director_socket_path, PROVIDER_DEADLINE },
  };
 
 }
 
-void Initializer::addInitStep(string_literal name, Object::fslot_t<State> func, bool fatal) noexcept
+void Initializer::addInitStep(string_literal name, Object::fslot_t<State> func, bool fatal,
+                              std::list<string_literal> depends,
+                              std::list<string_literal> provides,
+                              Context context) noexcept
 {
-  s_steps.emplace_back(step_t{ name, func, fatal, false, State::Clear });
+  s_steps.emplace_back(step_t{ name, func, fatal, false, State::Clear, context,
+                               { depends.begin(), depends.end() },
+                               { provides.begin(), provides.end() },
+                               {}, 0, false, false });
   Display::addItem(name);
 }
 
@@ -249,11 +444,11 @@ void Initializer::setStepState(string_literal step_id, State state) noexcept
   switch(state)
   {
     case State::Clear:    Display::setItemState(step_id, terminal::style::reset       , "        "); break;
-    case State::Starting: Display::setItemState(step_id, terminal::style::darkCyan    , "Starting"); break;
-    case State::Passed:   Display::setItemState(step_id, terminal::style::darkGreen   , " Passed "); break;
-    case State::Failed:   Display::setItemState(step_id, terminal::style::darkRed     , " Failed "); break;
-    case State::Canceled: Display::setItemState(step_id, terminal::style::reset       , "Canceled"); break;
-    case State::Retrying: Display::setItemState(step_id, terminal::style::darkYellow  , "Retrying"); break;
+    case State::Starting: Display::setItemState(step_id, terminal::style::darkCyan    , "Starting"); Tracer::begin  ("step", step_id); break;
+    case State::Passed:   Display::setItemState(step_id, terminal::style::darkGreen   , " Passed "); Tracer::end    ("step", step_id, "Passed"); break;
+    case State::Failed:   Display::setItemState(step_id, terminal::style::darkRed     , " Failed "); Tracer::end    ("step", step_id, "Failed"); break;
+    case State::Canceled: Display::setItemState(step_id, terminal::style::reset       , "Canceled"); Tracer::end    ("step", step_id, "Canceled"); break;
+    case State::Retrying: Display::setItemState(step_id, terminal::style::darkYellow  , "Retrying"); Tracer::instant("step", step_id, "Retrying"); break;
   }
 }
 
@@ -264,11 +459,17 @@ void Initializer::start(void) noexcept
     Write = 1,
   };
 
-  posix::fd_t stderr_pipe[2];
-
-  if(!posix::pipe(stderr_pipe) ||
-     !posix::dup2(stderr_pipe[Write], STDERR_FILENO))
+  if(!Journal::init()) // collect stderr
     terminal::write("%s Unable to redirect stderr: %s", terminal::warning, posix::strerror(errno));
+#if !defined(WANT_MOUNT_ROOT)
+  Journal::persist(JOURNAL_PATH); // already on the final root filesystem
+#endif
+
+#if defined(WANT_MOUNT_ROOT)
+  BootCache::open(BOOTCACHE_PATH, BOOTCACHE_EARLY_PATH); // the root device and modules are looked up before root is mounted
+#else
+  BootCache::open(BOOTCACHE_PATH); // read once something is looked up
+#endif
 
   Display::clearItems();
   Display::setItemsLocation(3, 1);
@@ -277,46 +478,361 @@ void Initializer::start(void) noexcept
   addInitStep("Load Modules", load_modules, false);
 #endif
 #if defined(WANT_MOUNT_ROOT)
-  addInitStep("Mount Root", mount_root, false);
+  addInitStep(mount_root_step, mount_root, false, { "Load Modules" }, { "/" });
+  addInitStep("Persist Log", []() noexcept { Journal::persist(JOURNAL_PATH); return State::Passed; }, false,
+              { "/" }, {}, Context::EventLoop); // retries by timer until the root filesystem is writable
 #endif
 
-  if(!s_vfses.empty()) // being empty is unlikely but possible
+  addInitStep("Readahead", start_readahead, false, { "/", PROCFS_PATH }, {}, Context::EventLoop);
+  addInitStep("Find Consoles", find_consoles, false, { "/", PROCFS_PATH });
+  addInitStep("Find Mount Points", read_vfs_paths, false, { "/" });
+  for(vfs_mount& vfs : s_vfses)
+    addInitStep(vfs.step_id, [&vfs]() noexcept { return mount_vfs(&vfs); }, vfs.fatal,
+                { "Find Mount Points" }, { vfs.defaults.path });
+  std::list<string_literal> fstab_depends = { "Find Mount Points", PROCFS_PATH };
+  for(vfs_mount& vfs : s_vfses) // left out of mount_fstab: entries below them must not be hidden by them
+    fstab_depends.push_back(vfs.step_id);
+  addInitStep("Mount Filesystems", mount_fstab, false, fstab_depends);
+
+  if(!MountTable::watch()) // here rather than by whichever worker looks up a mount first (procfs may not be mounted yet)
+    addInitStep("Watch Mounts", []() noexcept { return MountTable::watch() ? State::Passed : State::Failed; }, false,
+                { PROCFS_PATH }, {}, Context::EventLoop);
+  MountTable::subscribe([]() noexcept // providers that mount something are ready once it appears
+                         {
+                           for(provider_data_t& provider : s_providers)
+                             check_provider(&provider);
+                         });
+  // NOTE: provider steps are part of the graph from the start, so the manifest can't wait for root to be mounted
+  if(Manifest::load(MANIFEST_PATH))
+    load_manifest();
+  else if(errno != ENOENT)
+    terminal::write("%s Unable to load provider manifest %s: %s", terminal::warning, MANIFEST_PATH, posix::strerror(errno));
+  Supervisor::id_t id = 0;
+  for(provider_data_t& provider : s_providers)
+    provider.id = id++;
+  for(provider_data_t& provider : s_providers)
+    addInitStep(provider.step_id, [&provider]() noexcept { return provider_run(&provider); }, provider.fatal,
+                provider.depends, provider.provides, Context::EventLoop);
+
+  Display::beginFrame();
+  for(auto& step : s_steps)
+    setStepState(step.name, step.result);
+  Display::endFrame();
+
+  if(!posix::pipe(s_loop_wakeup) ||
+     !EventBackend::add(s_loop_wakeup[Read], EventFlags::Readable, runLoopSteps))
   {
-    addInitStep("Find Mount Points", read_vfs_paths, false);
-    for(vfs_mount& vfs : s_vfses)
-      addInitStep(vfs.step_id, [&vfs]() noexcept { return mount_vfs(&vfs); }, vfs.fatal);
+    terminal::write("%s Unable to attach scheduler to the event loop: %s", terminal::warning, posix::strerror(errno));
+    s_serial = true; // run every step in dispatch order on the event loop thread (by timer) instead
   }
 
-  for(provider_data_t& provider : s_providers)
-    addInitStep(provider.step_id, [&provider]() noexcept { return provider_run(&provider); }, provider.fatal);
+  std::lock_guard<std::mutex> guard(s_schedule_lock);
+  if(!resolveDependencies())
+    return;
 
   for(auto& step : s_steps)
-    setStepState(step.name, step.result);
+    if(!step.settled && !step.waiting)
+      dispatchStep(&step);
+
+  if(!s_worker_queue.empty())
+  {
+    uint16_t workers = std::min(uint16_t(SCHEDULER_WORKERS), uint16_t(std::max(1U, std::thread::hardware_concurrency())));
+    while(workers--)
+      std::thread(runWorker).detach();
+  }
+}
+
+// links each step to the steps that provide what it depends upon
+// NOTE: dependencies that no step provides are assumed to be satisfied by the environment
+bool Initializer::resolveDependencies(void) noexcept
+{
+  for(auto& step : s_steps)
+  {
+    step.dependents.clear();
+    step.waiting = 0;
+    step.running = false;
+    step.settled = false;
+  }
 
   for(auto& step : s_steps)
+    for(string_literal dependency : step.depends)
+      for(auto& provider : s_steps)
+        if(&provider != &step &&
+           (!posix::strcmp(provider.name, dependency) ||
+            std::any_of(provider.provides.begin(), provider.provides.end(),
+                        [dependency](string_literal resource) noexcept { return !posix::strcmp(resource, dependency); })) &&
+           std::find(provider.dependents.begin(), provider.dependents.end(), &step) == provider.dependents.end())
+        {
+          provider.dependents.push_back(&step);
+          ++step.waiting;
+        }
+
+  s_unsettled = uint16_t(s_steps.size());
+  s_aborted = false;
+
+  // walk the graph in topological order to find dependency cycles
+  Arena::list<step_t*> order;
+  Arena::unordered_map<step_t*, uint16_t> remaining;
+  for(auto& step : s_steps)
+    if(!(remaining[&step] = step.waiting))
+      order.push_back(&step);
+  for(auto pos = order.begin(); pos != order.end(); ++pos)
+    for(step_t* dependent : (*pos)->dependents)
+      if(!--remaining[dependent])
+        order.push_back(dependent);
+
+  if(order.size() == s_steps.size())
+    return true;
+
+  // steps in (or behind) a cycle can never be scheduled: settle them all before reporting any
+  // so that no dependent is released (settleStep() would dispatch the rest of a cycle)
+  bool fatal = false;
+  for(auto& step : s_steps)
+    if(remaining[&step])
+    {
+      step.result = State::Failed;
+      step.have_result = true;
+      step.settled = true;
+      --s_unsettled;
+      fatal |= step.fatal;
+    }
+
+  Display::beginFrame();
+  for(auto& step : s_steps)
+    if(remaining[&step])
+    {
+      Display::bailoutLine("Dependency cycle detected at step: %s", step.name);
+      setStepState(step.name, State::Failed);
+    }
+  Display::endFrame();
+
+  if(fatal)
+  {
+    abortBoot();
+    return false;
+  }
+  if(!s_unsettled)
+    bootSettled();
+  return true;
+}
+
+// NOTE: s_schedule_lock must be held
+void Initializer::dispatchStep(step_t* step) noexcept
+{
+  step->running = true;
+  if(step->context == Context::EventLoop || s_serial)
+  {
+    s_loop_queue.push_back(step);
+    if(s_loop_queue.size() == 1) // only wake the event loop once per batch
+      wakeLoop();
+  }
+  else
   {
-    if(!step.have_result || step.result == State::Failed)
+    s_worker_queue.push_back(step);
+    s_worker_wakeup.notify_one();
+  }
+}
+
+void Initializer::completeStep(string_literal step_id, State result) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_schedule_lock);
+  bool found = false;
+  for(auto& step : s_steps)
+    if(step.name == step_id)
     {
-      step.result = step.func();
-      setStepState(step.name, step.result);
-      if(step.result == State::Failed && step.fatal)
-      {
-        run_emergency_shell();
-        break;
-      }
+      found = true;
+      if(step.settled) // step is being revisited (e.g. a provider restart)
+        setStepState(step_id, result);
+      else
+        settleStep(&step, result);
     }
+  if(!found) // boot is over and the steps are gone (e.g. a provider restart)
+    setStepState(step_id, result);
+}
+
+// NOTE: s_schedule_lock must be held
+void Initializer::settleStep(step_t* step, State result) noexcept
+{
+  if(step->settled ||
+     result == State::Starting) // step will complete later
+    return;
+
+  step->result = result;
+  step->have_result = true;
+  step->running = false;
+  step->settled = true;
+  --s_unsettled;
+  setStepState(step->name, step->result);
+
+  if(step->result == State::Failed && step->fatal)
+  {
+    abortBoot();
+    return;
   }
+
+  if(!s_aborted)
+    for(step_t* dependent : step->dependents)
+      if(!--dependent->waiting && !dependent->settled)
+        dispatchStep(dependent);
+
+  if(!s_unsettled)
+    bootSettled();
+}
+
+// NOTE: s_schedule_lock must be held
+void Initializer::abortBoot(void) noexcept
+{
+  s_aborted = true;
+  Display::beginFrame();
+  for(auto& other : s_steps)
+    if(!other.settled && !other.running) // steps already in progress will be left to finish
+    {
+      other.settled = true;
+      --s_unsettled;
+      setStepState(other.name, State::Canceled);
+    }
+  Display::endFrame();
+  s_worker_queue.clear();
+  s_loop_queue.clear();
+  s_worker_wakeup.notify_all();
+  run_emergency_shell();
+  if(!s_unsettled) // nothing was left running to settle it later
+    bootSettled();
+}
+
+// NOTE: s_schedule_lock must be held
+void Initializer::bootSettled(void) noexcept
+{
+  s_worker_wakeup.notify_all(); // let the workers exit
+  s_finish = true; // the rest writes files: not on a worker and not while holding the lock
+  wakeLoop();
+}
+
+// NOTE: s_schedule_lock must be held
+void Initializer::wakeLoop(void) noexcept
+{
+  enum {
+    Read = 0,
+    Write = 1,
+  };
+
+  if(!s_serial)
+    posix::write(s_loop_wakeup[Write], "!", 1);
+  else
+    Timer::start(0, []() noexcept { runLoopSteps(posix::error_response, 0); });
+}
+
+// runs on the event loop once every step has settled
+void Initializer::finishBoot(bool aborted) noexcept
+{
+  Tracer::save(TRACE_PATH);
+  Readahead::finish();
+  BootCache::save();
+  if(!aborted)
+    Timer::start(0, releaseBoot); // once the caller (and the steps it is iterating) is done
+}
+
+// frees everything only the boot needed so supervision runs on what is left
+void Initializer::releaseBoot(void) noexcept
+{
+  Arena::report("boot");
+  {
+    std::lock_guard<std::mutex> guard(s_schedule_lock);
+    s_worker_queue.clear();
+    s_loop_queue.clear();
+    s_steps.clear();
+  }
+  Arena::release();
+  Timer::start(MEMORY_REPORT_DELAY, []() noexcept
+               {
+                 Arena::report("steady");
+                 Reaper::report();
+               });
+}
+
+Initializer::State Initializer::executeStep(step_t* step) noexcept
+{
+  if(!step->have_result || step->result == State::Failed)
+  {
+    setStepState(step->name, State::Starting);
+    return step->func();
+  }
+  return step->result; // reuse prior result
+}
+
+void Initializer::runWorker(void) noexcept
+{
+  std::unique_lock<std::mutex> guard(s_schedule_lock);
+  for(;;)
+  {
+    s_worker_wakeup.wait(guard, []() noexcept { return !s_worker_queue.empty() || s_aborted || !s_unsettled; });
+    if(s_worker_queue.empty())
+      break;
+
+    step_t* step = s_worker_queue.front();
+    s_worker_queue.pop_front();
+    guard.unlock();
+    State result = executeStep(step);
+    guard.lock();
+    settleStep(step, result); // ignored if the step completes later
+  }
+}
+
+void Initializer::runLoopSteps(posix::fd_t fd, native_flags_t) noexcept
+{
+  char buffer[64];
+  if(fd != posix::error_response)
+    posix::read(fd, buffer, sizeof(buffer)); // consume wakeup(s)
+
+  Arena::list<step_t*> batch;
+  {
+    std::lock_guard<std::mutex> guard(s_schedule_lock);
+    batch.swap(s_loop_queue);
+  }
+
+  for(step_t* step : batch)
+  {
+    State result = executeStep(step);
+    std::lock_guard<std::mutex> guard(s_schedule_lock);
+    settleStep(step, result);
+  }
+
+  bool finish;
+  bool aborted;
+  {
+    std::lock_guard<std::mutex> guard(s_schedule_lock);
+    finish = s_finish;
+    aborted = s_aborted;
+    s_finish = false;
+  }
+  if(finish)
+    finishBoot(aborted);
+}
+
+// replays the files the previous boot read (or records them) alongside the mounts and providers
+Initializer::State Initializer::start_readahead(void) noexcept
+{
+  if(!Readahead::start(READAHEAD_PATH))
+  {
+    Display::bailoutLine("Unable to start readahead: %s", posix::strerror(errno));
+    return State::Failed;
+  }
+  return State::Passed;
+}
+
+// adds every console= to the display (only /dev/console is written to until now)
+Initializer::State Initializer::find_consoles(void) noexcept
+{
+  Console::discover(PROCFS_PATH "/cmdline");
+  return State::Passed;
 }
 
 Initializer::State Initializer::read_vfs_paths(void) noexcept
 {
-  std::list<fsentry_t> fstab;
-  if(filesystem_table(fstab)) // parse filesystem table
+  if(FsTab::load()) // parse filesystem table (once)
   {
-    for(const fsentry_t& entry : fstab) // iterate all fstab entries
-      for(vfs_mount& vfs : s_vfses) // iterate all vfses we want
-        if(!posix::strcmp(entry.device, vfs.defaults.device)) // if the fstab entry is the vfs we want
-          vfs.fstab_entry = &entry; // copy a pointer to the entry
+    for(vfs_mount& vfs : s_vfses) // iterate all vfses we want
+      vfs.fstab_entry = FsTab::findByDevice(vfs.defaults.device);
     return State::Passed;
   }
   else
@@ -326,87 +842,448 @@ Initializer::State Initializer::read_vfs_paths(void) noexcept
 
 Initializer::State Initializer::mount_vfs(vfs_mount* vfs) noexcept
 {
+  fsentry_t mounted;
+  if(MountTable::findByPath(vfs->defaults.path, &mounted) && // something is mounted there already
+     !posix::strcmp(mounted.filesystems, vfs->defaults.filesystems)) // and it's what we want
+  {
+    vfs->rval = posix::success_response;
+    return State::Passed;
+  }
+
   if(vfs->fstab_entry != nullptr)
   {
     ::mkdir(vfs->fstab_entry->path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH); // create directory (if it doesn't exist)
-    vfs->rval = mount(vfs->fstab_entry->device, vfs->fstab_entry->path, vfs->fstab_entry->filesystems, vfs->fstab_entry->options);
+    vfs->rval = traced_mount(vfs->fstab_entry->device, vfs->fstab_entry->path, vfs->fstab_entry->fstype, vfs->fstab_entry->options);
   }
 
   if(vfs->rval != posix::success_response) // if not mounted
   {
     ::mkdir(vfs->defaults.path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH); // create directory (if it doesn't exist)
-    vfs->rval = mount(vfs->defaults.device, vfs->defaults.path, vfs->defaults.filesystems, vfs->defaults.options); // mount to default directory with default options
+    vfs->rval = traced_mount(vfs->defaults.device, vfs->defaults.path, vfs->defaults.filesystems, vfs->defaults.options); // mount to default directory with default options
   }
   return vfs->rval == posix::success_response ? State::Passed : State::Failed;
 }
 
+// everything else in fstab, mounted concurrently
+Initializer::State Initializer::mount_fstab(void) noexcept
+{
+#if !defined(WANT_MOUNT_ROOT)
+  BootOptions::load(PROCFS_PATH "/cmdline"); // not read while mounting root
+  Fsck::configure(BootOptions::get(BootOptions::Option::FsckMode), BootOptions::get(BootOptions::Option::FsckRepair));
+#endif
+  int failures = FsTab::mountAll([](const FsTab::entry_t& entry) noexcept
+                                 {
+                                   return std::none_of(s_vfses.begin(), s_vfses.end(),
+                                                       [&entry](const vfs_mount& vfs) noexcept { return vfs.fstab_entry == &entry; });
+                                 },
+                                 [](const FsTab::entry_t& entry, const char* device) noexcept
+                                 { return check_filesystem("Mount Filesystems", entry.path, device, entry.fstype, entry.pass); });
+  return failures ? State::Failed : State::Passed;
+}
+
+// runs fsck with its progress shown as the state of step_id, false if the filesystem must not be mounted
+bool Initializer::check_filesystem(string_literal step_id, const char* path, const char* device, const char* fstype, uint8_t pass) noexcept
+{
+  Fsck::Result result = Fsck::check(path, device, fstype, pass,
+                                    [step_id](const char*, int percent) noexcept
+                                    {
+                                      char state[16];
+                                      posix::snprintf(state, sizeof(state), "fsck%3d%%", percent);
+                                      Display::setItemState(step_id, terminal::style::darkCyan, state);
+                                    });
+  int error = errno;
+  switch(result)
+  {
+    case Fsck::Result::Skipped:
+      return true;
+    case Fsck::Result::Clean:
+    case Fsck::Result::Repaired:
+      break;
+    case Fsck::Result::Reboot:
+      Display::bailoutLine("Repaired %s on %s: reboot recommended", device, path);
+      break;
+    case Fsck::Result::Uncorrected:
+      Display::bailoutLine("Unable to repair %s on %s: run fsck manually", device, path);
+      errno = error;
+      return false;
+    case Fsck::Result::Error:
+      if(error != ENOENT) // no checker installed
+        Display::bailoutLine("Unable to check %s on %s: %s", device, path, posix::strerror(error));
+      break;
+  }
+  Display::setItemState(step_id, terminal::style::darkCyan, "Starting"); // progress is over
+  return true;
+}
+
+int Initializer::traced_mount(const char* device, const char* path, const char* filesystem, const char* options) noexcept
+{
+  uint64_t start = Tracer::now();
+  int rval = mount(device, path, filesystem, options);
+  Tracer::complete("mount", path, start, rval == posix::success_response ? "mounted" : "failed", rval == posix::success_response ? 0 : errno);
+  return rval;
+}
+
+int Initializer::traced_unmount(const char* path) noexcept
+{
+  uint64_t start = Tracer::now();
+  int rval = unmount(path);
+  Tracer::complete("unmount", path, start, rval == posix::success_response ? "unmounted" : "failed", rval == posix::success_response ? 0 : errno);
+  return rval;
+}
+
 Initializer::State Initializer::provider_run(provider_data_t* data) noexcept
 {
   if(data->test())
     return State::Canceled;
 
-  int retries = 5;
-  for(; retries > 0; --retries, ::sleep(1)) // keep trying and wait a second between tries
+  if(!start_provider(data))
+    return State::Failed;
+  return await_provider(data);
+}
+
+Initializer::State Initializer::await_provider(provider_data_t* data) noexcept
+{
+  if(data->test()) // ready already
   {
-    if(start_provider(data) && data->test())
-      retries = INT_MIN + 1; // exit loop
-    else
-      setStepState(data->step_id, State::Retrying);
+    settle_provider(data, State::Passed);
+    return State::Passed;
   }
 
-  if(retries == INT_MIN) // if succeeded
+  data->awaiting = true;
+  data->deadline_timer = Timer::start(data->deadline,
+                                      [data]() noexcept
+                                      {
+                                        data->deadline_timer = posix::error_response; // timer is spent
+                                        if(data->awaiting && !data->test())
+                                        {
+                                          settle_provider(data, State::Failed);
+                                          completeStep(data->step_id, State::Failed);
+                                        }
+                                        else
+                                          check_provider(data);
+                                      });
+  if(data->deadline_timer == posix::error_response) // no event driven timers: wait here
   {
-    Object::connect(s_procs[data->bin].finished,
-        [data](pid_t, posix::error_t) noexcept { restart_provider(data); });
-    Object::connect(s_procs[data->bin].killed,
-        [data](pid_t, posix::Signal::EId) noexcept { restart_provider(data); });
+    for(uint32_t waited = 0; waited < data->deadline && !data->test(); waited += PROVIDER_POLL_INTERVAL)
+      ::usleep(PROVIDER_POLL_INTERVAL * 1000);
+    State result = data->test() ? State::Passed : State::Failed;
+    settle_provider(data, result);
+    return result;
+  }
+
+  // the poll timer is a safety net for providers that neither notify nor create a watchable socket
+  data->poll_timer = Timer::start(PROVIDER_POLL_INTERVAL, [data]() noexcept { check_provider(data); }, true);
+  watch_provider(data);
+  return State::Starting;
+}
+
+void Initializer::check_provider(provider_data_t* data) noexcept
+{
+  if(!data->awaiting)
+    return;
+
+  if(data->test())
+  {
+    settle_provider(data, State::Passed);
+    completeStep(data->step_id, State::Passed);
+  }
+  else
+    watch_provider(data); // a deeper directory may exist now
+}
+
+// stops waiting for readiness and begins supervision if the provider passed
+void Initializer::settle_provider(provider_data_t* data, State result) noexcept
+{
+  data->awaiting = false;
+  if(result == State::Passed)
+    data->supervised = true; // restart it from now on
+  else if(!data->supervised)
+    Timer::stop(data->restart_timer);
+  Timer::stop(data->deadline_timer);
+  Timer::stop(data->poll_timer);
+  unwatch_provider(data);
+  if(data->notify != posix::error_response)
+  {
+    EventBackend::remove(data->notify, EventFlags::Readable);
+    posix::close(data->notify);
+    data->notify = posix::error_response;
+  }
+}
+
+void Initializer::provider_notified(provider_data_t* data, posix::fd_t fd) noexcept
+{
+  char buffer[64];
+  posix::ssize_t count = posix::read(fd, buffer, sizeof(buffer));
+  if(count > 0) // provider reports it is ready
+    check_provider(data);
+  else if(count == 0 || errno != EAGAIN) // provider closed notification descriptor or exited
+  {
+    EventBackend::remove(fd, EventFlags::Readable);
+    posix::close(fd);
+    if(data->notify == fd)
+      data->notify = posix::error_response;
   }
-  return retries == INT_MIN ? State::Passed : State::Failed;
 }
 
+void Initializer::watch_provider(provider_data_t* data) noexcept
+{
+#if defined(__linux__)
+  if(data->socket_path == nullptr || !*data->socket_path)
+    return;
+
+  if(s_inotify == posix::error_response)
+  {
+    s_inotify = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(s_inotify == posix::error_response)
+      return;
+    if(!EventBackend::add(s_inotify, EventFlags::Readable, provider_watch_event))
+    {
+      posix::close(s_inotify);
+      s_inotify = posix::error_response;
+      return;
+    }
+  }
+
+  char directory[PATH_MAX] = { 0 };
+  posix::strncpy(directory, data->socket_path, sizeof(directory) - 1);
+
+  // watch the deepest directory on the socket path that exists
+  for(char* slash = posix::strrchr(directory, '/'); slash != nullptr; slash = posix::strrchr(directory, '/'))
+  {
+    *slash = '\0';
+    int watch = ::inotify_add_watch(s_inotify, slash == directory ? "/" : directory,
+                                    IN_CREATE | IN_MOVED_TO | IN_ATTRIB | IN_ONLYDIR);
+    if(watch != posix::error_response)
+    {
+      if(watch != data->watch)
+        unwatch_provider(data);
+      data->watch = watch;
+      return;
+    }
+    if(slash == directory)
+      break;
+  }
+#else
+  (void)data;
+#endif
+}
+
+void Initializer::unwatch_provider(provider_data_t* data) noexcept
+{
+#if defined(__linux__)
+  int watch = data->watch;
+  data->watch = posix::error_response;
+  if(watch == posix::error_response ||
+     std::any_of(s_providers.begin(), s_providers.end(),
+                 [watch](const provider_data_t& other) noexcept { return other.watch == watch; })) // directory watch is shared
+    return;
+  ::inotify_rm_watch(s_inotify, watch);
+#else
+  (void)data;
+#endif
+}
+
+#if defined(__linux__)
+void Initializer::provider_watch_event(posix::fd_t fd, native_flags_t) noexcept
+{
+  alignas(struct inotify_event) char buffer[4096];
+  posix::ssize_t count;
+  while((count = posix::read(fd, buffer, sizeof(buffer))) > 0)
+    for(char* pos = buffer; pos < buffer + count; pos += sizeof(struct inotify_event) + reinterpret_cast<struct inotify_event*>(pos)->len)
+    {
+      int watch = reinterpret_cast<struct inotify_event*>(pos)->wd;
+      for(provider_data_t& provider : s_providers)
+        if(provider.watch == watch)
+          check_provider(&provider);
+    }
+}
+#endif
+
 bool Initializer::start_provider(provider_data_t* data) noexcept
 {
-  if(s_procs.find(data->bin) != s_procs.end()) // if process exists
+  enum {
+    Read = 0,
+    Write = 1,
+  };
+
+  if(Supervisor::running(data->id)) // if process exists
     return false; // do not try to start it
 
-  setStepState(data->step_id, State::Starting);
-  ChildProcess& proc = s_procs[data->bin]; // create process
-  return
-      (data->arguments == nullptr || proc.setOption("/Process/Arguments", data->arguments)) && // set arguments if they exist
-      (data->username  == nullptr || proc.setOption("/Process/User", data->username)) && // set username if provided
-      proc.invoke(); // invoke the process
+  if(s_provider_environment.empty())
+  {
+    for(char** pos = environ; *pos != nullptr; ++pos)
+      if(posix::strncmp(*pos, PROVIDER_NOTIFY_ENV "=", sizeof(PROVIDER_NOTIFY_ENV))) // not inherited from our parent
+        s_provider_environment.push_back(*pos);
+    s_provider_environment.push_back(s_notify_variable);
+    s_provider_environment.push_back(nullptr);
+  }
+
+  // give the provider a descriptor to write to once it is ready (like sd_notify)
+  // NOTE: providers are only started on the event loop thread and Spawn reads envp before returning
+  Spawn::setup_t setup;
+  posix::fd_t notify[2] = { posix::error_response, posix::error_response };
+  if(::pipe2(notify, O_CLOEXEC) == posix::success_response) // only the child's copy of the write end is kept open
+  {
+    ::fcntl(notify[Read], F_SETFL, ::fcntl(notify[Read], F_GETFL) | O_NONBLOCK);
+    posix::snprintf(s_notify_variable, sizeof(s_notify_variable), PROVIDER_NOTIFY_ENV "=%d", notify[Write]);
+    setup.envp = s_provider_environment.data();
+    setup.inherit_fd = notify[Write];
+  }
+
+  setup.stderr_fd = Journal::childOutput(data->bin); // a pipe of its own
+  uint64_t spawn_start = Tracer::now();
+  bool started = Supervisor::start(data->id, data->bin, data->arguments, data->username,
+                                   [data](posix::error_t status, int signal) noexcept { provider_exited(data, status, signal); },
+                                   &setup);
+  Tracer::complete("spawn", data->bin, spawn_start, started ? "spawned" : "spawn failed",
+                   started ? Supervisor::entry(data->id).pid : errno); // tools/bootbench matches the pid to its exec
+  if(setup.stderr_fd != posix::error_response)
+    posix::close(setup.stderr_fd); // only the child may hold the write end
+
+  if(notify[Write] != posix::error_response)
+  {
+    posix::close(notify[Write]); // only the child may hold the write end
+
+    if(data->notify != posix::error_response) // discard the descriptor of a previous attempt
+    {
+      EventBackend::remove(data->notify, EventFlags::Readable);
+      posix::close(data->notify);
+      data->notify = posix::error_response;
+    }
+
+    if(started &&
+       EventBackend::add(notify[Read], EventFlags::Readable,
+                         [data](posix::fd_t fd, native_flags_t) noexcept { provider_notified(data, fd); }))
+      data->notify = notify[Read];
+    else
+      posix::close(notify[Read]);
+  }
+  return started;
 }
 
-void Initializer::restart_provider(provider_data_t* data) noexcept
+void Initializer::provider_exited(provider_data_t* data, posix::error_t status, int signal) noexcept
 {
-  if(s_procs.find(data->bin) != s_procs.end()) // if process existed once
+  crash_t& crash = data->crashes[data->crash_count++ % PROVIDER_CRASH_HISTORY];
+  crash.when = Timer::monotonic() / 1000000;
+  crash.status = status;
+  crash.signal = signal;
+  Tracer::instant("process", data->bin, signal ? "killed" : "exited", signal ? signal : status);
+
+  if(data->awaiting || // died before becoming ready
+     data->supervised)
+    schedule_restart(data);
+}
+
+// restart with exponential backoff and jitter, cooling down when the restart budget is spent
+void Initializer::schedule_restart(provider_data_t* data) noexcept
+{
+  static std::minstd_rand jitter(uint32_t(Timer::monotonic()));
+
+  if(data->restart_timer != posix::error_response) // already scheduled
+    return;
+
+  uint64_t now = Timer::monotonic() / 1000000;
+  uint32_t recent = 0;
+  for(uint32_t pos = 0; pos < data->crash_count && pos < PROVIDER_CRASH_HISTORY; ++pos)
+    if(now - data->crashes[pos].when < PROVIDER_RESTART_WINDOW)
+      ++recent;
+
+  uint32_t delay = PROVIDER_RESTART_WINDOW;
+  if(recent > PROVIDER_RESTART_BUDGET)
+  {
+    char count[16];
+    char seconds[16];
+    posix::snprintf(count, sizeof(count), "%u", recent);
+    posix::snprintf(seconds, sizeof(seconds), "%u", PROVIDER_RESTART_WINDOW / 1000);
+    Display::bailoutLine("%s crashed %s times, suspending restarts for %s seconds", data->step_id, count, seconds);
+  }
+  else
   {
-    s_procs.erase(data->bin); // erase old process entry
-    ::sleep(1); // safety delay
+    delay = PROVIDER_RESTART_DELAY_MIN << std::min(recent ? recent - 1 : 0U, 16U);
+    delay = std::min(delay, uint32_t(PROVIDER_RESTART_DELAY_MAX));
+    delay = delay - delay / 4 + jitter() % (delay / 2 + 1); // +/- 25%
   }
-  start_provider(data);
+
+  setStepState(data->step_id, State::Retrying);
+  data->restart_timer = Timer::start(delay,
+                                     [data]() noexcept
+                                     {
+                                       data->restart_timer = posix::error_response; // timer is spent
+                                       restart_provider(data);
+                                     });
+  if(data->restart_timer == posix::error_response)
+    Display::bailoutLine("Unable to schedule restart of %s: %s", data->step_id, posix::strerror(errno));
 }
 
+void Initializer::restart_provider(provider_data_t* data) noexcept
+{
+  setStepState(data->step_id, State::Starting); // the first start is marked by executeStep
+  if(!start_provider(data))
+  {
+    provider_exited(data, errno, 0); // count as a crash
+    return;
+  }
+
+  if(data->awaiting) // still within the deadline of the first start
+    return;
 
-#if defined(WANT_MODULES)
-Initializer::State Initializer::load_modules(void) noexcept
+  State result = await_provider(data);
+  if(result != State::Starting)
+    completeStep(data->step_id, result);
+}
+
+// replaces the built-in providers with the ones in the manifest (strings stay in the mapping)
+void Initializer::load_manifest(void) noexcept
 {
-  posix::fd_t fd = posix::open("/modules/modules.list", O_RDONLY);
+  s_providers.clear();
+  for(uint16_t index = 0; index < Manifest::count(); ++index)
+  {
+    const Manifest::provider_t& entry = Manifest::provider(index);
+    s_providers.emplace_back(provider_data_t{ Manifest::string(entry.step_id),
+                                              Manifest::string(entry.bin),
+                                              Manifest::string(entry.arguments),
+                                              Manifest::string(entry.username),
+                                              [&entry]() noexcept { return test_manifest(entry); },
+                                              entry.fatal != 0,
+                                              {}, {},
+                                              Manifest::string(entry.socket_path),
+                                              entry.deadline ? entry.deadline : PROVIDER_DEADLINE });
+    provider_data_t& provider = s_providers.back();
+    for(uint16_t item = 0; item < entry.depends_count; ++item)
+      provider.depends.push_back(Manifest::listItem(entry.depends, item));
+    for(uint16_t item = 0; item < entry.provides_count; ++item)
+      provider.provides.push_back(Manifest::listItem(entry.provides, item));
+  }
+}
 
-  if(fd == posix::error_response)
+bool Initializer::test_manifest(const Manifest::provider_t& entry) noexcept
+{
+  struct stat data;
+  switch(entry.ready)
   {
-    Display::bailoutLine("Unable to open list of modules to load: %s", posix::strerror(errno));
-    return State::Failed;
+    case Manifest::Ready::None:
+      return true;
+    case Manifest::Ready::Socket:
+      return posix::stat(Manifest::string(entry.socket_path), &data) && // stat file on VFS worked AND
+          data.st_mode & S_IFSOCK; // it's a socket file
+    case Manifest::Ready::Mount:
+      return MountTable::findBySource(Manifest::string(entry.mount_source));
   }
+  return false;
+}
 
-  // TODO
 
-  if(false)
+#if defined(WANT_MODULES)
+Initializer::State Initializer::load_modules(void) noexcept
+{
+  int failures = Modules::load(MODULES_PATH);
+
+  if(failures == posix::error_response)
   {
-    Display::bailoutLine("Unable to load module %s: %s", "xyz", posix::strerror(errno));
+    Display::bailoutLine("Unable to open list of modules to load: %s", posix::strerror(errno));
     return State::Failed;
   }
-  return State::Passed;
+  return failures ? State::Failed : State::Passed; // failures are reported by the loader
 }
 
 #endif
@@ -417,110 +1294,46 @@ Initializer::State Initializer::mount_root(void) noexcept
   fsentry_t root_entry;
 # if defined(WANT_PROCFS)
   ::mkdir(PROCFS_PATH, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH); // create directory (if it doesn't exist)
-  if(mount("proc", PROCFS_PATH, PROCFS_NAME, PROCFS_OPTIONS) == posix::success_response) // temporarily mount procfs
+  if(traced_mount("proc", PROCFS_PATH, PROCFS_NAME, PROCFS_OPTIONS) == posix::success_response) // temporarily mount procfs
   {
     reinitialize_paths();
-    constexpr posix::size_t cmdlength = 0x2000; // 8KB
-    char cmdline[cmdlength + 1] = { 0 }; // 8KB + NUL char
-
-    posix::fd_t fd = posix::open(PROCFS_PATH "/cmdline", O_RDONLY); // read /proc/cmdline so we can read boot options
-    posix::ssize_t count = posix::read(fd, cmdline, cmdlength);
+    uint64_t parse_start = Tracer::now();
+    BootOptions::load(PROCFS_PATH "/cmdline"); // read boot options
+    Tracer::complete("parse", "cmdline", parse_start);
+    Fsck::configure(BootOptions::get(BootOptions::Option::FsckMode), BootOptions::get(BootOptions::Option::FsckRepair));
 
-    std::string key;
-    std::string value;
-    key.reserve(cmdlength);
-    value.reserve(cmdlength);
+    const char* mode = BootOptions::get(BootOptions::Option::Mode);
+    if(mode != nullptr)
+      posix::strncpy(root_entry.options, mode, sizeof(fsentry_t::options));
 
-    for(char* pos = cmdline; *pos && pos < cmdline + count; ++pos)
+    const char* root = BootOptions::get(BootOptions::Option::Root);
+    if(root != nullptr)
     {
-      key.clear();
-      value.clear();
-
-      while(*pos && posix::isspace(*pos))
-        ++pos;
-
-      for(; *pos && pos < cmdline + cmdlength && posix::isgraph(*pos) && *pos != '='; ++pos)
-        key.push_back(char(::tolower(*pos))); // options must be lowercase
-
-      if(*pos == '=')
-      {
-        for(++pos; *pos && pos < cmdline + cmdlength && posix::isgraph(*pos); ++pos)
-          value.push_back(*pos);
-        boot_options.emplace(key, value);
-      }
-      else
-      {
-        switch (hash(key))
-        {
-          case "debug"_hash:
-            boot_options.emplace("debug", "yes");
-            break;
-          case "break"_hash:
-            boot_options.emplace("break", "premount");
-            break;
-          case "noresume"_hash:
-            boot_options.emplace("noresume", "premount");
-            break;
-          case "ro"_hash:
-            posix::strncpy(root_entry.options, "ro", sizeof(fsentry_t::options));
-            break;
-          case "rw"_hash:
-            posix::strncpy(root_entry.options, "rw", sizeof(fsentry_t::options));
-            break;
-          case "fastboot"_hash:
-            boot_options.emplace("fsck.mode", "skip");
-            break;
-          case "forcefsck"_hash:
-            boot_options.emplace("fsck.mode", "force");
-            break;
-          case "fsckfix"_hash:
-            boot_options.emplace("fsck.repair", "yes");
-            break;
-
-          default:
-            break;
-        }
-      }
-    }
-
-    blockdevices::init(); // probe system partitions (reads /proc/partitions)
-    blockdevice_t* root_device = nullptr;
-    auto pos = boot_options.find("root");
-    if(pos != boot_options.end())
-    {
-      std::string::size_type offset = pos->second.find('=');
-      if(offset == std::string::npos) // not found
-      {
-        root_device = blockdevices::lookupByPath(pos->second.c_str()); // try to find in detected devices
-        if(root_device == nullptr) // if none found
-          root_device = blockdevices::probe(pos->second.c_str()); // probe the specified device name
-      }
-      else // found '='
-      {
-        std::string prefix = pos->second.substr(0, offset);
-        std::transform(prefix.begin(), prefix.end(), prefix.begin(), ::toupper);
-        switch(hash(prefix))
-        {
-          case "UUID"_hash: // found "root=UUID=XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX"
-            root_device = blockdevices::lookupByUUID(pos->second.substr(offset).c_str());
-            break;
-          case "LABEL"_hash: // found "root=LABEL=XXXXXXXX"
-            root_device = blockdevices::lookupByLabel(pos->second.substr(offset).c_str());
-            break;
-          default: // found "root=???=XXXXXXXX" but try to find it anyway
-            root_device = blockdevices::lookup(pos->second.substr(offset).c_str());
-            break;
-        }
-      }
+      int timeout = 0; // fail immediately unless asked to wait
+      const char* delay = BootOptions::get(BootOptions::Option::RootDelay);
+      if(delay != nullptr)
+        timeout = int(posix::strtoul(delay, nullptr, 10)) * 1000; // seconds
+      if(BootOptions::has(BootOptions::Option::RootWait))
+        timeout = -1; // wait forever
+
+      blockdevice_t* root_device =
+          RootDevice::find(root, timeout,
+                           []() noexcept
+                           {
+                             setStepState(mount_root_step, State::Retrying);
+                             Display::bailoutLine("Waiting for root device...");
+                           });
 
       if(root_device != nullptr) // found a device
       {
         posix::strncpy(root_entry.device, root_device->path, sizeof(fsentry_t::device)); // copy over data
         posix::strncpy(root_entry.filesystems, root_device->fstype, sizeof(fsentry_t::filesystems));
+        if(!check_filesystem(mount_root_step, "/", root_entry.device, root_entry.filesystems, 1)) // root is always pass 1
+          return State::Failed;
       }
       else
       {
-        Display::bailoutLine("Could not find root device using: %s", pos->second.c_str());
+        Display::bailoutLine("Could not find root device using: %s", root);
         return State::Failed;
       }
     }
@@ -530,7 +1343,7 @@ Initializer::State Initializer::mount_root(void) noexcept
       return State::Failed;
     }
 
-    unmount(PROCFS_PATH); // done with temporary procfs mount
+    traced_unmount(PROCFS_PATH); // done with temporary procfs mount
   }
   else
   {
@@ -538,9 +1351,11 @@ Initializer::State Initializer::mount_root(void) noexcept
     return State::Failed;
   }
 # else
+  uint64_t probe_start = Tracer::now();
   blockdevices::init(); // probe system partitions
+  Tracer::complete("probe", "blockdevices", probe_start);
 # endif
-  if(mount(root_entry.device, "/", root_entry.filesystems, root_entry.options) != posix::success_response) // mount directly on top of Linux rootfs
+  if(traced_mount(root_entry.device, "/", root_entry.filesystems, root_entry.options) != posix::success_response) // mount directly on top of Linux rootfs
   {
     Display::bailoutLine("Unable to mount device \"%s\": %s", root_entry.device, posix::strerror(errno));
     return State::Failed;
@@ -554,6 +1369,7 @@ void Initializer::run_emergency_shell(void) noexcept
 {
   uint16_t rows = 0;
   uint16_t columns = 0;
+  Console::release(); // the shell expects a blocking terminal
   terminal::getWindowSize(rows, columns);
   terminal::setCursorPosition(rows - 5, 0);
   terminal::write("Starting rescue shell\n");
@@ -0,0 +1,375 @@
+#include "journal.h"
+
+// STL
+#include <list>
+#include <array>
+#include <mutex>
+#include <algorithm>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// PUT
+#include <put/specialized/eventbackend.h>
+#include <put/cxxutils/vterm.h>
+
+// Project
+#include "timer.h"
+
+#ifndef KMSG_PATH
+#define KMSG_PATH                 "/dev/kmsg"
+#endif
+
+#ifndef JOURNAL_RING_SIZE
+#define JOURNAL_RING_SIZE         8192 // bytes held per source before the oldest are dropped
+#endif
+
+#ifndef JOURNAL_FLUSH_DELAY
+#define JOURNAL_FLUSH_DELAY       50 // milliseconds spent gathering a batch
+#endif
+
+#ifndef JOURNAL_FLUSH_BUDGET
+#define JOURNAL_FLUSH_BUDGET      2048 // bytes forwarded per source per flush
+#endif
+
+#ifndef JOURNAL_RECORD_SIZE
+#define JOURNAL_RECORD_SIZE       960 // bytes per /dev/kmsg record (the kernel refuses ~1KB and up)
+#endif
+
+#ifndef JOURNAL_BATCH_SIZE
+#define JOURNAL_BATCH_SIZE        16384 // bytes per log file write
+#endif
+
+#ifndef JOURNAL_PERSIST_INTERVAL
+#define JOURNAL_PERSIST_INTERVAL  1000 // milliseconds
+#endif
+
+#ifndef JOURNAL_PERSIST_ATTEMPTS
+#define JOURNAL_PERSIST_ATTEMPTS  600
+#endif
+
+static_assert(JOURNAL_BATCH_SIZE >= JOURNAL_RECORD_SIZE, "a batch must hold at least one record");
+
+namespace Journal
+{
+  enum {
+    Read = 0,
+    Write = 1,
+  };
+
+  struct source_t
+  {
+    const char* name;
+    posix::fd_t fd;     // read end of the pipe (posix::error_response once closed)
+    uint32_t head;      // total bytes written to ring
+    uint32_t tail;      // total bytes taken from ring
+    uint64_t received;  // bytes read from the pipe
+    uint64_t dropped;   // bytes discarded because the ring was full
+    uint64_t reported;  // dropped bytes already reported
+    std::array<char, JOURNAL_RING_SIZE> ring;
+  };
+
+  static std::mutex s_lock;
+  static std::list<source_t> s_sources; // stable addresses for event callbacks
+  static std::list<source_t> s_spares;  // sources of children that are gone, reused by later ones
+  static posix::fd_t s_stderr = posix::error_response; // write end of our own pipe
+  static posix::fd_t s_kmsg = posix::error_response;
+  static posix::fd_t s_file = posix::error_response;
+  static Timer::id_t s_flush_timer = posix::error_response;
+  static Timer::id_t s_persist_timer = posix::error_response;
+  static uint16_t s_persist_attempts = 0;
+
+  static char s_batch[JOURNAL_BATCH_SIZE];
+  static posix::size_t s_batch_length = 0;
+  static const source_t* s_batch_source = nullptr; // a kmsg record only holds lines of one source
+
+  source_t* attach(const char* name, posix::fd_t fd) noexcept;
+  void drain(source_t* source) noexcept;
+  void append(source_t* source, const char* data, posix::size_t length) noexcept;
+  void flush(void) noexcept;
+  void schedule(void) noexcept;
+  void emit(const source_t* source, const char* line, posix::size_t length) noexcept;
+  void commit(void) noexcept;
+  bool open_file(const char* path) noexcept;
+}
+
+bool Journal::init(void) noexcept
+{
+  posix::fd_t fds[2];
+  if(!posix::pipe(fds))
+    return false;
+
+  ::fcntl(fds[Write], F_SETFL, ::fcntl(fds[Write], F_GETFL) | O_NONBLOCK); // PID 1 must never stall on its own diagnostics
+  ::fcntl(fds[Write], F_SETFD, FD_CLOEXEC);
+
+  std::lock_guard<std::mutex> guard(s_lock);
+  if(attach("sxinit", fds[Read]) == nullptr ||
+     !posix::dup2(fds[Write], STDERR_FILENO))
+  {
+    posix::close(fds[Write]);
+    return false;
+  }
+  s_stderr = fds[Write];
+  return true;
+}
+
+// our own stderr is left alone: the child is given the write end in place of it (see Spawn::setup_t)
+posix::fd_t Journal::childOutput(const char* name) noexcept
+{
+  posix::fd_t fds[2];
+  if(s_stderr == posix::error_response || ::pipe2(fds, O_CLOEXEC) == posix::error_response)
+    return posix::error_response;
+
+  std::lock_guard<std::mutex> guard(s_lock);
+  if(attach(name, fds[Read]) == nullptr)
+  {
+    posix::close(fds[Write]);
+    return posix::error_response;
+  }
+  return fds[Write];
+}
+
+void Journal::persist(const char* path) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  if(s_file != posix::error_response || open_file(path))
+  {
+    Timer::stop(s_persist_timer);
+    return;
+  }
+
+  if(errno != EROFS && errno != ENOENT && errno != EACCES) // not a problem that mounting will solve
+  {
+    Timer::stop(s_persist_timer);
+    terminal::write("%s Unable to write log to %s: %s\n", terminal::warning, path, posix::strerror(errno));
+    return;
+  }
+
+  if(s_persist_timer == posix::error_response && s_persist_attempts < JOURNAL_PERSIST_ATTEMPTS)
+    s_persist_timer = Timer::start(JOURNAL_PERSIST_INTERVAL,
+                                   [path]() noexcept
+                                   {
+                                     if(++s_persist_attempts >= JOURNAL_PERSIST_ATTEMPTS)
+                                       Timer::stop(s_persist_timer); // give up
+                                     persist(path);
+                                   }, true);
+}
+
+// NOTE: s_lock must be held
+bool Journal::open_file(const char* path) noexcept
+{
+  posix::fd_t fd = posix::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP);
+  if(fd == posix::error_response)
+    return false;
+
+  commit(); // finish the record in progress on the old sink
+  s_file = fd;
+  if(s_kmsg != posix::error_response)
+  {
+    posix::close(s_kmsg);
+    s_kmsg = posix::error_response;
+  }
+  return true;
+}
+
+// NOTE: s_lock must be held
+Journal::source_t* Journal::attach(const char* name, posix::fd_t fd) noexcept
+{
+  ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  if(s_spares.empty())
+    s_sources.emplace_back();
+  else // a restarted child needs no new ring
+    s_sources.splice(s_sources.end(), s_spares, s_spares.begin());
+  source_t* source = &s_sources.back();
+  source->name = name;
+  source->fd = fd;
+  source->head = source->tail = 0;
+  source->received = source->dropped = source->reported = 0;
+
+  if(!EventBackend::add(fd, EventFlags::Readable,
+                        [source](posix::fd_t, native_flags_t) noexcept
+                        {
+                          std::lock_guard<std::mutex> guard(s_lock);
+                          drain(source);
+                        }))
+  {
+    posix::close(fd);
+    s_spares.splice(s_spares.end(), s_sources, std::prev(s_sources.end()));
+    return nullptr;
+  }
+  return source;
+}
+
+// empty the pipe right away so writers never block, whether or not the sink keeps up
+void Journal::drain(source_t* source) noexcept
+{
+  char buffer[4096];
+  posix::ssize_t count = 0;
+  while(source->fd != posix::error_response &&
+        (count = posix::read(source->fd, buffer, sizeof(buffer))) > 0)
+    append(source, buffer, posix::size_t(count));
+
+  if(source->fd != posix::error_response &&
+     (count == 0 || (errno != EAGAIN && errno != EINTR))) // every writer is gone
+  {
+    EventBackend::remove(source->fd, EventFlags::Readable);
+    posix::close(source->fd);
+    source->fd = posix::error_response;
+  }
+  schedule();
+}
+
+// when the ring is full the oldest bytes are dropped (and accounted for) instead of stalling the writer
+void Journal::append(source_t* source, const char* data, posix::size_t length) noexcept
+{
+  source->received += length;
+  if(length > JOURNAL_RING_SIZE)
+  {
+    source->dropped += length - JOURNAL_RING_SIZE;
+    data += length - JOURNAL_RING_SIZE;
+    length = JOURNAL_RING_SIZE;
+  }
+
+  uint32_t space = JOURNAL_RING_SIZE - (source->head - source->tail);
+  if(length > space)
+  {
+    source->tail += uint32_t(length - space);
+    source->dropped += length - space;
+  }
+
+  while(length)
+  {
+    uint32_t offset = source->head % JOURNAL_RING_SIZE;
+    posix::size_t chunk = std::min(length, posix::size_t(JOURNAL_RING_SIZE - offset));
+    posix::memcpy(source->ring.data() + offset, data, chunk);
+    source->head += uint32_t(chunk);
+    data += chunk;
+    length -= chunk;
+  }
+}
+
+// NOTE: s_lock must be held
+void Journal::schedule(void) noexcept
+{
+  if(s_flush_timer == posix::error_response)
+    s_flush_timer = Timer::start(JOURNAL_FLUSH_DELAY,
+                                 []() noexcept
+                                 {
+                                   std::lock_guard<std::mutex> guard(s_lock);
+                                   s_flush_timer = posix::error_response; // timer is spent
+                                   flush();
+                                 });
+}
+
+// forwards whole lines from every source, each limited to its budget so a chatty one can't starve the rest
+void Journal::flush(void) noexcept
+{
+  if(s_file == posix::error_response && s_kmsg == posix::error_response)
+    s_kmsg = posix::open(KMSG_PATH, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+  if(s_file == posix::error_response && s_kmsg == posix::error_response)
+    return; // keep buffering until /dev is ready (retried when more arrives)
+
+  bool backlog = false;
+  char line[JOURNAL_RECORD_SIZE];
+  for(auto pos = s_sources.begin(); pos != s_sources.end();)
+  {
+    source_t* source = &*pos;
+    if(source->dropped != source->reported)
+    {
+      int length = posix::snprintf(line, sizeof(line), "[%llu of %llu bytes dropped]",
+                                   static_cast<unsigned long long>(source->dropped - source->reported),
+                                   static_cast<unsigned long long>(source->received));
+      emit(source, line, posix::size_t(std::max(length, 0)));
+      source->reported = source->dropped;
+    }
+
+    posix::size_t limit = sizeof(line) - posix::strlen(source->name) - 8; // room for "<30>name: " and '\n'
+    posix::size_t budget = JOURNAL_FLUSH_BUDGET;
+    while(budget && source->tail != source->head)
+    {
+      posix::size_t used = source->head - source->tail;
+      posix::size_t available = std::min(used, std::min(limit, budget));
+      posix::size_t length = 0;
+      while(length < available && source->ring[(source->tail + length) % JOURNAL_RING_SIZE] != '\n')
+        ++length;
+
+      bool complete = length < available;
+      if(!complete && length == budget && budget < limit && budget < used) // the line doesn't fit what is left
+      {
+        budget = 0; // forward it next time
+        break;
+      }
+      if(!complete && // no newline yet
+         length < limit && // not an overlong line
+         source->fd != posix::error_response && // more may come
+         used < JOURNAL_RING_SIZE) // and there is room for it
+        break;
+
+      for(posix::size_t i = 0; i < length; ++i)
+        line[i] = source->ring[(source->tail + i) % JOURNAL_RING_SIZE];
+      emit(source, line, length);
+
+      length += complete ? 1 : 0; // consume the newline
+      source->tail += uint32_t(length);
+      budget -= std::min(budget, length);
+    }
+
+    backlog |= !budget && source->tail != source->head;
+    if(source->fd == posix::error_response && source->tail == source->head) // closed and forwarded
+    {
+      if(s_batch_source == source)
+        commit();
+      s_spares.splice(s_spares.end(), s_sources, pos++); // keep the ring for the next child
+    }
+    else
+      ++pos;
+  }
+  commit();
+
+  if(backlog)
+    schedule();
+}
+
+void Journal::emit(const source_t* source, const char* line, posix::size_t length) noexcept
+{
+  posix::size_t name_length = posix::strlen(source->name);
+  posix::size_t required = name_length + length + 24; // prefix, timestamp and newline
+  if(s_file == posix::error_response
+     ? (s_batch_source != source || s_batch_length + required > JOURNAL_RECORD_SIZE) // records hold lines of one source
+     : s_batch_length + required > JOURNAL_BATCH_SIZE)
+    commit();
+
+  if(s_file != posix::error_response) // the kernel timestamps records but not files
+  {
+    uint64_t now = Timer::monotonic() / 1000;
+    s_batch_length += posix::size_t(std::max(0, posix::snprintf(s_batch + s_batch_length, sizeof(s_batch) - s_batch_length,
+                                                                "[%5u.%06u] ", uint32_t(now / 1000000), uint32_t(now % 1000000))));
+  }
+  else if(!s_batch_length)
+  {
+    posix::memcpy(s_batch, "<30>", 4); // LOG_DAEMON | LOG_INFO
+    s_batch_length = 4;
+  }
+
+  posix::memcpy(s_batch + s_batch_length, source->name, name_length);
+  s_batch_length += name_length;
+  s_batch[s_batch_length++] = ':';
+  s_batch[s_batch_length++] = ' ';
+  posix::memcpy(s_batch + s_batch_length, line, length);
+  s_batch_length += length;
+  s_batch[s_batch_length++] = '\n';
+  s_batch_source = source;
+}
+
+// a single write per record (kmsg) or per batch (file), so the kernel's rate limit sees few messages
+void Journal::commit(void) noexcept
+{
+  posix::fd_t sink = s_file != posix::error_response ? s_file : s_kmsg;
+  if(s_batch_length && sink != posix::error_response)
+    posix::write(sink, s_batch, s_batch_length); // lost if the sink refuses it: never worth stalling for
+  s_batch_length = 0;
+  s_batch_source = nullptr;
+}
@@ -0,0 +1,22 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+// PUT
+#include <put/cxxutils/posix_helpers.h>
+
+namespace Journal
+{
+  // redirects stderr of this process into the collector (writes never block)
+  extern bool init(void) noexcept;
+
+  // write end of a new pipe collected under name for a child's stderr (close-on-exec, the caller closes it)
+  // returns posix::error_response if stderr isn't collected
+  // NOTE: name must outlive the child (string literal or static storage)
+  extern posix::fd_t childOutput(const char* name) noexcept;
+
+  // switch from /dev/kmsg to a log file once path can be created (retries until the filesystem is writable)
+  // NOTE: call from the event loop thread (see Timer::start)
+  extern void persist(const char* path) noexcept;
+}
+
+#endif // JOURNAL_H
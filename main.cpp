@@ -4,10 +4,12 @@
 // Project
 #include "initializer.h"
 #include "display.h"
+#include "reaper.h"
 
 
 int main(void) // there are no arguments for an init system!
 {
+  Reaper::init(); // first: threads started later inherit SIGCHLD blocked
   Display::init();
   Application app;
   Initializer::start();
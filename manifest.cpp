@@ -0,0 +1,118 @@
+#include "manifest.h"
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// PUT
+#include <put/cxxutils/posix_helpers.h>
+
+namespace Manifest
+{
+  static const uint8_t* s_base = nullptr; // read-only mapping, never unmapped
+  static const header_t* s_header = nullptr;
+
+  bool validate(const uint8_t* base, posix::size_t size) noexcept;
+}
+
+bool Manifest::load(const char* path) noexcept
+{
+  if(s_header != nullptr)
+    return true;
+
+  posix::fd_t fd = posix::open(path, O_RDONLY | O_CLOEXEC);
+  if(fd == posix::error_response)
+    return false;
+
+  struct stat state;
+  if(::fstat(fd, &state) == posix::error_response)
+  {
+    posix::close(fd);
+    return false;
+  }
+
+  if(posix::size_t(state.st_size) < sizeof(header_t)) // too small to be a manifest
+  {
+    posix::close(fd);
+    errno = EINVAL;
+    return false;
+  }
+
+  void* base = ::mmap(nullptr, posix::size_t(state.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  posix::close(fd); // the mapping keeps the file
+  if(base == MAP_FAILED)
+    return false;
+
+  if(!validate(static_cast<const uint8_t*>(base), posix::size_t(state.st_size)))
+  {
+    ::munmap(base, posix::size_t(state.st_size));
+    errno = EINVAL;
+    return false;
+  }
+
+  s_base = static_cast<const uint8_t*>(base);
+  s_header = reinterpret_cast<const header_t*>(base);
+  return true;
+}
+
+// every offset is checked here so lookups never have to
+bool Manifest::validate(const uint8_t* base, posix::size_t size) noexcept
+{
+  const header_t& header = *reinterpret_cast<const header_t*>(base);
+  if(header.magic != MANIFEST_MAGIC ||
+     header.version != MANIFEST_VERSION ||
+     header.size != size ||
+     header.providers % alignof(provider_t) ||
+     header.lists % alignof(uint32_t) ||
+     header.providers < sizeof(header_t) ||
+     header.providers + uint64_t(header.provider_count) * sizeof(provider_t) > header.lists ||
+     header.lists + uint64_t(header.list_count) * sizeof(uint32_t) > header.strings ||
+     header.strings + uint64_t(header.strings_size) > size ||
+     !header.strings_size ||
+     base[header.strings] != '\0' || // offset 0 is the empty string
+     base[header.strings + header.strings_size - 1] != '\0') // so every string is terminated
+    return false;
+
+  const uint32_t* lists = reinterpret_cast<const uint32_t*>(base + header.lists);
+  for(uint32_t index = 0; index < header.list_count; ++index)
+    if(!lists[index] || // list items are never empty (listItem() would return nullptr)
+       lists[index] >= header.strings_size)
+      return false;
+
+  const provider_t* providers = reinterpret_cast<const provider_t*>(base + header.providers);
+  for(uint16_t index = 0; index < header.provider_count; ++index)
+  {
+    const provider_t& entry = providers[index];
+    if(!entry.step_id || // must be named
+       !entry.bin ||
+       entry.step_id      >= header.strings_size ||
+       entry.bin          >= header.strings_size ||
+       entry.arguments    >= header.strings_size ||
+       entry.username     >= header.strings_size ||
+       entry.socket_path  >= header.strings_size ||
+       entry.mount_source >= header.strings_size ||
+       entry.depends  + uint64_t(entry.depends_count ) > header.list_count ||
+       entry.provides + uint64_t(entry.provides_count) > header.list_count ||
+       entry.ready > Ready::Mount ||
+       (entry.ready == Ready::Socket && !entry.socket_path) ||
+       (entry.ready == Ready::Mount && !entry.mount_source))
+      return false;
+  }
+  return true;
+}
+
+bool Manifest::loaded(void) noexcept
+  { return s_header != nullptr; }
+
+uint16_t Manifest::count(void) noexcept
+  { return s_header != nullptr ? s_header->provider_count : 0; }
+
+const Manifest::provider_t& Manifest::provider(uint16_t index) noexcept
+  { return reinterpret_cast<const provider_t*>(s_base + s_header->providers)[index]; }
+
+const char* Manifest::string(uint32_t offset) noexcept
+  { return offset ? reinterpret_cast<const char*>(s_base + s_header->strings + offset) : nullptr; }
+
+const char* Manifest::listItem(uint32_t list, uint16_t index) noexcept
+  { return string(reinterpret_cast<const uint32_t*>(s_base + s_header->lists)[list + index]); }
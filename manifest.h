@@ -0,0 +1,70 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+// STL
+#include <cstdint>
+
+// NOTE: this header is shared with tools/manifestc.cpp so it must not depend on PUT
+
+#define MANIFEST_MAGIC    0x4d584953 // "SIXM" in host byte order (a foreign byte order reads as a bad magic)
+#define MANIFEST_VERSION  1
+
+// Layout (every offset is from the start of the file and 4 byte aligned):
+//   header_t
+//   provider_t[provider_count]
+//   uint32_t[list_count]          string offsets referenced by provider_t::depends and provides
+//   char[]                        NUL terminated strings (offset 0 is the empty string)
+namespace Manifest
+{
+  enum class Ready : uint8_t
+  {
+    None,     // ready as soon as it starts
+    Socket,   // ready once socket_path is a socket
+    Mount,    // ready once something with mount_source is mounted
+  };
+
+  struct header_t
+  {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t provider_count;
+    uint32_t size;            // total file size
+    uint32_t providers;       // offset of the provider table
+    uint32_t lists;           // offset of the list table
+    uint32_t list_count;
+    uint32_t strings;         // offset of the string table
+    uint32_t strings_size;
+  };
+
+  struct provider_t
+  {
+    uint32_t step_id;         // string offsets
+    uint32_t bin;
+    uint32_t arguments;
+    uint32_t username;
+    uint32_t socket_path;
+    uint32_t mount_source;
+    uint32_t deadline;        // milliseconds allowed to become ready (0 = default)
+    uint32_t depends;         // index into the list table
+    uint32_t provides;        // index into the list table
+    uint16_t depends_count;
+    uint16_t provides_count;
+    Ready ready;
+    uint8_t fatal;
+    uint16_t reserved;
+  };
+
+  static_assert(sizeof(header_t) == 32, "header layout changed");
+  static_assert(sizeof(provider_t) == 44, "provider layout changed");
+
+  // maps the manifest read-only and validates every offset once (nothing is copied)
+  extern bool load(const char* path) noexcept;
+  extern bool loaded(void) noexcept;
+
+  extern uint16_t count(void) noexcept;
+  extern const provider_t& provider(uint16_t index) noexcept;
+  extern const char* string(uint32_t offset) noexcept; // nullptr for the empty string
+  extern const char* listItem(uint32_t list, uint16_t index) noexcept;
+}
+
+#endif // MANIFEST_H
@@ -0,0 +1,461 @@
+#include "modules.h"
+
+// STL
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// POSIX
+#include <sys/mman.h>
+
+#if defined(__linux__)
+// Linux
+#include <sys/syscall.h>
+#endif
+
+// PUT
+#include <put/cxxutils/hashing.h>
+
+// Project
+#include "display.h"
+#include "tracer.h"
+#include "bootcache.h"
+
+#ifndef MODULE_WORKERS
+#define MODULE_WORKERS  4
+#endif
+
+namespace Modules
+{
+  struct slice_t
+  {
+    const char* data;
+    posix::size_t length;
+  };
+
+  struct mapping_t
+  {
+    const char* data = nullptr;
+    posix::size_t size = 0;
+  };
+
+  struct module_t
+  {
+    slice_t path;        // relative to the module directory
+    slice_t arguments;
+    char name[64];       // for reports (outlives the mapped files)
+    uint64_t elapsed;    // nanoseconds
+    int error;
+    uint16_t waiting;    // dependencies not yet loaded
+    bool failed;
+    std::vector<module_t*> dependents;
+  };
+
+  static std::list<module_t> s_modules; // kept for the boot trace
+  static std::unordered_multimap<uint32_t, module_t*> s_index;
+  static std::unordered_multimap<uint32_t, slice_t> s_dependencies; // path hash -> dependency list
+  static std::vector<char> s_record; // resolved modules from the boot cache
+
+  static std::mutex s_lock;
+  static std::condition_variable s_wakeup;
+  static std::list<module_t*> s_ready;
+  static posix::size_t s_remaining = 0;
+  static posix::size_t s_active = 0; // modules being loaded
+
+  bool map(const char* filename, mapping_t& mapping) noexcept;
+  void unmap(mapping_t& mapping) noexcept;
+  bool next_line(const char*& pos, const char* end, slice_t& line) noexcept;
+  slice_t next_word(const char*& pos, const char* end) noexcept;
+  module_t* find(slice_t path) noexcept;
+  module_t* create(slice_t path, slice_t arguments) noexcept;
+  module_t* add(slice_t path, slice_t arguments, uint16_t depth) noexcept;
+  bool restore(const char* name, uint64_t stamp) noexcept;
+  void store(const char* name, uint64_t stamp) noexcept;
+  void finish(module_t* module) noexcept;
+  void worker(posix::fd_t directory) noexcept;
+  int load_one(posix::fd_t directory, module_t* module) noexcept;
+
+  static inline bool equal(slice_t a, slice_t b) noexcept
+    { return a.length == b.length && !posix::memcmp(a.data, b.data, a.length); }
+}
+
+bool Modules::map(const char* filename, mapping_t& mapping) noexcept
+{
+  posix::fd_t fd = posix::open(filename, O_RDONLY | O_CLOEXEC);
+  if(fd == posix::error_response)
+    return false;
+
+  struct stat info;
+  bool ok = posix::fstat(fd, &info);
+  if(ok && info.st_size > 0)
+  {
+    void* data = ::mmap(nullptr, posix::size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ok = data != MAP_FAILED;
+    if(ok)
+    {
+      mapping.data = static_cast<const char*>(data);
+      mapping.size = posix::size_t(info.st_size);
+    }
+  }
+  posix::close(fd);
+  return ok;
+}
+
+void Modules::unmap(mapping_t& mapping) noexcept
+{
+  if(mapping.data != nullptr)
+    ::munmap(const_cast<char*>(mapping.data), mapping.size);
+  mapping.data = nullptr;
+  mapping.size = 0;
+}
+
+bool Modules::next_line(const char*& pos, const char* end, slice_t& line) noexcept
+{
+  while(pos < end)
+  {
+    line.data = pos;
+    while(pos < end && *pos != '\n')
+      ++pos;
+    line.length = posix::size_t(pos - line.data);
+    if(pos < end)
+      ++pos; // skip newline
+    if(line.length && *line.data != '#') // skip blank lines and comments
+      return true;
+  }
+  return false;
+}
+
+Modules::slice_t Modules::next_word(const char*& pos, const char* end) noexcept
+{
+  while(pos < end && posix::isspace(*pos))
+    ++pos;
+  slice_t word = { pos, 0 };
+  while(pos < end && !posix::isspace(*pos) && *pos != ':')
+    ++pos;
+  word.length = posix::size_t(pos - word.data);
+  if(pos < end && *pos == ':')
+    ++pos;
+  return word;
+}
+
+Modules::module_t* Modules::find(slice_t path) noexcept
+{
+  auto range = s_index.equal_range(hash(path.data, path.length));
+  for(auto pos = range.first; pos != range.second; ++pos)
+    if(equal(pos->second->path, path))
+      return pos->second;
+  return nullptr;
+}
+
+Modules::module_t* Modules::create(slice_t path, slice_t arguments) noexcept
+{
+  s_modules.emplace_back();
+  module_t* module = &s_modules.back();
+  module->path = path;
+  module->arguments = arguments;
+  module->elapsed = 0;
+  module->error = 0;
+  module->waiting = 0;
+  module->failed = false;
+
+  const char* base = path.data + path.length;
+  while(base > path.data && base[-1] != '/')
+    --base;
+  posix::size_t length = std::min(posix::size_t(path.data + path.length - base), sizeof(module->name) - 1);
+  posix::memcpy(module->name, base, length);
+  module->name[length] = '\0';
+
+  s_index.emplace(hash(path.data, path.length), module);
+  return module;
+}
+
+// adds a module and (recursively) the modules it depends upon
+Modules::module_t* Modules::add(slice_t path, slice_t arguments, uint16_t depth) noexcept
+{
+  module_t* module = find(path);
+  if(module != nullptr)
+  {
+    if(arguments.length) // explicitly listed after being pulled in as a dependency
+      module->arguments = arguments;
+    return module;
+  }
+
+  if(depth > 64) // malformed dependency data
+    return nullptr;
+
+  module = create(path, arguments);
+  uint32_t key = hash(path.data, path.length);
+  auto range = s_dependencies.equal_range(key);
+  for(auto entry = range.first; entry != range.second; ++entry)
+  {
+    const char* pos = entry->second.data;
+    const char* end = pos + entry->second.length;
+    if(!equal(next_word(pos, end), path)) // hash collision
+      continue;
+    for(slice_t dependency = next_word(pos, end); dependency.length; dependency = next_word(pos, end))
+    {
+      module_t* required = add(dependency, slice_t{ nullptr, 0 }, uint16_t(depth + 1));
+      if(required != nullptr && required != module &&
+         std::find(required->dependents.begin(), required->dependents.end(), module) == required->dependents.end())
+      {
+        required->dependents.push_back(module);
+        ++module->waiting;
+      }
+    }
+    break;
+  }
+  return module;
+}
+
+// record layout for each module in load order:
+// uint16_t path length, argument length and dependent count, the path, the arguments, uint16_t dependents
+bool Modules::restore(const char* name, uint64_t stamp) noexcept
+{
+  if(!BootCache::get(name, stamp, s_record))
+    return false;
+
+  std::vector<module_t*> modules;
+  std::vector<std::pair<const char*, uint16_t>> dependents; // where the dependents of each module are listed
+  const char* pos = s_record.data();
+  const char* end = pos + s_record.size();
+  bool valid = true;
+  while(valid && pos < end)
+  {
+    uint16_t sizes[3];
+    valid = posix::size_t(end - pos) >= sizeof(sizes);
+    if(valid)
+    {
+      posix::memcpy(sizes, pos, sizeof(sizes));
+      pos += sizeof(sizes);
+      valid = sizes[0] && posix::size_t(end - pos) >= posix::size_t(sizes[0]) + sizes[1] + sizes[2] * sizeof(uint16_t);
+    }
+    if(valid)
+    {
+      modules.push_back(create(slice_t{ pos, sizes[0] }, slice_t{ pos + sizes[0], sizes[1] }));
+      pos += sizes[0] + sizes[1];
+      dependents.emplace_back(pos, sizes[2]);
+      pos += sizes[2] * sizeof(uint16_t);
+    }
+  }
+
+  for(posix::size_t number = 0; valid && number < modules.size(); ++number)
+  {
+    for(uint16_t entry = 0; valid && entry < dependents[number].second; ++entry)
+    {
+      uint16_t dependent;
+      posix::memcpy(&dependent, dependents[number].first + entry * sizeof(uint16_t), sizeof(dependent));
+      valid = dependent < modules.size() && dependent != number;
+      if(valid)
+      {
+        modules[number]->dependents.push_back(modules[dependent]);
+        ++modules[dependent]->waiting;
+      }
+    }
+  }
+
+  if(!valid) // parse the files instead
+  {
+    s_modules.clear();
+    s_index.clear();
+  }
+  return valid;
+}
+
+void Modules::store(const char* name, uint64_t stamp) noexcept
+{
+  std::unordered_map<const module_t*, uint16_t> numbers;
+  for(const module_t& module : s_modules)
+    numbers.emplace(&module, uint16_t(numbers.size()));
+  if(s_modules.size() > UINT16_MAX)
+    return;
+
+  std::vector<char> record;
+  for(const module_t& module : s_modules)
+  {
+    if(module.path.length > UINT16_MAX || module.arguments.length > UINT16_MAX) // not worth caching
+      return;
+    uint16_t sizes[3] = { uint16_t(module.path.length), uint16_t(module.arguments.length), uint16_t(module.dependents.size()) };
+    const char* bytes = reinterpret_cast<const char*>(sizes);
+    record.insert(record.end(), bytes, bytes + sizeof(sizes));
+    record.insert(record.end(), module.path.data, module.path.data + module.path.length);
+    record.insert(record.end(), module.arguments.data, module.arguments.data + module.arguments.length);
+    for(const module_t* dependent : module.dependents)
+    {
+      bytes = reinterpret_cast<const char*>(&numbers[dependent]);
+      record.insert(record.end(), bytes, bytes + sizeof(uint16_t));
+    }
+  }
+  BootCache::put(name, stamp, record.data(), record.size());
+}
+
+int Modules::load_one(posix::fd_t directory, module_t* module) noexcept
+{
+#if defined(__linux__) && defined(SYS_finit_module)
+  char path[PATH_MAX];
+  char arguments[1024];
+  posix::snprintf(path, sizeof(path), "%.*s", int(module->path.length), module->path.data);
+  posix::snprintf(arguments, sizeof(arguments), "%.*s", int(module->arguments.length), module->arguments.data);
+
+  posix::fd_t fd = ::openat(directory, path, O_RDONLY | O_CLOEXEC);
+  if(fd == posix::error_response)
+    return errno;
+  int rval = int(::syscall(SYS_finit_module, fd, arguments, 0));
+  int error = errno;
+  posix::close(fd);
+  return rval == posix::success_response || error == EEXIST ? 0 : error; // already loaded is fine
+#else
+  (void)directory;
+  (void)module;
+  return ENOSYS;
+#endif
+}
+
+// NOTE: s_lock must be held
+void Modules::finish(module_t* module) noexcept
+{
+  --s_remaining;
+  for(module_t* dependent : module->dependents)
+  {
+    if(module->failed && !dependent->failed) // don't try modules whose dependencies are missing
+    {
+      dependent->failed = true;
+      dependent->error = ENOENT;
+    }
+    if(!--dependent->waiting)
+    {
+      if(dependent->failed)
+        finish(dependent);
+      else
+        s_ready.push_back(dependent);
+    }
+  }
+  s_wakeup.notify_all();
+}
+
+void Modules::worker(posix::fd_t directory) noexcept
+{
+  std::unique_lock<std::mutex> guard(s_lock);
+  for(;;)
+  {
+    s_wakeup.wait(guard, []() noexcept { return !s_ready.empty() || !s_remaining || !s_active; });
+    if(s_ready.empty()) // done or only dependency cycles remain
+      break;
+
+    module_t* module = s_ready.front();
+    s_ready.pop_front();
+    ++s_active;
+    guard.unlock();
+
+    uint64_t start = Tracer::now();
+    module->error = load_one(directory, module);
+    module->elapsed = Tracer::now() - start;
+    Tracer::complete("module", module->name, start, module->error ? "failed" : "loaded", module->error);
+
+    guard.lock();
+    module->failed = module->error != 0;
+    --s_active;
+    finish(module);
+  }
+}
+
+int Modules::load(const char* directory) noexcept
+{
+  char filename[PATH_MAX];
+  char list_path[PATH_MAX];
+  char record[PATH_MAX];
+  mapping_t list;
+  mapping_t deps;
+
+  s_modules.clear();
+  s_index.clear();
+  s_dependencies.clear();
+  s_ready.clear();
+
+  // both files are stamped before being read so an update made meanwhile isn't cached
+  posix::snprintf(list_path, sizeof(list_path), "%s/modules.list", directory);
+  posix::snprintf(filename, sizeof(filename), "%s/modules.dep", directory);
+  posix::snprintf(record, sizeof(record), "modules:%s", directory);
+  uint64_t stamp = BootCache::stamp(filename, BootCache::stamp(list_path));
+
+  if(!restore(record, stamp)) // resolve the modules from the files
+  {
+    if(!map(list_path, list))
+      return posix::error_response;
+    map(filename, deps); // optional
+
+    // index modules.dep lines by module path
+    slice_t line;
+    for(const char* pos = deps.data; next_line(pos, deps.data + deps.size, line);)
+    {
+      const char* word = line.data;
+      slice_t path = next_word(word, line.data + line.length);
+      if(path.length)
+        s_dependencies.emplace(hash(path.data, path.length), line);
+    }
+
+    // each line of modules.list is: <path> [arguments]
+    for(const char* pos = list.data; next_line(pos, list.data + list.size, line);)
+    {
+      const char* word = line.data;
+      const char* end = line.data + line.length;
+      slice_t path = next_word(word, end);
+      while(word < end && posix::isspace(*word))
+        ++word;
+      if(path.length)
+        add(path, slice_t{ word, posix::size_t(end - word) }, 0);
+    }
+    store(record, stamp);
+  }
+
+  int failures = 0;
+  posix::fd_t dirfd = posix::open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if(dirfd == posix::error_response)
+    failures = int(s_modules.size());
+  else
+  {
+    {
+      std::lock_guard<std::mutex> guard(s_lock);
+      s_remaining = s_modules.size();
+      s_active = 0;
+      for(module_t& module : s_modules)
+        if(!module.waiting)
+          s_ready.push_back(&module);
+    }
+
+    std::vector<std::thread> workers;
+    uint16_t count = uint16_t(std::min(posix::size_t(MODULE_WORKERS), s_modules.size()));
+    count = std::min(count, uint16_t(std::max(1U, std::thread::hardware_concurrency())));
+    while(workers.size() < count)
+      workers.emplace_back(worker, dirfd);
+    for(std::thread& thread : workers)
+      thread.join();
+    posix::close(dirfd);
+
+    for(module_t& module : s_modules)
+    {
+      if(!module.failed && !module.waiting)
+        continue;
+      char elapsed[24];
+      posix::snprintf(elapsed, sizeof(elapsed), "%u ms", unsigned(module.elapsed / 1000000));
+      Display::bailoutLine("Unable to load module %s: %s (%s)", module.name,
+                           module.waiting ? "dependency cycle" : posix::strerror(module.error), elapsed);
+      ++failures;
+    }
+  }
+
+  for(module_t& module : s_modules) // slices point into the mapped files (or the record)
+  {
+    module.path = slice_t{ nullptr, 0 };
+    module.arguments = slice_t{ nullptr, 0 };
+  }
+  s_index.clear();
+  s_dependencies.clear();
+  s_record = std::vector<char>();
+  unmap(list);
+  unmap(deps);
+  return failures;
+}
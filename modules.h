@@ -0,0 +1,14 @@
+#ifndef MODULES_H
+#define MODULES_H
+
+// PUT
+#include <put/cxxutils/posix_helpers.h>
+
+namespace Modules
+{
+  // loads every module named in list (and what modules.dep says they need) concurrently
+  // returns the number of modules that failed to load or posix::error_response if list is unreadable
+  extern int load(const char* directory) noexcept;
+}
+
+#endif // MODULES_H
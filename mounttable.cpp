@@ -0,0 +1,274 @@
+#include "mounttable.h"
+
+// STL
+#include <unordered_map>
+#include <vector>
+#include <list>
+#include <string>
+#include <mutex>
+#include <cstring>
+
+// POSIX
+#include <fcntl.h>
+
+// PUT
+#include <put/specialized/eventbackend.h>
+#include <put/cxxutils/hashing.h>
+
+#ifndef MOUNTINFO_PATH
+#define MOUNTINFO_PATH  "/proc/self/mountinfo"
+#endif
+
+namespace MountTable
+{
+  struct entry_t
+  {
+    uint32_t checksum;    // hash of the mountinfo line (catches remounts)
+    uint32_t order;       // position in the table: later mounts are stacked on top of earlier ones
+    uint32_t generation;  // last reload the mount was seen in
+    uint16_t source;      // offsets into fields
+    uint16_t fstype;
+    uint16_t options;
+    std::string fields;   // NUL separated: path, source, fstype and options
+
+    const char* getPath   (void) const noexcept { return fields.data(); }
+    const char* getSource (void) const noexcept { return fields.data() + source; }
+    const char* getType   (void) const noexcept { return fields.data() + fstype; }
+    const char* getOptions(void) const noexcept { return fields.data() + options; }
+  };
+
+  using field_t = const char* (entry_t::*)(void) const noexcept;
+  using index_t = std::unordered_multimap<uint32_t, uint32_t>; // hash of field -> mount id
+
+  static std::mutex s_lock;
+  static posix::fd_t s_fd = posix::error_response;
+  static bool s_watched = false;
+  static std::unordered_map<uint32_t, entry_t> s_mounts; // by mount id
+  static index_t s_by_source;
+  static index_t s_by_type;
+  static index_t s_by_path;
+  static std::vector<char> s_buffer; // reused by every reload
+  static uint32_t s_generation = 0;
+  static std::list<Object::fslot_t<void>> s_subscribers;
+
+  bool open(void) noexcept;
+  bool reload(void) noexcept;
+  void changed(posix::fd_t fd, native_flags_t) noexcept;
+  void learn(uint32_t id, const char* pos, const char* end, uint32_t checksum, uint32_t order) noexcept;
+  void forget(uint32_t id, const entry_t& entry) noexcept;
+  bool find(const index_t& index, field_t field, const char* value, fsentry_t* entry) noexcept;
+}
+
+bool MountTable::findBySource(const char* source, fsentry_t* entry) noexcept
+  { return find(s_by_source, &entry_t::getSource, source, entry); }
+
+bool MountTable::findByType(const char* fstype, fsentry_t* entry) noexcept
+  { return find(s_by_type, &entry_t::getType, fstype, entry); }
+
+bool MountTable::findByPath(const char* path, fsentry_t* entry) noexcept
+  { return find(s_by_path, &entry_t::getPath, path, entry); }
+
+void MountTable::subscribe(Object::fslot_t<void> func) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  s_subscribers.emplace_back(func);
+}
+
+bool MountTable::find(const index_t& index, field_t field, const char* value, fsentry_t* entry) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  if(!s_watched && // no change events to rely on
+     ((s_fd == posix::error_response && !open()) || // procfs may not be mounted yet
+      !reload()))
+    return false;
+
+  const entry_t* match = nullptr;
+  auto range = index.equal_range(hash(value, posix::strlen(value)));
+  for(auto pos = range.first; pos != range.second; ++pos)
+  {
+    auto mount = s_mounts.find(pos->second);
+    if(mount != s_mounts.end() &&
+       !posix::strcmp((mount->second.*field)(), value) && // not a hash collision
+       (match == nullptr || mount->second.order > match->order))
+      match = &mount->second;
+  }
+
+  if(match != nullptr && entry != nullptr)
+  {
+    posix::strncpy(entry->device     , match->getSource() , sizeof(fsentry_t::device) - 1);
+    posix::strncpy(entry->path       , match->getPath()   , sizeof(fsentry_t::path) - 1);
+    posix::strncpy(entry->filesystems, match->getType()   , sizeof(fsentry_t::filesystems) - 1);
+    posix::strncpy(entry->options    , match->getOptions(), sizeof(fsentry_t::options) - 1);
+  }
+  return match != nullptr;
+}
+
+bool MountTable::watch(void) noexcept
+{
+  std::lock_guard<std::mutex> guard(s_lock);
+  if(s_watched)
+    return true;
+  if(s_fd == posix::error_response && !open())
+    return false;
+
+  // mountinfo never blocks on reads; changes are signaled as POLLPRI | POLLERR instead
+  s_watched = reload() && EventBackend::add(s_fd, EventFlags::Error, changed);
+  return s_watched;
+}
+
+// NOTE: s_lock must be held
+bool MountTable::open(void) noexcept
+{
+  s_fd = posix::open(MOUNTINFO_PATH, O_RDONLY | O_CLOEXEC);
+  return s_fd != posix::error_response;
+}
+
+void MountTable::changed(posix::fd_t, native_flags_t) noexcept
+{
+  std::list<Object::fslot_t<void>> subscribers;
+  {
+    std::lock_guard<std::mutex> guard(s_lock);
+    reload();
+    subscribers = s_subscribers;
+  }
+  for(auto& func : subscribers) // without the lock so they may query the table
+    func();
+}
+
+// rereads the table (the kernel doesn't offer deltas) but only reindexes mounts that were added, removed or changed
+// NOTE: s_lock must be held
+bool MountTable::reload(void) noexcept
+{
+  if(s_buffer.empty())
+    s_buffer.resize(0x4000); // 16KB
+
+  if(::lseek(s_fd, 0, SEEK_SET) == posix::error_response)
+    return false;
+
+  posix::size_t length = 0;
+  posix::ssize_t count = 0;
+  while((count = posix::read(s_fd, s_buffer.data() + length, s_buffer.size() - length)) > 0)
+    if((length += posix::size_t(count)) == s_buffer.size())
+      s_buffer.resize(s_buffer.size() * 2);
+  if(count == posix::error_response)
+    return false;
+
+  ++s_generation;
+  uint32_t order = 0;
+  const char* end = s_buffer.data() + length;
+  for(const char* pos = s_buffer.data(); pos < end; ++order)
+  {
+    const char* eol = static_cast<const char*>(std::memchr(pos, '\n', posix::size_t(end - pos)));
+    if(eol == nullptr)
+      eol = end;
+
+    uint32_t checksum = hash(pos, posix::size_t(eol - pos));
+    uint32_t id = uint32_t(posix::strtoul(pos, nullptr, 10));
+    auto mount = s_mounts.find(id);
+    if(mount != s_mounts.end() && mount->second.checksum == checksum) // unchanged
+    {
+      mount->second.order = order;
+      mount->second.generation = s_generation;
+    }
+    else
+    {
+      if(mount != s_mounts.end()) // remounted
+        forget(id, mount->second);
+      learn(id, pos, eol, checksum, order);
+    }
+    pos = eol + 1;
+  }
+
+  for(auto pos = s_mounts.begin(); pos != s_mounts.end();)
+  {
+    if(pos->second.generation != s_generation) // unmounted
+    {
+      forget(pos->first, pos->second);
+      pos = s_mounts.erase(pos);
+    }
+    else
+      ++pos;
+  }
+  return true;
+}
+
+// parses "id parent major:minor root path options [optional...] - fstype source superoptions"
+void MountTable::learn(uint32_t id, const char* pos, const char* end, uint32_t checksum, uint32_t order) noexcept
+{
+  const char* fields[9] = { nullptr };
+  posix::size_t lengths[9] = { 0 };
+  posix::size_t count = 0;
+  bool separated = false;
+  while(pos < end && count < 9)
+  {
+    const char* start = pos;
+    while(pos < end && *pos != ' ')
+      ++pos;
+    posix::size_t length = posix::size_t(pos - start);
+    if(count == 6 && !separated) // optional fields end with "-"
+      separated = length == 1 && *start == '-';
+    else
+    {
+      fields[count] = start;
+      lengths[count] = length;
+      ++count;
+    }
+    ++pos; // skip space
+  }
+  if(count < 9) // malformed
+    return;
+
+  entry_t& entry = s_mounts[id];
+  entry.checksum = checksum;
+  entry.order = order;
+  entry.generation = s_generation;
+  entry.fields.clear();
+
+  auto append = [&entry](const char* value, posix::size_t length) noexcept
+  {
+    for(posix::size_t i = 0; i < length; ++i)
+    {
+      if(value[i] == '\\' && i + 3 < length && // octal escapes ("\040" for space, etc)
+         value[i + 1] >= '0' && value[i + 1] <= '3' &&
+         value[i + 2] >= '0' && value[i + 2] <= '7' &&
+         value[i + 3] >= '0' && value[i + 3] <= '7')
+      {
+        entry.fields.push_back(char(((value[i + 1] - '0') << 6) | ((value[i + 2] - '0') << 3) | (value[i + 3] - '0')));
+        i += 3;
+      }
+      else
+        entry.fields.push_back(value[i]);
+    }
+    entry.fields.push_back('\0');
+  };
+
+  append(fields[4], lengths[4]); // path
+  entry.source = uint16_t(entry.fields.size());
+  append(fields[7], lengths[7]); // source
+  entry.fstype = uint16_t(entry.fields.size());
+  append(fields[6], lengths[6]); // fstype
+  entry.options = uint16_t(entry.fields.size());
+  append(fields[5], lengths[5]); // mount options
+
+  s_by_path  .emplace(hash(entry.getPath()  , posix::strlen(entry.getPath()))  , id);
+  s_by_source.emplace(hash(entry.getSource(), posix::strlen(entry.getSource())), id);
+  s_by_type  .emplace(hash(entry.getType()  , posix::strlen(entry.getType()))  , id);
+}
+
+// removes the mount from every index (the caller erases or replaces the entry itself)
+void MountTable::forget(uint32_t id, const entry_t& entry) noexcept
+{
+  auto unindex = [id](index_t& index, const char* value) noexcept
+  {
+    auto range = index.equal_range(hash(value, posix::strlen(value)));
+    for(auto pos = range.first; pos != range.second; ++pos)
+      if(pos->second == id)
+      {
+        index.erase(pos);
+        return;
+      }
+  };
+  unindex(s_by_path  , entry.getPath());
+  unindex(s_by_source, entry.getSource());
+  unindex(s_by_type  , entry.getType());
+}
@@ -0,0 +1,25 @@
+#ifndef MOUNTTABLE_H
+#define MOUNTTABLE_H
+
+// PUT
+#include <put/object.h>
+#include <put/specialized/fstable.h>
+
+namespace MountTable
+{
+  // registers for change events so the table is only reread when it changes
+  // NOTE: call from the event loop thread (or before any other thread starts); fails until procfs is mounted
+  extern bool watch(void) noexcept;
+
+  // lookups of the current mount table (the topmost mount wins when several match)
+  // entry (optional) receives a copy of the match
+  // NOTE: until watch() succeeds every lookup rereads the table
+  extern bool findBySource(const char* source, fsentry_t* entry = nullptr) noexcept;
+  extern bool findByType  (const char* fstype, fsentry_t* entry = nullptr) noexcept;
+  extern bool findByPath  (const char* path  , fsentry_t* entry = nullptr) noexcept;
+
+  // invokes func on the event loop thread whenever the mount table changes
+  extern void subscribe(Object::fslot_t<void> func) noexcept;
+}
+
+#endif // MOUNTTABLE_H
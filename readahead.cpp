@@ -0,0 +1,469 @@
+#include "readahead.h"
+
+#if defined(__linux__)
+
+// STL
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <unordered_set>
+#include <thread>
+#include <cstring>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// Linux
+#include <sys/fanotify.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+
+// PUT
+#include <put/cxxutils/hashing.h>
+#include <put/specialized/eventbackend.h>
+
+// Project
+#include "timer.h"
+#include "tracer.h"
+#include "bootcache.h"
+
+#ifndef READAHEAD_MAX_FILES
+#define READAHEAD_MAX_FILES       2048
+#endif
+
+#ifndef READAHEAD_RECORD_TAIL
+#define READAHEAD_RECORD_TAIL     5000 // milliseconds still recorded after boot settles (lazy loads)
+#endif
+
+#ifndef READAHEAD_THREADS
+#define READAHEAD_THREADS         4 // devices replayed at once
+#endif
+
+#ifndef READAHEAD_MERGE_GAP
+#define READAHEAD_MERGE_GAP       8 // uncached pages bridged to make fewer, larger reads
+#endif
+
+#ifndef READAHEAD_SAVE_INTERVAL
+#define READAHEAD_SAVE_INTERVAL   10000 // milliseconds
+#endif
+
+#ifndef READAHEAD_SAVE_ATTEMPTS
+#define READAHEAD_SAVE_ATTEMPTS   30
+#endif
+
+#define READAHEAD_MAGIC           0x41525853 // "SXRA"
+#define READAHEAD_VERSION         2
+
+namespace Readahead
+{
+  // pack layout: header_t, file_t[file_count], range_t[range_count], NUL terminated paths
+  struct header_t
+  {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t page_shift;
+    uint32_t file_count;
+    uint32_t range_count;
+    uint32_t strings_size;
+    uint32_t reserved;    // keeps file_t aligned
+    uint64_t stamp;       // BootCache::stamp of every Binary file (in order): the pack is recorded again once one changes
+  };
+
+  enum : uint32_t
+  {
+    Binary = 1, // a program or shared library: unlike data (e.g. logs) it only changes when software is updated
+  };
+
+  struct file_t // sorted by device then block so each device is read front to back
+  {
+    uint64_t device;
+    uint64_t block;       // physical offset of the first extent (inode number without FIEMAP)
+    uint32_t path;        // offset into the paths
+    uint32_t first_range;
+    uint32_t range_count;
+    uint32_t flags;
+  };
+
+  struct range_t
+  {
+    uint32_t page;
+    uint32_t count;
+  };
+
+  using pack_t = std::shared_ptr<const std::vector<char>>; // freed by the last replay thread
+
+  static const char* s_path = nullptr;
+  static posix::fd_t s_fanotify = posix::error_response;
+  static std::vector<std::string> s_files; // in the order they were first opened
+  static std::unordered_set<uint32_t> s_seen; // path hashes
+  static Timer::id_t s_stop_timer = posix::error_response;
+  static Timer::id_t s_save_timer = posix::error_response;
+  static uint16_t s_save_attempts = 0;
+  static std::vector<char> s_pack; // recording waiting for a writable filesystem
+
+  bool replay(const char* path) noexcept;
+  uint64_t stamp(const std::vector<char>& pack) noexcept;
+  void replay_devices(pack_t pack, std::vector<std::pair<uint32_t, uint32_t>> devices) noexcept;
+  bool record(void) noexcept;
+  void record_event(posix::fd_t fd, native_flags_t) noexcept;
+  void stop(void) noexcept;
+  uint64_t first_block(posix::fd_t fd, const struct stat& state) noexcept;
+  void save(void) noexcept;
+
+  static inline const header_t& header(const std::vector<char>& pack) noexcept
+    { return *reinterpret_cast<const header_t*>(pack.data()); }
+  static inline const file_t* files(const std::vector<char>& pack) noexcept
+    { return reinterpret_cast<const file_t*>(pack.data() + sizeof(header_t)); }
+  static inline const range_t* ranges(const std::vector<char>& pack) noexcept
+    { return reinterpret_cast<const range_t*>(files(pack) + header(pack).file_count); }
+  static inline const char* paths(const std::vector<char>& pack) noexcept
+    { return reinterpret_cast<const char*>(ranges(pack) + header(pack).range_count); }
+}
+
+bool Readahead::start(const char* path) noexcept
+{
+  s_path = path;
+  if(replay(path))
+    return true;
+  if(errno != ENOENT && errno != EINVAL && errno != ESTALE) // a pack that is missing, unusable or outdated is recorded again
+    return false;
+  return record();
+}
+
+void Readahead::finish(void) noexcept
+{
+  if(s_fanotify != posix::error_response &&
+     s_stop_timer == posix::error_response)
+    s_stop_timer = Timer::start(READAHEAD_RECORD_TAIL,
+                                []() noexcept
+                                {
+                                  s_stop_timer = posix::error_response; // timer is spent
+                                  stop();
+                                });
+}
+
+bool Readahead::replay(const char* path) noexcept
+{
+  posix::fd_t fd = posix::open(path, O_RDONLY | O_CLOEXEC);
+  if(fd == posix::error_response)
+    return false;
+
+  struct stat state;
+  if(::fstat(fd, &state) == posix::error_response)
+  {
+    posix::close(fd);
+    return false;
+  }
+
+  std::shared_ptr<std::vector<char>> pack = std::make_shared<std::vector<char>>(posix::size_t(state.st_size));
+  posix::size_t length = 0;
+  posix::ssize_t count = 0;
+  while(length < pack->size() &&
+        (count = posix::read(fd, pack->data() + length, pack->size() - length)) > 0)
+    length += posix::size_t(count);
+  posix::close(fd);
+  if(count == posix::error_response)
+    return false;
+
+  // validate once so the replay threads can trust every offset
+  if(length != pack->size() ||
+     length < sizeof(header_t))
+  {
+    errno = EINVAL;
+    return false;
+  }
+
+  const header_t& head = header(*pack);
+  if(head.magic != READAHEAD_MAGIC ||
+     head.version != READAHEAD_VERSION ||
+     head.page_shift < 9 || head.page_shift > 30 ||
+     !head.strings_size ||
+     sizeof(header_t) + uint64_t(head.file_count) * sizeof(file_t) + uint64_t(head.range_count) * sizeof(range_t) + head.strings_size != length ||
+     paths(*pack)[head.strings_size - 1] != '\0')
+  {
+    errno = EINVAL;
+    return false;
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> devices; // [first, last) file of each device
+  for(uint32_t index = 0; index < head.file_count; ++index)
+  {
+    const file_t& file = files(*pack)[index];
+    if(file.path >= head.strings_size ||
+       file.first_range + uint64_t(file.range_count) > head.range_count)
+    {
+      errno = EINVAL;
+      return false;
+    }
+    if(devices.empty() || files(*pack)[devices.back().first].device != file.device)
+      devices.emplace_back(index, index);
+    devices.back().second = index + 1;
+  }
+
+  if(stamp(*pack) != head.stamp) // software was updated since the recording
+  {
+    errno = ESTALE;
+    return false;
+  }
+
+  // one thread per device (up to a limit) so no disk waits on another
+  for(posix::size_t thread = 0; thread < devices.size() && thread < READAHEAD_THREADS; ++thread)
+  {
+    std::vector<std::pair<uint32_t, uint32_t>> share;
+    for(posix::size_t device = thread; device < devices.size(); device += READAHEAD_THREADS)
+      share.push_back(devices[device]);
+    std::thread(replay_devices, pack, std::move(share)).detach();
+  }
+  return true;
+}
+
+uint64_t Readahead::stamp(const std::vector<char>& pack) noexcept
+{
+  uint64_t value = 0;
+  for(uint32_t index = 0; index < header(pack).file_count; ++index)
+    if(files(pack)[index].flags & Binary)
+      value = BootCache::stamp(paths(pack) + files(pack)[index].path, value);
+  return value;
+}
+
+void Readahead::replay_devices(pack_t pack, std::vector<std::pair<uint32_t, uint32_t>> devices) noexcept
+{
+  uint64_t start = Tracer::now();
+  uint64_t total = 0;
+  const uint16_t shift = header(*pack).page_shift;
+  for(const auto& device : devices)
+    for(uint32_t index = device.first; index < device.second; ++index)
+    {
+      const file_t& file = files(*pack)[index];
+      const char* path = paths(*pack) + file.path;
+      posix::fd_t fd = posix::open(path, O_RDONLY | O_CLOEXEC | O_NOATIME);
+      if(fd == posix::error_response && errno == EPERM) // O_NOATIME is for owners only
+        fd = posix::open(path, O_RDONLY | O_CLOEXEC);
+      if(fd == posix::error_response) // removed since the recording: skip it
+        continue;
+
+      for(const range_t* range = ranges(*pack) + file.first_range; range != ranges(*pack) + file.first_range + file.range_count; ++range)
+      {
+        off_t offset = off_t(range->page) << shift;
+        posix::size_t length = posix::size_t(range->count) << shift;
+        if(::readahead(fd, offset, length) == posix::error_response) // e.g. not supported by this filesystem
+          ::posix_fadvise(fd, offset, off_t(length), POSIX_FADV_WILLNEED);
+        total += length;
+      }
+      posix::close(fd);
+    }
+  Tracer::complete("readahead", "Replay", start, nullptr, int64_t(total));
+}
+
+bool Readahead::record(void) noexcept
+{
+  s_fanotify = ::fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE | O_CLOEXEC | O_NOATIME);
+  if(s_fanotify == posix::error_response)
+    return false;
+
+  if(::fanotify_mark(s_fanotify, FAN_MARK_ADD | FAN_MARK_MOUNT, FAN_OPEN, AT_FDCWD, "/") == posix::error_response ||
+     !EventBackend::add(s_fanotify, EventFlags::Readable, record_event))
+  {
+    int error = errno;
+    posix::close(s_fanotify);
+    s_fanotify = posix::error_response;
+    errno = error;
+    return false;
+  }
+  return true;
+}
+
+void Readahead::record_event(posix::fd_t fd, native_flags_t) noexcept
+{
+  alignas(struct fanotify_event_metadata) char buffer[4096];
+  char link[32];
+  char path[PATH_MAX];
+  posix::ssize_t count;
+  while((count = posix::read(fd, buffer, sizeof(buffer))) > 0)
+    for(const struct fanotify_event_metadata* event = reinterpret_cast<const struct fanotify_event_metadata*>(buffer);
+        FAN_EVENT_OK(event, count);
+        event = FAN_EVENT_NEXT(event, count))
+    {
+      if(event->fd < 0) // queue overflow: those files are missed
+        continue;
+
+      posix::snprintf(link, sizeof(link), "/proc/self/fd/%d", event->fd);
+      posix::ssize_t length = ::readlink(link, path, sizeof(path) - 1);
+      posix::close(event->fd);
+      if(length <= 0 || *path != '/' || s_files.size() >= READAHEAD_MAX_FILES)
+        continue;
+
+      path[length] = '\0';
+      if(s_seen.insert(hash(path, posix::size_t(length))).second) // a hash collision only loses a file
+        s_files.emplace_back(path, posix::size_t(length));
+    }
+}
+
+// where the file starts on disk so files can be read in seek order
+uint64_t Readahead::first_block(posix::fd_t fd, const struct stat& state) noexcept
+{
+  alignas(struct fiemap) char buffer[sizeof(struct fiemap) + sizeof(struct fiemap_extent)] = {};
+  struct fiemap* map = reinterpret_cast<struct fiemap*>(buffer);
+  map->fm_length = FIEMAP_MAX_OFFSET;
+  map->fm_extent_count = 1;
+  if(::ioctl(fd, FS_IOC_FIEMAP, map) == posix::success_response && map->fm_mapped_extents)
+    return map->fm_extents[0].fe_physical;
+  return uint64_t(state.st_ino); // inode order is the next best guess
+}
+
+// samples which pages of every opened file are cached now and packs them in disk order
+void Readahead::stop(void) noexcept
+{
+  record_event(s_fanotify, 0); // drain
+  EventBackend::remove(s_fanotify, EventFlags::Readable);
+  posix::close(s_fanotify);
+  s_fanotify = posix::error_response;
+
+  struct sample_t
+  {
+    file_t file;
+    const std::string* path;
+    std::vector<range_t> ranges;
+  };
+
+  const posix::size_t page_size = posix::size_t(::sysconf(_SC_PAGESIZE));
+  std::vector<sample_t> samples;
+  std::vector<unsigned char> resident;
+  for(const std::string& path : s_files)
+  {
+    posix::fd_t fd = posix::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if(fd == posix::error_response)
+      continue;
+
+    struct stat state;
+    void* mapping = MAP_FAILED;
+    if(::fstat(fd, &state) == posix::success_response &&
+       S_ISREG(state.st_mode) &&
+       state.st_size > 0)
+      mapping = ::mmap(nullptr, posix::size_t(state.st_size), PROT_READ, MAP_SHARED, fd, 0);
+
+    if(mapping != MAP_FAILED)
+    {
+      resident.resize((posix::size_t(state.st_size) + page_size - 1) / page_size);
+      if(::mincore(mapping, posix::size_t(state.st_size), resident.data()) == posix::success_response)
+      {
+        bool binary = (state.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) || std::strstr(path.c_str(), ".so") != nullptr;
+        sample_t sample = { { uint64_t(state.st_dev), first_block(fd, state), 0, 0, 0, binary ? uint32_t(Binary) : 0U }, &path, {} };
+        for(uint32_t page = 0; page < resident.size(); ++page)
+        {
+          if(!(resident[page] & 1))
+            continue;
+          if(!sample.ranges.empty() &&
+             page - (sample.ranges.back().page + sample.ranges.back().count) <= READAHEAD_MERGE_GAP)
+            sample.ranges.back().count = page - sample.ranges.back().page + 1;
+          else
+            sample.ranges.push_back(range_t{ page, 1 });
+        }
+        if(!sample.ranges.empty())
+          samples.push_back(std::move(sample));
+      }
+      ::munmap(mapping, posix::size_t(state.st_size));
+    }
+    posix::close(fd);
+  }
+
+  std::sort(samples.begin(), samples.end(),
+            [](const sample_t& a, const sample_t& b) noexcept
+            { return a.file.device != b.file.device ? a.file.device < b.file.device : a.file.block < b.file.block; });
+
+  header_t head = { READAHEAD_MAGIC, READAHEAD_VERSION, uint16_t(__builtin_ctzl(page_size)), uint32_t(samples.size()), 0, 1, 0, 0 };
+  for(sample_t& sample : samples)
+  {
+    sample.file.path = head.strings_size;
+    sample.file.first_range = head.range_count;
+    sample.file.range_count = uint32_t(sample.ranges.size());
+    head.range_count += sample.file.range_count;
+    head.strings_size += uint32_t(sample.path->size() + 1);
+  }
+
+  s_pack.clear();
+  s_pack.reserve(sizeof(header_t) + samples.size() * sizeof(file_t) + head.range_count * sizeof(range_t) + head.strings_size);
+  auto append = [](const void* data, posix::size_t length) noexcept
+                { s_pack.insert(s_pack.end(), static_cast<const char*>(data), static_cast<const char*>(data) + length); };
+  append(&head, sizeof(head));
+  for(const sample_t& sample : samples)
+    append(&sample.file, sizeof(file_t));
+  for(const sample_t& sample : samples)
+    append(sample.ranges.data(), sample.ranges.size() * sizeof(range_t));
+  s_pack.push_back('\0'); // offset 0 is unused
+  for(const sample_t& sample : samples)
+    append(sample.path->c_str(), sample.path->size() + 1);
+  reinterpret_cast<header_t*>(s_pack.data())->stamp = stamp(s_pack);
+
+  s_files = std::vector<std::string>();
+  s_seen = std::unordered_set<uint32_t>();
+  save();
+}
+
+// writes the pack beside its final name first so a partial pack is never replayed
+void Readahead::save(void) noexcept
+{
+  char temporary[PATH_MAX];
+  char directory[PATH_MAX];
+  posix::snprintf(temporary, sizeof(temporary), "%s.new", s_path);
+  posix::strncpy(directory, s_path, sizeof(directory) - 1);
+  directory[sizeof(directory) - 1] = '\0';
+  char* slash = std::strrchr(directory, '/');
+  if(slash != nullptr && slash != directory)
+  {
+    *slash = '\0';
+    ::mkdir(directory, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH); // create directory (if it doesn't exist)
+  }
+
+  posix::fd_t fd = posix::open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  bool saved = fd != posix::error_response &&
+               posix::write(fd, s_pack.data(), s_pack.size()) == posix::ssize_t(s_pack.size());
+  if(fd != posix::error_response)
+    posix::close(fd);
+  saved = saved && ::rename(temporary, s_path) == posix::success_response;
+  int error = errno;
+  if(!saved && fd != posix::error_response)
+    ::unlink(temporary);
+
+  if(saved)
+  {
+    Timer::stop(s_save_timer);
+    s_pack = std::vector<char>();
+    return;
+  }
+
+  if(error != EROFS && error != ENOENT && error != EACCES) // not a problem that mounting will solve
+  {
+    Timer::stop(s_save_timer);
+    s_pack = std::vector<char>();
+    terminal::write("%s Unable to save readahead pack to %s: %s\n", terminal::warning, s_path, posix::strerror(error));
+    return;
+  }
+
+  if(s_save_timer == posix::error_response && s_save_attempts < READAHEAD_SAVE_ATTEMPTS)
+    s_save_timer = Timer::start(READAHEAD_SAVE_INTERVAL,
+                                []() noexcept
+                                {
+                                  if(++s_save_attempts >= READAHEAD_SAVE_ATTEMPTS)
+                                    Timer::stop(s_save_timer); // give up
+                                  save();
+                                }, true);
+  else if(s_save_timer == posix::error_response) // gave up
+    s_pack = std::vector<char>();
+}
+
+#else
+
+bool Readahead::start(const char*) noexcept
+{
+  errno = ENOSYS;
+  return false;
+}
+
+void Readahead::finish(void) noexcept { }
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+// PUT
+#include <put/cxxutils/posix_helpers.h>
+
+namespace Readahead
+{
+  // replays the pack at path in the background if it exists, otherwise records the files opened on the root filesystem
+  // NOTE: path must outlive the recording (string literal or static storage)
+  extern bool start(const char* path) noexcept;
+
+  // ends a recording shortly after boot settles and saves which pages of those files are cached (no-op otherwise)
+  extern void finish(void) noexcept;
+}
+
+#endif // READAHEAD_H
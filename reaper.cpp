@@ -0,0 +1,128 @@
+#include "reaper.h"
+
+// POSIX
+#include <signal.h>
+#include <sys/wait.h>
+
+#if defined(__linux__)
+// Linux
+#include <sys/signalfd.h>
+#endif
+
+// PUT
+#include <put/cxxutils/vterm.h>
+#include <put/specialized/eventbackend.h>
+
+// Project
+#include "supervisor.h"
+#include "timer.h"
+#include "tracer.h"
+
+#ifndef REAPER_BATCH
+#define REAPER_BATCH  256 // children collected before other events get a turn
+#endif
+
+namespace Reaper
+{
+  static stats_t s_stats = {};
+  static posix::fd_t s_signals = posix::error_response;
+
+  void collect(posix::fd_t fd, native_flags_t) noexcept;
+}
+
+const Reaper::stats_t& Reaper::stats(void) noexcept
+  { return s_stats; }
+
+#if defined(__linux__)
+
+bool Reaper::init(void) noexcept
+{
+  sigset_t mask;
+  ::sigemptyset(&mask);
+  ::sigaddset(&mask, SIGCHLD);
+  if(::pthread_sigmask(SIG_BLOCK, &mask, nullptr) != posix::success_response)
+    return false;
+
+  s_signals = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if(s_signals == posix::error_response)
+    return false;
+
+  if(!EventBackend::add(s_signals, EventFlags::Readable, collect))
+  {
+    posix::close(s_signals);
+    s_signals = posix::error_response;
+    return false;
+  }
+
+  collect(s_signals, 0); // orphans that exited before now
+  return true;
+}
+
+// one SIGCHLD may stand for any number of exits so every exited child is collected per wakeup
+void Reaper::collect(posix::fd_t fd, native_flags_t) noexcept
+{
+  struct signalfd_siginfo info[8];
+  while(posix::read(fd, info, sizeof(info)) > 0) // consume first: exits from now on raise it again
+    continue;
+
+  uint64_t start = Timer::monotonic();
+  uint64_t count = 0;
+  siginfo_t child;
+  for(; count < REAPER_BATCH; ++count)
+  {
+    child = {};
+    if(::waitid(P_ALL, 0, &child, WEXITED | WNOHANG) == posix::error_response || // ECHILD: none left
+       !child.si_pid) // none exited
+      break;
+
+    posix::error_t status = 0;
+    int signal = 0;
+    if(child.si_code == CLD_EXITED)
+      status = posix::error_t(child.si_status);
+    else
+      signal = child.si_status;
+    if(Supervisor::reaped(child.si_pid, status, signal))
+      ++s_stats.supervised;
+
+    uint64_t latency = Timer::monotonic() - start;
+    s_stats.total_latency += latency;
+    if(latency > s_stats.max_latency)
+      s_stats.max_latency = latency;
+  }
+
+  if(count == REAPER_BATCH) // more may be waiting: come back after the other events
+    ::kill(::getpid(), SIGCHLD);
+
+  ++s_stats.wakeups;
+  s_stats.reaped += count;
+  if(count > s_stats.largest_batch)
+    s_stats.largest_batch = count;
+  if(count)
+    Tracer::complete("reap", "children", start, nullptr, int64_t(count));
+}
+
+#else
+
+bool Reaper::init(void) noexcept
+{
+  errno = ENOSYS;
+  return false;
+}
+
+void Reaper::collect(posix::fd_t, native_flags_t) noexcept { }
+
+#endif
+
+void Reaper::report(void) noexcept
+{
+  uint64_t average = s_stats.reaped ? s_stats.total_latency / s_stats.reaped : 0;
+  terminal::write("Reaper: %llu children (%llu supervised) in %llu wakeups, largest batch %llu, latency %llu us average, %llu us max\n",
+                  (unsigned long long)s_stats.reaped,
+                  (unsigned long long)s_stats.supervised,
+                  (unsigned long long)s_stats.wakeups,
+                  (unsigned long long)s_stats.largest_batch,
+                  (unsigned long long)(average / 1000),
+                  (unsigned long long)(s_stats.max_latency / 1000));
+  Tracer::instant("reap", "children", nullptr, int64_t(s_stats.reaped));
+  Tracer::instant("reap", "largest batch", nullptr, int64_t(s_stats.largest_batch));
+}
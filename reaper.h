@@ -0,0 +1,34 @@
+#ifndef REAPER_H
+#define REAPER_H
+
+// PUT
+#include <put/cxxutils/posix_helpers.h>
+
+// Reaps every child that exits with SIGCHLD: orphans reparented to init and
+// children that aren't watched through a pidfd.  Exits of supervised
+// processes are passed on to the supervision table.  Children that are
+// waited for directly (Spawn, Fsck) are created without an exit signal so
+// they are never taken from their owners.
+namespace Reaper
+{
+  struct stats_t
+  {
+    uint64_t wakeups;       // SIGCHLD deliveries handled
+    uint64_t reaped;        // children collected
+    uint64_t supervised;    // of which were in the supervision table
+    uint64_t largest_batch; // children collected by one wakeup
+    uint64_t total_latency; // nanoseconds from each wakeup to each child being collected
+    uint64_t max_latency;
+  };
+
+  // blocks SIGCHLD and collects it through a signalfd on the event loop
+  // NOTE: call before any thread is started so that every thread keeps SIGCHLD blocked
+  extern bool init(void) noexcept;
+
+  extern const stats_t& stats(void) noexcept;
+
+  // logs the counters (and adds them to the boot trace)
+  extern void report(void) noexcept;
+}
+
+#endif // REAPER_H
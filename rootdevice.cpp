@@ -0,0 +1,286 @@
+#include "rootdevice.h"
+
+// STL
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+
+// POSIX
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+// Linux
+#include <linux/netlink.h>
+#endif
+
+// PUT
+#include <put/cxxutils/hashing.h>
+
+// Project
+#include "timer.h"
+#include "tracer.h"
+#include "bootcache.h"
+
+#ifndef ROOT_POLL_INTERVAL
+#define ROOT_POLL_INTERVAL  100 // milliseconds
+#endif
+
+#ifndef PARTITIONS_PATH
+#define PARTITIONS_PATH     "/proc/partitions"
+#endif
+
+namespace RootDevice
+{
+  static std::unordered_set<uint32_t> s_known; // hashes of probed partition names
+
+  blockdevice_t* match(const char* spec) noexcept;
+  blockdevice_t* recall(const char* spec) noexcept;
+  void remember(const char* spec, const blockdevice_t* device) noexcept;
+  blockdevice_t* probe(const char* name, const char* spec) noexcept;
+  blockdevice_t* rescan(const char* spec, bool record_only = false) noexcept;
+  blockdevice_t* receive(posix::fd_t fd, const char* spec) noexcept;
+  posix::fd_t subscribe(void) noexcept;
+}
+
+blockdevice_t* RootDevice::match(const char* spec) noexcept
+{
+  const char* value = posix::strchr(spec, '=');
+  if(value == nullptr) // a device path
+  {
+    blockdevice_t* device = blockdevices::lookupByPath(spec); // try to find in detected devices
+    if(device == nullptr) // if none found
+      device = blockdevices::probe(spec); // probe the specified device name
+    return device;
+  }
+
+  char prefix[16] = { 0 };
+  posix::size_t length = std::min(posix::size_t(value - spec), sizeof(prefix) - 1);
+  for(posix::size_t pos = 0; pos < length; ++pos)
+    prefix[pos] = char(::toupper(spec[pos]));
+  ++value; // skip '='
+
+  switch(hash(prefix, length))
+  {
+    case "UUID"_hash: // found "root=UUID=XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX"
+      return blockdevices::lookupByUUID(value);
+    case "LABEL"_hash: // found "root=LABEL=XXXXXXXX"
+      return blockdevices::lookupByLabel(value);
+    default: // found "root=???=XXXXXXXX" but try to find it anyway
+      return blockdevices::lookup(value);
+  }
+}
+
+// the device found for spec last boot if it still has the same number, filesystem and UUID
+// only that device is probed so the other partitions are left alone
+blockdevice_t* RootDevice::recall(const char* spec) noexcept
+{
+  char name[PATH_MAX];
+  std::vector<char> record; // dev_t, path, fstype and uuid
+  posix::snprintf(name, sizeof(name), "root=%s", spec);
+  if(!BootCache::get(name, 0, record) ||
+     record.size() < sizeof(uint64_t) + 3 ||
+     record.back() != '\0' ||
+     std::count(record.begin() + sizeof(uint64_t), record.end(), '\0') != 3)
+    return nullptr;
+
+  uint64_t number;
+  posix::memcpy(&number, record.data(), sizeof(number));
+  const char* path = record.data() + sizeof(uint64_t);
+  const char* fstype = path + posix::strlen(path) + 1;
+  const char* uuid = fstype + posix::strlen(fstype) + 1;
+
+  struct stat state;
+  if(::stat(path, &state) == posix::error_response ||
+     !S_ISBLK(state.st_mode) ||
+     uint64_t(state.st_rdev) != number) // renumbered or not present yet
+    return nullptr;
+
+  uint64_t start = Tracer::now();
+  blockdevice_t* device = blockdevices::probe(path);
+  bool valid = device != nullptr && !posix::strcmp(device->fstype, fstype) && !posix::strcmp(device->uuid, uuid);
+  Tracer::complete("probe", "cached", start, valid ? "valid" : "stale");
+  return valid ? device : nullptr;
+}
+
+void RootDevice::remember(const char* spec, const blockdevice_t* device) noexcept
+{
+  struct stat state;
+  if(::stat(device->path, &state) == posix::error_response || !S_ISBLK(state.st_mode))
+    return;
+
+  char name[PATH_MAX];
+  std::vector<char> record(sizeof(uint64_t));
+  uint64_t number = uint64_t(state.st_rdev);
+  posix::memcpy(record.data(), &number, sizeof(number));
+  for(const char* field : { device->path, device->fstype, device->uuid })
+    record.insert(record.end(), field, field + posix::strlen(field) + 1);
+  posix::snprintf(name, sizeof(name), "root=%s", spec);
+  BootCache::put(name, 0, record.data(), record.size());
+}
+
+// probes a newly appeared partition (name is relative to /dev)
+blockdevice_t* RootDevice::probe(const char* name, const char* spec) noexcept
+{
+  if(!s_known.insert(hash(name, posix::strlen(name))).second) // already probed
+    return nullptr;
+
+  char path[PATH_MAX];
+  posix::snprintf(path, sizeof(path), "/dev/%s", name);
+  uint64_t start = Tracer::now();
+  blockdevice_t* device = blockdevices::probe(path);
+  Tracer::complete("probe", "partition", start, device != nullptr ? "probed" : "failed");
+  return device != nullptr ? match(spec) : nullptr;
+}
+
+// probes partitions that have appeared in /proc/partitions
+blockdevice_t* RootDevice::rescan(const char* spec, bool record_only) noexcept
+{
+  posix::fd_t fd = posix::open(PARTITIONS_PATH, O_RDONLY | O_CLOEXEC);
+  if(fd == posix::error_response)
+    return nullptr;
+
+  char buffer[8192];
+  posix::ssize_t count = posix::read(fd, buffer, sizeof(buffer) - 1);
+  posix::close(fd);
+  if(count <= 0)
+    return nullptr;
+  buffer[count] = '\0';
+
+  // each line is: major minor #blocks name
+  blockdevice_t* device = nullptr;
+  for(char* line = buffer; device == nullptr && line != nullptr && *line;)
+  {
+    char* next = posix::strchr(line, '\n');
+    if(next != nullptr)
+      *next++ = '\0';
+
+    char* name = line;
+    for(int field = 0; field < 3 && *name; ++field) // skip numeric fields
+    {
+      while(*name && posix::isspace(*name))
+        ++name;
+      while(*name && !posix::isspace(*name))
+        ++name;
+    }
+    while(*name && posix::isspace(*name))
+      ++name;
+
+    if(*name && line[0] != 'm') // skip header line ("major minor  #blocks  name")
+    {
+      if(record_only)
+        s_known.insert(hash(name, posix::strlen(name)));
+      else
+        device = probe(name, spec);
+    }
+    line = next;
+  }
+  return device;
+}
+
+posix::fd_t RootDevice::subscribe(void) noexcept
+{
+#if defined(__linux__)
+  posix::fd_t fd = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+  if(fd == posix::error_response)
+    return posix::error_response;
+
+  struct sockaddr_nl address = {};
+  address.nl_family = AF_NETLINK;
+  address.nl_groups = 1; // kernel uevents
+  if(::bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == posix::error_response)
+  {
+    posix::close(fd);
+    return posix::error_response;
+  }
+  return fd;
+#else
+  return posix::error_response;
+#endif
+}
+
+blockdevice_t* RootDevice::receive(posix::fd_t fd, const char* spec) noexcept
+{
+  char message[4096];
+  posix::ssize_t count;
+  blockdevice_t* device = nullptr;
+  while(device == nullptr &&
+        (count = ::recv(fd, message, sizeof(message) - 1, MSG_DONTWAIT)) != posix::error_response)
+  {
+    message[count] = '\0';
+
+    // message is: "action@devpath\0KEY=value\0KEY=value\0..."
+    bool add = !posix::strncmp(message, "add@", 4);
+    bool block = false;
+    const char* name = nullptr;
+    for(const char* pos = message; pos < message + count; pos += posix::strlen(pos) + 1)
+    {
+      if(!posix::strcmp(pos, "SUBSYSTEM=block"))
+        block = true;
+      else if(!posix::strncmp(pos, "DEVNAME=", 8))
+        name = pos + 8;
+    }
+
+    if(add && block && name != nullptr)
+      device = probe(name, spec);
+  }
+
+  if(device == nullptr && errno == ENOBUFS) // events were lost
+    device = rescan(spec);
+  return device;
+}
+
+blockdevice_t* RootDevice::find(const char* spec, int timeout, Object::fslot_t<void> waiting) noexcept
+{
+  blockdevice_t* device = recall(spec);
+  if(device != nullptr)
+    return device;
+
+  posix::fd_t uevents = timeout ? subscribe() : posix::error_response; // subscribe first so no device is missed
+
+  s_known.clear();
+  uint64_t start = Tracer::now();
+  blockdevices::init(); // probe system partitions (reads /proc/partitions)
+  Tracer::complete("probe", "blockdevices", start);
+
+  device = match(spec);
+  if(device == nullptr && timeout)
+  {
+    if(waiting)
+      waiting();
+
+    rescan(spec, true); // note partitions that init() already probed
+
+    uint64_t deadline = Timer::monotonic() + uint64_t(timeout) * 1000000;
+    while(device == nullptr)
+    {
+      int interval = ROOT_POLL_INTERVAL;
+      if(timeout > 0)
+      {
+        uint64_t now = Timer::monotonic();
+        if(now >= deadline)
+          break;
+        interval = int(std::min(uint64_t(interval), (deadline - now) / 1000000 + 1));
+      }
+
+      if(uevents != posix::error_response)
+      {
+        struct pollfd pfd = { uevents, POLLIN, 0 };
+        if(::poll(&pfd, 1, interval) > 0)
+          device = receive(uevents, spec);
+      }
+      else // polling fallback
+      {
+        ::usleep(useconds_t(interval) * 1000);
+        device = rescan(spec);
+      }
+    }
+  }
+
+  if(uevents != posix::error_response)
+    posix::close(uevents);
+  if(device != nullptr)
+    remember(spec, device);
+  return device;
+}
@@ -0,0 +1,17 @@
+#ifndef ROOTDEVICE_H
+#define ROOTDEVICE_H
+
+// PUT
+#include <put/object.h>
+#include <put/specialized/blockdevices.h>
+
+namespace RootDevice
+{
+  // finds the device described by a root= boot option (path, UUID=, LABEL=)
+  // timeout: milliseconds to wait for it to appear, negative waits forever
+  // waiting: invoked once if the device isn't present yet
+  // the device found last boot is tried first (see BootCache) and only it is probed if still valid
+  extern blockdevice_t* find(const char* spec, int timeout, Object::fslot_t<void> waiting = nullptr) noexcept;
+}
+
+#endif // ROOTDEVICE_H
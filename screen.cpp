@@ -0,0 +1,245 @@
+#include "screen.h"
+
+// STL
+#include <vector>
+#include <array>
+#include <algorithm>
+
+// POSIX
+#include <sys/uio.h>
+
+namespace Screen
+{
+  constexpr posix::size_t pageSize = 4096;
+  constexpr posix::size_t pageCount = 8;
+  constexpr uint16_t maxStyles = 32;
+  constexpr uint16_t gapLimit = 6; // rewrite unchanged cells rather than emit a cursor movement
+
+  struct cell_t
+  {
+    char ch;
+    uint8_t style;
+    bool operator ==(const cell_t& other) const noexcept
+      { return ch == other.ch && style == other.style; }
+    bool operator !=(const cell_t& other) const noexcept
+      { return !operator ==(other); }
+  };
+
+  static uint16_t s_rows = 0;
+  static uint16_t s_columns = 0;
+  static std::vector<cell_t> s_back;  // what we want shown
+  static std::vector<cell_t> s_front; // what the terminal shows
+  static std::vector<bool> s_dirty_rows;
+  static std::array<string_literal, maxStyles> s_styles = { { terminal::style::reset } };
+  static uint8_t s_style_count = 1;
+
+  // output pages are gathered by writev()
+  static std::array<std::array<char, pageSize>, pageCount> s_pages;
+  static std::array<struct iovec, pageCount> s_iov;
+  static posix::size_t s_page = 0;
+  static posix::size_t s_used = 0;
+
+  uint8_t styleIndex(string_literal style) noexcept;
+  bool emit(writer_t writer, const char* data, posix::size_t length) noexcept;
+  void commit(writer_t writer) noexcept;
+  static inline cell_t* cell(std::vector<cell_t>& grid, uint16_t row, uint16_t column) noexcept
+    { return grid.data() + row * s_columns + column; }
+}
+
+bool Screen::resize(uint16_t rows, uint16_t columns) noexcept
+{
+  s_rows = rows;
+  s_columns = columns;
+  s_back.assign(posix::size_t(rows) * columns, cell_t{ ' ', 0 });
+  s_front = s_back;
+  s_dirty_rows.assign(rows, false);
+  return rows && columns;
+}
+
+uint16_t Screen::rows(void) noexcept
+  { return s_rows; }
+
+uint16_t Screen::columns(void) noexcept
+  { return s_columns; }
+
+uint8_t Screen::styleIndex(string_literal style) noexcept
+{
+  if(style == nullptr || !*style)
+    return 0;
+  for(uint8_t pos = 0; pos < s_style_count; ++pos)
+    if(s_styles[pos] == style || !posix::strcmp(s_styles[pos], style))
+      return pos;
+  if(s_style_count == maxStyles) // table is full, fall back to reset
+    return 0;
+  s_styles[s_style_count] = style;
+  return s_style_count++;
+}
+
+uint16_t Screen::put(uint16_t row, uint16_t column, string_literal style, const char* text) noexcept
+  { return put(row, column, style, text, posix::strlen(text)); }
+
+uint16_t Screen::put(uint16_t row, uint16_t column, string_literal style, const char* text, posix::size_t length) noexcept
+{
+  if(row >= s_rows || column >= s_columns)
+    return 0;
+  uint8_t index = styleIndex(style);
+  uint16_t count = uint16_t(std::min(length, posix::size_t(s_columns - column)));
+  cell_t* pos = cell(s_back, row, column);
+  for(uint16_t offset = 0; offset < count; ++offset, ++pos)
+    *pos = cell_t{ posix::isgraph(text[offset]) ? text[offset] : ' ', index };
+  s_dirty_rows[row] = true;
+  return count;
+}
+
+uint16_t Screen::fill(uint16_t row, uint16_t column, string_literal style, char ch, uint16_t count) noexcept
+{
+  if(row >= s_rows || column >= s_columns)
+    return 0;
+  uint8_t index = styleIndex(style);
+  count = std::min(count, uint16_t(s_columns - column));
+  std::fill_n(cell(s_back, row, column), count, cell_t{ ch, index });
+  s_dirty_rows[row] = true;
+  return count;
+}
+
+void Screen::invalidate(void) noexcept
+{
+  for(cell_t& c : s_front)
+    c.ch = '\0'; // never matches a drawn cell
+  std::fill(s_dirty_rows.begin(), s_dirty_rows.end(), true);
+}
+
+bool Screen::emit(writer_t writer, const char* data, posix::size_t length) noexcept
+{
+  while(length)
+  {
+    if(s_used == pageSize) // current page is full
+    {
+      if(s_page + 1 == pageCount) // all pages are full
+        commit(writer);
+      else
+      {
+        ++s_page;
+        s_used = 0;
+      }
+    }
+    posix::size_t count = std::min(length, pageSize - s_used);
+    posix::memcpy(s_pages[s_page].data() + s_used, data, count);
+    s_used += count;
+    data += count;
+    length -= count;
+  }
+  return true;
+}
+
+void Screen::commit(writer_t writer) noexcept
+{
+  posix::size_t count = 0;
+  for(; count < s_page; ++count) // preceding pages are full
+  {
+    s_iov[count].iov_base = s_pages[count].data();
+    s_iov[count].iov_len = pageSize;
+  }
+  if(s_used)
+  {
+    s_iov[count].iov_base = s_pages[count].data();
+    s_iov[count].iov_len = s_used;
+    ++count;
+  }
+  s_page = 0;
+  s_used = 0;
+
+  if(count)
+    writer(s_iov.data(), int(count));
+}
+
+bool Screen::flush(writer_t writer) noexcept
+{
+  bool ok = true;
+  int16_t current_style = -1; // unknown
+  int32_t cursor_row = -1;
+  int32_t cursor_column = -1;
+  char sequence[32];
+
+  auto draw = [writer, &ok, &current_style](const cell_t& c) noexcept
+  {
+    if(c.style != current_style)
+    {
+      current_style = c.style;
+      ok = ok && emit(writer, terminal::style::reset, posix::strlen(terminal::style::reset));
+      if(current_style)
+        ok = ok && emit(writer, s_styles[c.style], posix::strlen(s_styles[c.style]));
+    }
+    ok = ok && emit(writer, &c.ch, 1);
+  };
+
+  for(uint16_t row = 0; ok && row < s_rows; ++row)
+  {
+    if(!s_dirty_rows[row])
+      continue;
+    s_dirty_rows[row] = false;
+
+    cell_t* back = cell(s_back, row, 0);
+    cell_t* front = cell(s_front, row, 0);
+    for(uint16_t column = 0; ok && column < s_columns; ++column)
+    {
+      if(back[column] == front[column])
+        continue;
+
+      if(cursor_row == row && column > cursor_column && column - cursor_column <= gapLimit)
+      {
+        for(int32_t gap = cursor_column; gap < column; ++gap) // rewrite short runs of unchanged cells
+          draw(back[gap]);
+      }
+      else if(cursor_row != row || cursor_column != column)
+      {
+        int length = posix::snprintf(sequence, sizeof(sequence), CSI "%u;%uH", row + 1, column + 1);
+        ok = emit(writer, sequence, posix::size_t(length));
+      }
+
+      draw(back[column]);
+      front[column] = back[column];
+      cursor_row = row;
+      cursor_column = column + 1;
+      if(cursor_column == s_columns) // avoid relying on autowrap behavior
+        cursor_row = -1;
+    }
+  }
+
+  if(current_style > 0)
+    ok = ok && emit(writer, terminal::style::reset, posix::strlen(terminal::style::reset));
+  commit(writer);
+  return ok;
+}
+
+void Screen::paint(painter_t painter) noexcept
+{
+  char text[UINT8_MAX + 1];
+  for(uint16_t row = 0; row < s_rows; ++row)
+  {
+    if(!s_dirty_rows[row])
+      continue;
+    s_dirty_rows[row] = false;
+
+    cell_t* back = cell(s_back, row, 0);
+    cell_t* front = cell(s_front, row, 0);
+    for(uint16_t column = 0; column < s_columns;)
+    {
+      if(back[column] == front[column])
+      {
+        ++column;
+        continue;
+      }
+
+      uint16_t start = column;
+      uint16_t count = 0;
+      for(; column < s_columns && count < sizeof(text) &&
+            back[column] != front[column] && back[column].style == back[start].style; ++column, ++count)
+      {
+        text[count] = back[column].ch;
+        front[column] = back[column];
+      }
+      painter(row, start, text, count, s_styles[back[start].style]);
+    }
+  }
+}
@@ -0,0 +1,31 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+// PUT
+#include <put/cxxutils/vterm.h>
+
+struct iovec;
+
+// In-memory model of the terminal.  Changes are drawn into the model and
+// flush() emits only the cells that differ from what the terminal shows.
+// NOTE: not thread-safe, callers serialize access
+namespace Screen
+{
+  using writer_t = void (*)(const struct iovec* iov, int count); // must take everything (e.g. buffer it)
+  using painter_t = void (*)(uint16_t row, uint16_t column, const char* text, uint16_t count, string_literal style);
+
+  extern bool resize(uint16_t rows, uint16_t columns) noexcept; // assumes the terminal was cleared
+  extern uint16_t rows(void) noexcept;
+  extern uint16_t columns(void) noexcept;
+
+  // coordinates are zero based and clipped to the screen
+  extern uint16_t put(uint16_t row, uint16_t column, string_literal style, const char* text) noexcept;
+  extern uint16_t put(uint16_t row, uint16_t column, string_literal style, const char* text, posix::size_t length) noexcept;
+  extern uint16_t fill(uint16_t row, uint16_t column, string_literal style, char ch, uint16_t count) noexcept;
+
+  extern void invalidate(void) noexcept; // redraw everything on the next flush
+  extern bool flush(writer_t writer) noexcept; // emit all changes in one call to writer (per 32KB)
+  extern void paint(painter_t painter) noexcept; // hand every run of changed cells sharing a style to painter
+}
+
+#endif // SCREEN_H
@@ -0,0 +1,274 @@
+#include "spawn.h"
+
+#if defined(__linux__)
+
+// STL
+#include <atomic>
+#include <mutex>
+
+// POSIX
+#include <fcntl.h>
+#include <pwd.h>
+#include <grp.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+// Linux
+#include <sched.h>
+#include <sys/syscall.h>
+
+// PUT
+#include <put/specialized/eventbackend.h>
+
+#ifndef SPAWN_STACK_SIZE
+#define SPAWN_STACK_SIZE     0x10000 // 64KB: the child only drops privileges and calls execve
+#endif
+
+#ifndef SPAWN_MAX_LENGTH
+#define SPAWN_MAX_LENGTH     4096 // bytes of arguments
+#endif
+
+#ifndef SPAWN_MAX_ARGUMENTS
+#define SPAWN_MAX_ARGUMENTS  64
+#endif
+
+#ifndef SPAWN_MAX_GROUPS
+#define SPAWN_MAX_GROUPS     64
+#endif
+
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD          0x00001000 // Linux 5.2
+#endif
+
+#ifndef P_PIDFD
+#define P_PIDFD              3 // Linux 5.4
+#endif
+
+namespace Spawn
+{
+  // shared with the child, which runs in our memory until it calls execve
+  struct child_t
+  {
+    const char* path;
+    char* const* argv;
+    char* const* envp;
+    posix::fd_t stderr_fd;
+    posix::fd_t inherit_fd;
+    const posix::fd_t* pidfd; // written by the kernel before the child runs (if it knows CLONE_PIDFD)
+    sigset_t mask; // the child's signal mask
+    bool switch_user;
+    uid_t uid;
+    gid_t gid;
+    int group_count;
+    gid_t groups[SPAWN_MAX_GROUPS];
+    int error; // set by the child if it couldn't exec
+  };
+
+  static std::mutex s_lock; // guards s_stack (the parent is suspended until the child execs or exits)
+  static std::atomic<bool> s_unsupported(false); // this kernel ignores CLONE_PIDFD
+  alignas(16) static char s_stack[SPAWN_STACK_SIZE];
+
+  int child_main(void* arg) noexcept;
+  bool lookup_user(const char* username, child_t& child) noexcept;
+  void reap(posix::fd_t pidfd, pid_t pid, exit_slot_t exited) noexcept;
+}
+
+pid_t Spawn::start(const char* bin, const char* arguments, const char* username, exit_slot_t exited,
+                   const setup_t* setup) noexcept
+{
+  // split a copy of the arguments in place (nothing is allocated)
+  char storage[SPAWN_MAX_LENGTH];
+  char* argv[SPAWN_MAX_ARGUMENTS + 1];
+  posix::size_t argc = 0;
+  if(arguments != nullptr)
+  {
+    if(posix::strlen(arguments) >= sizeof(storage))
+    {
+      errno = E2BIG;
+      return posix::error_response;
+    }
+    posix::strncpy(storage, arguments, sizeof(storage));
+    for(char* pos = storage; *pos;)
+    {
+      while(*pos && posix::isspace(*pos))
+        *pos++ = '\0';
+      if(*pos && argc == SPAWN_MAX_ARGUMENTS)
+      {
+        errno = E2BIG;
+        return posix::error_response;
+      }
+      if(*pos)
+        argv[argc++] = pos;
+      while(*pos && !posix::isspace(*pos))
+        ++pos;
+    }
+  }
+  if(!argc)
+    argv[argc++] = const_cast<char*>(bin);
+
+  if(s_unsupported)
+  {
+    errno = ENOSYS;
+    return posix::error_response;
+  }
+  argv[argc] = nullptr;
+
+  child_t child = {};
+  child.path = bin;
+  child.argv = argv;
+  child.envp = setup != nullptr && setup->envp != nullptr ? setup->envp : environ;
+  child.stderr_fd = setup != nullptr ? setup->stderr_fd : posix::error_response;
+  child.inherit_fd = setup != nullptr ? setup->inherit_fd : posix::error_response;
+  if(username != nullptr && !lookup_user(username, child))
+    return posix::error_response;
+
+  // no handler of ours may run in the child while it shares our memory
+  sigset_t all;
+  sigset_t previous;
+  ::sigfillset(&all);
+  ::pthread_sigmask(SIG_SETMASK, &all, &previous);
+  child.mask = previous;
+  ::sigdelset(&child.mask, SIGCHLD); // blocked here only for the reaper's signalfd
+
+  posix::fd_t pidfd = posix::error_response;
+  child.pidfd = &pidfd;
+  pid_t pid;
+  {
+    std::lock_guard<std::mutex> guard(s_lock);
+    // no exit signal: the child is only collected through its pidfd, never by the reaper's waitid(P_ALL)
+    pid = ::clone(child_main, s_stack + sizeof(s_stack), CLONE_VM | CLONE_VFORK | CLONE_PIDFD, &child, &pidfd);
+  }
+  int error = errno;
+  ::pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+
+  if(pid == posix::error_response)
+  {
+    errno = error == EINVAL ? ENOSYS : error; // EINVAL: CLONE_PIDFD is unknown to this kernel
+    return posix::error_response;
+  }
+
+  if(child.error) // didn't make it to execve
+  {
+    ::waitpid(pid, nullptr, __WALL); // __WALL: children without an exit signal
+    if(pidfd != posix::error_response)
+      posix::close(pidfd);
+    s_unsupported = child.error == ENOSYS;
+    errno = child.error;
+    return posix::error_response;
+  }
+
+  // the pidfd becomes readable once the child exits: one wakeup, no SIGCHLD scan
+  if(!EventBackend::add(pidfd, EventFlags::Readable,
+                        [pid, exited](posix::fd_t fd, native_flags_t) noexcept { reap(fd, pid, exited); }))
+  {
+    error = errno;
+    ::kill(pid, SIGKILL); // unsupervised children aren't allowed
+    ::waitpid(pid, nullptr, __WALL);
+    posix::close(pidfd);
+    errno = error;
+    return posix::error_response;
+  }
+
+  return pid;
+}
+
+// NOTE: runs on s_stack in our memory, so only async-signal-safe calls and raw credential syscalls
+// (the libc wrappers would try to change the credentials of every thread in this process)
+int Spawn::child_main(void* arg) noexcept
+{
+  child_t* child = static_cast<child_t*>(arg);
+
+  struct sigaction action = {};
+  for(int signal = 1; signal < NSIG; ++signal)
+    if(::sigaction(signal, nullptr, &action) == posix::success_response &&
+       action.sa_handler != SIG_DFL && action.sa_handler != SIG_IGN) // handlers belong to the parent
+    {
+      action = {};
+      action.sa_handler = SIG_DFL;
+      ::sigaction(signal, &action, nullptr);
+    }
+  ::sigprocmask(SIG_SETMASK, &child->mask, nullptr);
+
+  if(*child->pidfd == posix::error_response) // kernels before 5.2 ignore CLONE_PIDFD: don't start what we can't watch
+  {
+    child->error = ENOSYS;
+    ::_exit(127);
+  }
+
+  if((child->stderr_fd != posix::error_response &&
+      ::dup2(child->stderr_fd, STDERR_FILENO) == posix::error_response) || // our descriptor table is a copy
+     (child->inherit_fd != posix::error_response &&
+      ::fcntl(child->inherit_fd, F_SETFD, 0) == posix::error_response))
+  {
+    child->error = errno;
+    ::_exit(127);
+  }
+
+  if(child->switch_user &&
+     (::syscall(SYS_setgroups, child->group_count, child->groups) == posix::error_response ||
+      ::syscall(SYS_setresgid, child->gid, child->gid, child->gid) == posix::error_response ||
+      ::syscall(SYS_setresuid, child->uid, child->uid, child->uid) == posix::error_response))
+  {
+    child->error = errno;
+    ::_exit(127);
+  }
+
+  ::execve(child->path, child->argv, child->envp);
+  child->error = errno;
+  ::_exit(127);
+}
+
+// resolved in the parent: NSS must not run in the child
+bool Spawn::lookup_user(const char* username, child_t& child) noexcept
+{
+  struct passwd entry;
+  struct passwd* result = nullptr;
+  char buffer[1024];
+  int error = ::getpwnam_r(username, &entry, buffer, sizeof(buffer), &result);
+  if(result == nullptr)
+  {
+    errno = error ? error : ENOENT;
+    return false;
+  }
+
+  child.switch_user = true;
+  child.uid = entry.pw_uid;
+  child.gid = entry.pw_gid;
+  child.group_count = SPAWN_MAX_GROUPS;
+  if(::getgrouplist(username, entry.pw_gid, child.groups, &child.group_count) == posix::error_response)
+    child.group_count = SPAWN_MAX_GROUPS; // truncated
+  return true;
+}
+
+void Spawn::reap(posix::fd_t pidfd, pid_t pid, exit_slot_t exited) noexcept
+{
+  siginfo_t info = {};
+  int rval = ::waitid(idtype_t(P_PIDFD), id_t(pidfd), &info, WEXITED | WNOHANG | __WALL);
+  if(rval == posix::error_response && errno == EINVAL) // kernel predates P_PIDFD
+    rval = ::waitid(P_PID, id_t(pid), &info, WEXITED | WNOHANG | __WALL);
+  if(rval == posix::success_response && !info.si_pid) // not exited after all
+    return;
+
+  EventBackend::remove(pidfd, EventFlags::Readable);
+  posix::close(pidfd);
+
+  posix::error_t status = 0;
+  int signal = 0;
+  if(rval == posix::error_response) // reaped by someone else: the status is lost
+    status = posix::error_t(errno);
+  else if(info.si_code == CLD_EXITED)
+    status = posix::error_t(info.si_status);
+  else
+    signal = info.si_status;
+  exited(pid, status, signal);
+}
+
+#else
+
+pid_t Spawn::start(const char*, const char*, const char*, exit_slot_t, const setup_t*) noexcept
+{
+  errno = ENOSYS;
+  return posix::error_response;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+// PUT
+#include <put/object.h>
+#include <put/cxxutils/posix_helpers.h>
+
+namespace Spawn
+{
+  // status: exit status (0 if killed), signal: terminating signal (0 if exited)
+  using exit_slot_t = Object::fslot_t<void, pid_t, posix::error_t, int>;
+
+  // what the child gets besides its arguments
+  struct setup_t
+  {
+    char* const* envp = nullptr;                    // environment (ours if nullptr)
+    posix::fd_t stderr_fd = posix::error_response;  // becomes the child's stderr (ours if posix::error_response)
+    posix::fd_t inherit_fd = posix::error_response; // close-on-exec descriptor the child keeps (optional)
+  };
+
+  // starts bin without copying this process (vfork semantics) and watches its pidfd on the event loop
+  // arguments: whitespace separated argv including argv[0] (optional), username: account to run as (optional)
+  // setup (optional) is only read during the call
+  // returns the pid or posix::error_response (errno is ENOSYS when the kernel lacks pidfds)
+  extern pid_t start(const char* bin, const char* arguments, const char* username, exit_slot_t exited,
+                     const setup_t* setup = nullptr) noexcept;
+}
+
+#endif // SPAWN_H
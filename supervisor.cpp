@@ -0,0 +1,209 @@
+#include "supervisor.h"
+
+// STL
+#include <array>
+#include <memory>
+
+// PUT
+#include <put/childprocess.h>
+
+// Project
+#include "spawn.h"
+#include "timer.h"
+
+#ifndef SUPERVISOR_INDEX_SIZE
+#define SUPERVISOR_INDEX_SIZE (SUPERVISOR_CAPACITY * 2) // buckets of the pid index (a power of two)
+#endif
+
+static_assert(!(SUPERVISOR_INDEX_SIZE & (SUPERVISOR_INDEX_SIZE - 1)) && SUPERVISOR_INDEX_SIZE > SUPERVISOR_CAPACITY,
+              "SUPERVISOR_INDEX_SIZE must be a power of two larger than SUPERVISOR_CAPACITY");
+
+namespace Supervisor
+{
+  struct bucket_t
+  {
+    pid_t pid; // 0 when free
+    id_t id;
+  };
+
+  static std::array<entry_t, SUPERVISOR_CAPACITY> s_table; // hot: read on every exit and restart
+  static std::array<exit_slot_t, SUPERVISOR_CAPACITY> s_slots; // cold: only touched on start and exit
+  static std::array<std::unique_ptr<ChildProcess>, SUPERVISOR_CAPACITY> s_legacy; // only without pidfds
+  static std::array<bucket_t, SUPERVISOR_INDEX_SIZE> s_index; // pid to id of children forked by ChildProcess (open addressing)
+
+  static bool s_initialized = false;
+
+  void init(void) noexcept;
+  void stopped(id_t id, posix::error_t status, int signal) noexcept;
+  bool start_legacy(id_t id, const char* bin, const char* arguments, const char* username) noexcept;
+
+  bucket_t* find(pid_t pid) noexcept;
+  void index(pid_t pid, id_t id) noexcept;
+  void unindex(pid_t pid) noexcept;
+
+  // pids are handed out in sequence so their low bits spread evenly
+  static inline posix::size_t home(pid_t pid) noexcept
+    { return posix::size_t(pid) & (SUPERVISOR_INDEX_SIZE - 1); }
+
+  static inline uint64_t now(void) noexcept
+    { return Timer::monotonic() / 1000000; }
+}
+
+void Supervisor::init(void) noexcept
+{
+  for(entry_t& entry : s_table)
+    entry = entry_t{ 0, Status::Idle, 0, 0, 0, 0, 0 };
+  for(bucket_t& bucket : s_index)
+    bucket = bucket_t{ 0, 0 };
+  s_initialized = true;
+}
+
+bool Supervisor::running(id_t id) noexcept
+{
+  return id < SUPERVISOR_CAPACITY &&
+         s_initialized &&
+         s_table[id].status == Status::Running;
+}
+
+const Supervisor::entry_t& Supervisor::entry(id_t id) noexcept
+{
+  if(!s_initialized)
+    init();
+  return s_table[id < SUPERVISOR_CAPACITY ? id : 0];
+}
+
+bool Supervisor::start(id_t id, const char* bin, const char* arguments, const char* username, exit_slot_t exited,
+                       const Spawn::setup_t* setup) noexcept
+{
+  if(id >= SUPERVISOR_CAPACITY)
+  {
+    errno = ENOSPC;
+    return false;
+  }
+
+  if(!s_initialized)
+    init();
+
+  entry_t& entry = s_table[id];
+  if(entry.status == Status::Running)
+  {
+    errno = EALREADY;
+    return false;
+  }
+
+  if(entry.status != Status::Idle)
+    ++entry.restarts;
+  s_slots[id] = exited;
+  entry.started = now();
+#if defined(WANT_LEGACY_SPAWN) // always fork (e.g. to compare with Spawn in tools/bootbench)
+  (void)setup;
+  entry.pid = posix::error_response;
+  errno = ENOSYS;
+#else
+  // the pidfd is Spawn's to watch and close: its exit comes straight back to this slot
+  entry.pid = Spawn::start(bin, arguments, username,
+                           [id](pid_t pid, posix::error_t status, int signal) noexcept
+                           {
+                             if(s_table[id].pid == pid)
+                               stopped(id, status, signal);
+                           },
+                           setup);
+#endif
+
+  if(entry.pid == posix::error_response &&
+     errno == ENOSYS && // no pidfds: fork through ChildProcess and rely on its signals
+     start_legacy(id, bin, arguments, username))
+  {
+    entry.pid = s_legacy[id]->processId();
+    index(entry.pid, id); // the reaper may collect it first
+  }
+
+  if(entry.pid == posix::error_response)
+  {
+    entry.pid = 0;
+    entry.status = Status::Failed;
+    entry.exit_status = posix::error_t(errno);
+    entry.exit_signal = 0;
+    entry.stopped = entry.started;
+    return false;
+  }
+
+  entry.status = Status::Running;
+  return true;
+}
+
+bool Supervisor::start_legacy(id_t id, const char* bin, const char* arguments, const char* username) noexcept
+{
+  s_legacy[id].reset(new ChildProcess()); // the previous one has finished signaling by now
+  ChildProcess& proc = *s_legacy[id];
+  Object::connect(proc.finished, // unless the reaper collected it first
+      [id](pid_t pid, posix::error_t status) noexcept { if(s_table[id].pid == pid) stopped(id, status, 0); });
+  Object::connect(proc.killed,
+      [id](pid_t pid, posix::Signal::EId signal) noexcept { if(s_table[id].pid == pid) stopped(id, 0, int(signal)); });
+
+  return proc.setOption("/Process/Arguments", arguments != nullptr ? arguments : bin) && // the first argument is the binary
+         (username  == nullptr || proc.setOption("/Process/User", username)) && // set username if provided
+         proc.invoke(); // invoke the process
+}
+
+// most children the reaper collects are orphans: a miss ends at the first free bucket
+bool Supervisor::reaped(pid_t pid, posix::error_t status, int signal) noexcept
+{
+  if(!s_initialized || pid <= 0)
+    return false;
+
+  bucket_t* bucket = find(pid);
+  if(bucket == nullptr)
+    return false;
+  stopped(bucket->id, status, signal);
+  return true;
+}
+
+void Supervisor::stopped(id_t id, posix::error_t status, int signal) noexcept
+{
+  entry_t& entry = s_table[id];
+  unindex(entry.pid);
+  entry.pid = 0;
+  entry.status = signal ? Status::Killed : Status::Exited;
+  entry.exit_status = status;
+  entry.exit_signal = signal;
+  entry.stopped = now();
+
+  exit_slot_t exited = s_slots[id]; // the slot may start the process again
+  if(exited)
+    exited(status, signal);
+}
+
+Supervisor::bucket_t* Supervisor::find(pid_t pid) noexcept
+{
+  for(posix::size_t pos = home(pid); s_index[pos].pid; pos = (pos + 1) & (SUPERVISOR_INDEX_SIZE - 1))
+    if(s_index[pos].pid == pid)
+      return &s_index[pos];
+  return nullptr;
+}
+
+// NOTE: never full since no more than SUPERVISOR_CAPACITY processes run at once
+void Supervisor::index(pid_t pid, id_t id) noexcept
+{
+  posix::size_t pos = home(pid);
+  while(s_index[pos].pid && s_index[pos].pid != pid)
+    pos = (pos + 1) & (SUPERVISOR_INDEX_SIZE - 1);
+  s_index[pos] = bucket_t{ pid, id };
+}
+
+// shifts later buckets of the same run back instead of leaving a marker, so lookups never slow down
+void Supervisor::unindex(pid_t pid) noexcept
+{
+  bucket_t* bucket = find(pid);
+  if(bucket == nullptr)
+    return;
+
+  posix::size_t hole = posix::size_t(bucket - s_index.data());
+  for(posix::size_t pos = (hole + 1) & (SUPERVISOR_INDEX_SIZE - 1); s_index[pos].pid; pos = (pos + 1) & (SUPERVISOR_INDEX_SIZE - 1))
+    if(((pos - home(s_index[pos].pid)) & (SUPERVISOR_INDEX_SIZE - 1)) >= ((pos - hole) & (SUPERVISOR_INDEX_SIZE - 1))) // may move back to the hole
+    {
+      s_index[hole] = s_index[pos];
+      hole = pos;
+    }
+  s_index[hole].pid = 0;
+}
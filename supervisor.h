@@ -0,0 +1,55 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+// PUT
+#include <put/object.h>
+#include <put/cxxutils/posix_helpers.h>
+
+// Project
+#include "spawn.h"
+
+#ifndef SUPERVISOR_CAPACITY
+#define SUPERVISOR_CAPACITY 256 // supervised processes
+#endif
+
+namespace Supervisor
+{
+  using id_t = uint16_t; // index into the table (e.g. provider number)
+
+  enum class Status : uint8_t
+  {
+    Idle,     // never started
+    Running,
+    Exited,
+    Killed,
+    Failed,   // could not be started
+  };
+
+  struct entry_t
+  {
+    pid_t pid;                  // 0 when not running
+    Status status;
+    uint32_t restarts;          // starts after the first
+    posix::error_t exit_status; // exit status (or errno if it could not be started)
+    int exit_signal;            // terminating signal (0 if exited)
+    uint64_t started;           // monotonic milliseconds
+    uint64_t stopped;           // monotonic milliseconds
+  };
+
+  // status: exit status (0 if killed), signal: terminating signal (0 if exited)
+  using exit_slot_t = Object::fslot_t<void, posix::error_t, int>;
+
+  // starts a process in slot id unless one is running there already (see Spawn::start for arguments)
+  // NOTE: the table isn't locked: call from the event loop thread, where exits are reported
+  // NOTE: setup is ignored without pidfds (the process is forked with our environment and descriptors)
+  extern bool start(id_t id, const char* bin, const char* arguments, const char* username, exit_slot_t exited,
+                    const Spawn::setup_t* setup = nullptr) noexcept;
+  extern bool running(id_t id) noexcept;
+
+  // reports the exit of a child collected elsewhere (see Reaper), false if it isn't in the table
+  // NOTE: only children forked without pidfds are collected elsewhere: Spawn reports the others to their slot
+  extern bool reaped(pid_t pid, posix::error_t status, int signal) noexcept;
+  extern const entry_t& entry(id_t id) noexcept;
+}
+
+#endif // SUPERVISOR_H
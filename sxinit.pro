@@ -46,17 +46,90 @@ QMAKE_CXXFLAGS_RELEASE += -DRELEASE
 #DEFINES += FORCE_POSIX_POLL
 #DEFINES += FORCE_POSIX_MUTEXES
 #DEFINES += FORCE_PROCESS_POLLING
+#DEFINES += WANT_BOOT_TRACE
 
 SOURCES += \
     main.cpp \
     framebuffer.cpp \
     initializer.cpp \
+    timer.cpp \
+    tracer.cpp \
+    screen.cpp \
+    modules.cpp \
+    rootdevice.cpp \
+    bootoptions.cpp \
+    journal.cpp \
+    mounttable.cpp \
+    fstab.cpp \
+    spawn.cpp \
+    supervisor.cpp \
+    manifest.cpp \
+    readahead.cpp \
+    bootcache.cpp \
+    arena.cpp \
+    reaper.cpp \
+    fsck.cpp \
+    console.cpp \
     display.cpp
 
 HEADERS += \
     framebuffer.h \
     initializer.h \
+    timer.h \
+    tracer.h \
+    screen.h \
+    modules.h \
+    rootdevice.h \
+    bootoptions.h \
+    journal.h \
+    mounttable.h \
+    fstab.h \
+    spawn.h \
+    supervisor.h \
+    manifest.h \
+    readahead.h \
+    bootcache.h \
+    arena.h \
+    reaper.h \
+    fsck.h \
+    console.h \
     splash.h \
+    font.h \
     display.h
 
+# splash.h is generated from splash.pgm
+splashgen.target = $$PWD/splash.h
+splashgen.depends = $$PWD/splash.pgm $$PWD/tools/splashgen.cpp
+splashgen.commands = $$QMAKE_CXX -std=c++14 -O2 -o splashgen $$PWD/tools/splashgen.cpp && ./splashgen $$PWD/splash.pgm $$PWD/splash.h
+QMAKE_EXTRA_TARGETS += splashgen
+PRE_TARGETDEPS += $$PWD/splash.h
+QMAKE_CLEAN += $$PWD/splash.h splashgen
+
+# font.h is generated from font.txt
+fontgen.target = $$PWD/font.h
+fontgen.depends = $$PWD/font.txt $$PWD/tools/fontgen.cpp
+fontgen.commands = $$QMAKE_CXX -std=c++14 -O2 -o fontgen $$PWD/tools/fontgen.cpp && ./fontgen $$PWD/font.txt $$PWD/font.h
+QMAKE_EXTRA_TARGETS += fontgen
+PRE_TARGETDEPS += $$PWD/font.h
+QMAKE_CLEAN += $$PWD/font.h fontgen
+
+# provider manifest compiler (make manifest)
+manifest.target = manifest
+manifest.depends = $$PWD/providers.txt $$PWD/tools/manifestc.cpp $$PWD/manifest.h
+manifest.commands = $$QMAKE_CXX -std=c++14 -O2 -o manifestc $$PWD/tools/manifestc.cpp && ./manifestc $$PWD/providers.txt sxinit.manifest
+QMAKE_EXTRA_TARGETS += manifest
+QMAKE_CLEAN += manifestc sxinit.manifest
+
+# boot benchmark (make bench, needs DEFINES += WANT_BOOT_TRACE)
+bench.depends = $(TARGET) manifest
+bench.commands = $$QMAKE_CXX -std=c++14 -O2 -I$$PWD -o bootbench $$PWD/tools/bootbench.cpp $$PWD/bootoptions.cpp $$PWD/framebuffer.cpp && ./bootbench --cmdline $$PWD/tools/bench/cmdline && ./bootbench --splash && ./bootbench -n 20 ./$(TARGET) $$PWD/tools/bench/default
+QMAKE_EXTRA_TARGETS += bench
+
+# supervision at scale (make bench-providers, 1000 stand-ins need DEFINES += SUPERVISOR_CAPACITY=1024)
+bench_providers.target = bench-providers
+bench_providers.depends = $(TARGET) manifest
+bench_providers.commands = $$QMAKE_CXX -std=c++14 -O2 -I$$PWD -o bootbench $$PWD/tools/bootbench.cpp $$PWD/bootoptions.cpp $$PWD/framebuffer.cpp && for count in 10 100 1000; do ./bootbench -n 20 -p $$$$count ./$(TARGET) $$PWD/tools/bench/default || exit 1; done
+QMAKE_EXTRA_TARGETS += bench_providers
+QMAKE_CLEAN += bootbench
+
 include(put/put.pri)
@@ -0,0 +1,196 @@
+#include "timer.h"
+
+// STL
+#include <array>
+#include <mutex>
+
+// POSIX
+#include <time.h>
+
+// PUT
+#include <put/specialized/eventbackend.h>
+
+#if defined(__linux__)
+// Linux
+#include <sys/timerfd.h>
+#endif
+
+#ifndef TIMER_CAPACITY
+#define TIMER_CAPACITY  1024 // timers at once (a power of two): up to three per provider
+#endif
+
+static_assert(!(TIMER_CAPACITY & (TIMER_CAPACITY - 1)), "TIMER_CAPACITY must be a power of two");
+
+namespace Timer
+{
+  struct entry_t
+  {
+    id_t timer;
+    Object::fslot_t<void> func;
+    bool repeat;
+    bool used;
+  };
+
+  static std::mutex s_lock;
+  static std::array<entry_t, TIMER_CAPACITY> s_timers; // by descriptor (open addressing): nothing is allocated per timer
+  static posix::size_t s_count = 0;
+
+  void expired(posix::fd_t fd, native_flags_t) noexcept;
+  entry_t* find(id_t timer) noexcept;
+  bool insert(id_t timer, Object::fslot_t<void>& func, bool repeat) noexcept;
+  bool erase(id_t timer) noexcept;
+
+  // descriptors are handed out lowest first so their low bits spread evenly
+  static inline posix::size_t home(id_t timer) noexcept
+    { return posix::size_t(timer) & (TIMER_CAPACITY - 1); }
+
+  static inline posix::size_t next(posix::size_t pos) noexcept
+    { return (pos + 1) & (TIMER_CAPACITY - 1); }
+}
+
+Timer::id_t Timer::start(uint32_t milliseconds, Object::fslot_t<void> func, bool repeat) noexcept
+{
+#if defined(__linux__)
+  id_t timer = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if(timer == posix::error_response)
+    return posix::error_response;
+
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec  = time_t(milliseconds / 1000);
+  spec.it_value.tv_nsec = long(milliseconds % 1000) * 1000000;
+  if(!milliseconds)
+    spec.it_value.tv_nsec = 1; // a zero value would disarm the timer
+  if(repeat)
+    spec.it_interval = spec.it_value;
+
+  bool inserted;
+  {
+    std::lock_guard<std::mutex> guard(s_lock);
+    inserted = insert(timer, func, repeat);
+  }
+  if(!inserted)
+  {
+    posix::close(timer);
+    errno = ENOSPC;
+    return posix::error_response;
+  }
+
+  if(::timerfd_settime(timer, 0, &spec, nullptr) == posix::error_response ||
+     !EventBackend::add(timer, EventFlags::Readable, expired))
+  {
+    stop(timer);
+    return posix::error_response;
+  }
+  return timer;
+#else
+  (void)milliseconds;
+  (void)func;
+  (void)repeat;
+  errno = ENOSYS;
+  return posix::error_response;
+#endif
+}
+
+bool Timer::stop(id_t& timer) noexcept
+{
+  if(timer == posix::error_response)
+    return false;
+
+  {
+    std::lock_guard<std::mutex> guard(s_lock);
+    if(!erase(timer)) // not a timer we own
+    {
+      timer = posix::error_response;
+      return false;
+    }
+  }
+
+  EventBackend::remove(timer, EventFlags::Readable);
+  posix::close(timer);
+  timer = posix::error_response;
+  return true;
+}
+
+void Timer::expired(posix::fd_t fd, native_flags_t) noexcept
+{
+  uint64_t expirations = 0;
+  if(posix::read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+    return;
+
+  Object::fslot_t<void> func;
+  bool repeat = false;
+  {
+    std::lock_guard<std::mutex> guard(s_lock);
+    entry_t* entry = find(fd);
+    if(entry == nullptr)
+      return;
+    func = entry->func; // copy because the callback may stop or start timers
+    repeat = entry->repeat;
+  }
+
+  if(!repeat)
+  {
+    id_t timer = fd;
+    stop(timer);
+  }
+
+  if(func)
+    func();
+}
+
+// NOTE: s_lock must be held
+Timer::entry_t* Timer::find(id_t timer) noexcept
+{
+  if(!s_count)
+    return nullptr;
+  for(posix::size_t pos = home(timer); s_timers[pos].used; pos = next(pos))
+    if(s_timers[pos].timer == timer)
+      return &s_timers[pos];
+  return nullptr;
+}
+
+// NOTE: s_lock must be held
+bool Timer::insert(id_t timer, Object::fslot_t<void>& func, bool repeat) noexcept
+{
+  if(s_count == TIMER_CAPACITY - 1) // a free entry ends every search
+    return false;
+  posix::size_t pos = home(timer);
+  while(s_timers[pos].used)
+    pos = next(pos);
+  s_timers[pos].timer = timer;
+  s_timers[pos].func = std::move(func);
+  s_timers[pos].repeat = repeat;
+  s_timers[pos].used = true;
+  ++s_count;
+  return true;
+}
+
+// NOTE: s_lock must be held
+// later entries of the same run are moved back instead of leaving a marker, so searches never slow down
+bool Timer::erase(id_t timer) noexcept
+{
+  entry_t* entry = find(timer);
+  if(entry == nullptr)
+    return false;
+
+  posix::size_t hole = posix::size_t(entry - s_timers.data());
+  for(posix::size_t pos = next(hole); s_timers[pos].used; pos = next(pos))
+    if(((pos - home(s_timers[pos].timer)) & (TIMER_CAPACITY - 1)) >= ((pos - hole) & (TIMER_CAPACITY - 1))) // may move back to the hole
+    {
+      s_timers[hole].timer = s_timers[pos].timer;
+      s_timers[hole].func = std::move(s_timers[pos].func);
+      s_timers[hole].repeat = s_timers[pos].repeat;
+      hole = pos;
+    }
+  s_timers[hole].func = nullptr;
+  s_timers[hole].used = false;
+  --s_count;
+  return true;
+}
+
+uint64_t Timer::monotonic(void) noexcept
+{
+  struct timespec now = {};
+  ::clock_gettime(CLOCK_MONOTONIC, &now);
+  return uint64_t(now.tv_sec) * 1000000000 + uint64_t(now.tv_nsec);
+}
@@ -0,0 +1,20 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+// PUT
+#include <put/object.h>
+#include <put/cxxutils/posix_helpers.h>
+
+namespace Timer
+{
+  using id_t = posix::fd_t;
+
+  // invokes func on the event loop thread once milliseconds have elapsed (and every milliseconds thereafter if repeating)
+  // NOTE: start and stop register with the event backend: call them from the event loop thread only
+  extern id_t start(uint32_t milliseconds, Object::fslot_t<void> func, bool repeat = false) noexcept;
+  extern bool stop(id_t& timer) noexcept; // sets timer to posix::error_response
+
+  extern uint64_t monotonic(void) noexcept; // nanoseconds
+}
+
+#endif // TIMER_H
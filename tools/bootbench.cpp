@@ -0,0 +1,1093 @@
+// Boots sxinit repeatedly as PID 1 inside unprivileged user, PID and mount namespaces and reports
+// percentiles of the time each step took to settle (from the boot trace, so sxinit must be built with
+// WANT_BOOT_TRACE).  Spawn-to-exec latency of every provider is reported as well: run it against a second
+// build with -DWANT_LEGACY_SPAWN to compare with forking through ChildProcess.
+//
+//   bootbench [-n runs] [-t timeout_ms] [-r ready_step] [-c manifestc] [-p providers] <sxinit> <scenario>
+//
+// -p replaces the providers of the scenario with that many stand-ins that are ready once they run, to see how
+// supervision scales (e.g. 10, 100 and 1000; beyond 256 sxinit needs a larger -DSUPERVISOR_CAPACITY).  Their
+// steps are reported together as "Stand-ins (last)": when the last of them settled.
+//
+// A scenario is a directory holding any of:
+//   root/          copied into the sandbox root (e.g. root/etc/fstab)
+//   providers.txt  compiled with manifestc into /etc/sxinit.manifest (use /bench/standin as the bin)
+//   cmdline        bound over /proc/cmdline
+//   devices        fake block devices, one per line: <image name> [uuid] [label]
+//                  (an empty image file is linked from /dev/disk/by-uuid and /dev/disk/by-label)
+//
+// The same binary doubles as a stand-in provider:
+//   bootbench --standin [name=id] [delay=ms] [crash=count] [mount=source:path] [bind=path] [bind_delay=ms] [notify=1]
+// It notes when it was executed, sleeps for delay, exits with status 1 on its first crash starts, mounts a
+// tmpfs named source, binds a unix socket after bind_delay and writes to NOTIFY_FD, then waits to be killed.
+//
+// It also benchmarks and fuzzes the kernel command line parser (BootOptions, compiled in):
+//   bootbench --cmdline [-n parses] [-f inputs] [-s seed] <corpus>
+// Each file of the corpus is parsed repeatedly and the time per parse reported, then inputs mutated from the
+// corpus (quotes, "--" separators, embedded NULs, lines beyond the 8KB capacity) are checked against a plain
+// reference parser.  Build it with -fsanitize=address to catch overruns as well.
+//
+// And it times drawing the splash (FrameBuffer and splash.h, compiled in) into memory in each pixel format:
+//   bootbench --splash [-n draws]
+// FrameBuffer::loadRLE of the encoded image is compared with FrameBuffer::load of the same image decoded into
+// a raw array beforehand (both must draw the same pixels), and the size of each is reported.  The memory
+// page is the size of the splash so the time is spent decoding rather than clearing the screen.
+
+// STL
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <cctype>
+#include <random>
+
+// POSIX
+#include <fcntl.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Linux
+#include <sched.h>
+#include <sys/mount.h>
+
+// Project
+#include "../bootoptions.h"
+#include "../framebuffer.h"
+#include "../splash.h"
+
+#define TRACE_FILE      "/var/log/sxinit-boot.json"
+#define MANIFEST_FILE   "/etc/sxinit.manifest"
+#define CONSOLE_FILE    "/bench/console.log"
+#define STANDIN_FILE    "/bench/standin"
+#define EXEC_FILE       "/bench/exec.log"
+#define INIT_FILE       "/sbin/init"
+#define STACK_SIZE      0x40000
+#define STANDIN_STEP    "Stand-in"
+#define STANDIN_STEPS   "Stand-ins (last)"
+
+#ifndef CMDLINE_CAPACITY
+#define CMDLINE_CAPACITY  0x2000 // must match bootoptions.cpp
+#endif
+
+#define CMDLINE_SAMPLE  100 // parses timed together
+
+struct options_t
+{
+  unsigned int runs = 20;
+  unsigned int timeout = 10000; // milliseconds
+  const char* ready_step = nullptr; // "Director Service" or STANDIN_STEPS
+  unsigned int providers = 0; // stand-ins generated instead of the scenario's providers.txt
+  std::string manifestc;
+  std::string sxinit;
+  std::string scenario;
+  std::string self;
+  std::string manifest; // compiled once for every run
+};
+
+struct sandbox_t
+{
+  const options_t* options;
+  std::string root;
+  int sync[2];
+};
+
+struct step_time_t
+{
+  std::string name;
+  std::vector<double> times; // milliseconds since sxinit started
+  unsigned int failures = 0;
+};
+
+static uint64_t now_ns(void) noexcept
+{
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+}
+
+static uint64_t now_us(void) noexcept
+  { return now_ns() / 1000; }
+
+static uint64_t now_ms(void) noexcept
+  { return now_us() / 1000; }
+
+static void sleep_ms(unsigned long ms) noexcept
+{
+  struct timespec ts = { time_t(ms / 1000), long(ms % 1000) * 1000000 };
+  while(::nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+static bool exists(const std::string& path) noexcept
+{
+  struct stat state;
+  return ::stat(path.c_str(), &state) == 0;
+}
+
+static bool make_path(const std::string& path, mode_t mode = 0755) noexcept
+{
+  for(size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1))
+    ::mkdir(path.substr(0, pos).c_str(), mode);
+  return ::mkdir(path.c_str(), mode) == 0 || errno == EEXIST;
+}
+
+static bool write_file(const std::string& path, const char* data, size_t length) noexcept
+{
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if(fd == -1)
+    return false;
+  bool ok = ::write(fd, data, length) == ssize_t(length);
+  return ::close(fd) == 0 && ok;
+}
+
+static bool read_file(const std::string& path, std::string& data) noexcept
+{
+  FILE* file = std::fopen(path.c_str(), "rb");
+  if(file == nullptr)
+    return false;
+  char buffer[4096];
+  data.clear();
+  for(size_t count; (count = std::fread(buffer, 1, sizeof(buffer), file)) > 0;)
+    data.append(buffer, count);
+  std::fclose(file);
+  return true;
+}
+
+static bool copy_file(const std::string& from, const std::string& to) noexcept
+{
+  std::string data;
+  return read_file(from, data) && write_file(to, data.data(), data.size());
+}
+
+static bool run(const std::vector<std::string>& args) noexcept
+{
+  pid_t pid = ::fork();
+  if(!pid)
+  {
+    std::vector<char*> argv;
+    for(const std::string& arg : args)
+      argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    ::execv(argv[0], argv.data());
+    std::fprintf(stderr, "unable to run %s: %s\n", argv[0], std::strerror(errno));
+    ::_exit(127);
+  }
+  int status = 0;
+  return pid != -1 && ::waitpid(pid, &status, 0) == pid && WIFEXITED(status) && !WEXITSTATUS(status);
+}
+
+// nftw() has no context argument
+static std::string s_copy_from;
+static std::string s_copy_to;
+
+static int copy_entry(const char* path, const struct stat* state, int type, struct FTW*) noexcept
+{
+  std::string target = s_copy_to + (path + s_copy_from.size());
+  if(type == FTW_D)
+    return make_path(target) ? 0 : -1;
+  if(type == FTW_SL)
+  {
+    char destination[PATH_MAX];
+    ssize_t length = ::readlink(path, destination, sizeof(destination) - 1);
+    if(length == -1)
+      return -1;
+    destination[length] = '\0';
+    return ::symlink(destination, target.c_str());
+  }
+  return S_ISREG(state->st_mode) && copy_file(path, target) ? 0 : -1;
+}
+
+static int remove_entry(const char* path, const struct stat*, int, struct FTW*) noexcept
+{
+  return ::remove(path);
+}
+
+static bool remove_tree(const std::string& path) noexcept
+{
+  return ::nftw(path.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS | FTW_MOUNT) == 0;
+}
+
+// builds the sandbox root on the host so the trace can be read after the namespaces are gone
+static bool populate(const options_t& options, const std::string& root) noexcept
+{
+  static const char* const directories[] = { "/etc", "/var/log", "/sbin", "/bin", "/usr", "/lib", "/lib64",
+                                             "/proc", "/sys", "/dev/disk/by-uuid", "/dev/disk/by-label",
+                                             "/svc", "/tmp", "/mnt", "/bench/images" };
+  for(const char* directory : directories)
+    if(!make_path(root + directory))
+      return false;
+
+  static const char* const files[] = { "/dev/null", "/dev/zero", "/dev/urandom", INIT_FILE, STANDIN_FILE };
+  for(const char* file : files) // bind mount targets
+    if(!write_file(root + file, "", 0))
+      return false;
+
+  s_copy_from = options.scenario + "/root";
+  s_copy_to = root;
+  if(exists(s_copy_from) &&
+     ::nftw(s_copy_from.c_str(), copy_entry, 16, FTW_PHYS) != 0)
+    return false;
+
+  if(!options.manifest.empty() &&
+     !copy_file(options.manifest, root + MANIFEST_FILE))
+    return false;
+
+  FILE* devices = std::fopen((options.scenario + "/devices").c_str(), "r");
+  if(devices != nullptr)
+  {
+    char line[512], image[128], uuid[128], label[128];
+    while(std::fgets(line, sizeof(line), devices) != nullptr)
+    {
+      *uuid = *label = '\0';
+      if(*line == '#' || std::sscanf(line, "%127s %127s %127s", image, uuid, label) < 1)
+        continue;
+      std::string target = std::string("/bench/images/") + image;
+      write_file(root + target, "", 0);
+      if(*uuid && std::strcmp(uuid, "-"))
+        ::symlink(target.c_str(), (root + "/dev/disk/by-uuid/" + uuid).c_str());
+      if(*label)
+        ::symlink(target.c_str(), (root + "/dev/disk/by-label/" + label).c_str());
+    }
+    std::fclose(devices);
+  }
+  return true;
+}
+
+static bool bind_mount(const std::string& from, const std::string& to) noexcept
+{
+  if(::mount(from.c_str(), to.c_str(), nullptr, MS_BIND | MS_REC, nullptr) == 0)
+    return true;
+  std::fprintf(stderr, "unable to bind %s to %s: %s\n", from.c_str(), to.c_str(), std::strerror(errno));
+  return false;
+}
+
+// runs as PID 1 of the new namespaces until it becomes sxinit
+static int sandbox_main(void* arg) noexcept
+{
+  sandbox_t* sandbox = static_cast<sandbox_t*>(arg);
+  const options_t& options = *sandbox->options;
+  const std::string& root = sandbox->root;
+
+  char ready;
+  ::close(sandbox->sync[1]);
+  if(::read(sandbox->sync[0], &ready, 1) != 1) // wait for the id maps
+    ::_exit(126);
+  ::close(sandbox->sync[0]);
+
+  if(::mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr) == -1) // keep our mounts away from the host
+    ::_exit(126);
+
+  static const char* const host[] = { "/bin", "/usr", "/lib", "/lib64", "/dev/null", "/dev/zero", "/dev/urandom" };
+  for(const char* path : host)
+    if(exists(path) && !bind_mount(path, root + path))
+      ::_exit(126);
+  if(!bind_mount(options.sxinit, root + INIT_FILE) ||
+     !bind_mount(options.self, root + STANDIN_FILE))
+    ::_exit(126);
+
+  // sxinit finds procfs already mounted (a private one if this kernel allows it)
+  if(::mount("proc", (root + "/proc").c_str(), "proc", MS_NOSUID | MS_NODEV | MS_NOEXEC, nullptr) == -1 &&
+     !bind_mount("/proc", root + "/proc"))
+    ::_exit(126);
+  if(exists(options.scenario + "/cmdline"))
+    bind_mount(options.scenario + "/cmdline", root + "/proc/cmdline");
+
+  int console = ::open((root + CONSOLE_FILE).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(console == -1 ||
+     ::chroot(root.c_str()) == -1 ||
+     ::chdir("/") == -1)
+    ::_exit(126);
+
+  ::dup2(console, STDOUT_FILENO);
+  ::dup2(console, STDERR_FILENO);
+  ::close(console);
+
+  char* const argv[] = { const_cast<char*>("init"), nullptr };
+  char* const envp[] = { const_cast<char*>("PATH=/sbin:/bin:/usr/sbin:/usr/bin"), const_cast<char*>("TERM=linux"), nullptr };
+  ::execve(INIT_FILE, argv, envp);
+  std::fprintf(stderr, "unable to exec sxinit: %s\n", std::strerror(errno));
+  ::_exit(127);
+}
+
+static bool write_id_map(pid_t pid, const char* name, const char* value) noexcept
+{
+  char path[64];
+  std::snprintf(path, sizeof(path), "/proc/%d/%s", int(pid), name);
+  return write_file(path, value, std::strlen(value));
+}
+
+// finds "key":"value" or "key":number on a trace line
+static bool trace_field(const std::string& line, const char* key, std::string& value) noexcept
+{
+  std::string pattern = std::string("\"") + key + "\":";
+  size_t pos = line.find(pattern);
+  if(pos == std::string::npos)
+    return false;
+  pos += pattern.size();
+  value.clear();
+  if(line[pos] != '"')
+  {
+    size_t end = line.find_first_of(",}", pos);
+    value = line.substr(pos, end - pos);
+    return true;
+  }
+  for(++pos; pos < line.size() && line[pos] != '"'; ++pos)
+  {
+    if(line[pos] == '\\')
+      ++pos;
+    value.push_back(line[pos]);
+  }
+  return true;
+}
+
+static void record_step(std::vector<step_time_t>& steps, const std::string& name, double time, bool failed) noexcept
+{
+  auto step = std::find_if(steps.begin(), steps.end(), [&name](const step_time_t& s) { return s.name == name; });
+  if(step == steps.end())
+  {
+    steps.emplace_back();
+    step = steps.end() - 1;
+    step->name = name;
+  }
+  step->times.push_back(time);
+  if(failed)
+    ++step->failures;
+}
+
+static void record_trace(const std::string& trace, std::vector<step_time_t>& steps) noexcept
+{
+  double standins = -1.0; // generated stand-ins count as one step that settles with the last of them
+  bool standin_failed = false;
+  size_t next;
+  for(size_t pos = 0; pos < trace.size(); pos = next + 1)
+  {
+    next = trace.find('\n', pos);
+    if(next == std::string::npos)
+      next = trace.size();
+    std::string line = trace.substr(pos, next - pos), phase, category, name, ts, detail;
+    if(!trace_field(line, "ph", phase) || phase != "e" ||
+       !trace_field(line, "cat", category) || category != "step" ||
+       !trace_field(line, "name", name) ||
+       !trace_field(line, "ts", ts))
+      continue;
+    trace_field(line, "detail", detail);
+
+    double time = std::strtod(ts.c_str(), nullptr) / 1000.0; // trace is in microseconds
+    if(!name.compare(0, sizeof(STANDIN_STEP), STANDIN_STEP " "))
+    {
+      standins = std::max(standins, time);
+      standin_failed = standin_failed || detail != "Passed";
+    }
+    else
+      record_step(steps, name, time, detail != "Passed");
+  }
+  if(standins >= 0.0)
+    record_step(steps, STANDIN_STEPS, standins, standin_failed);
+}
+
+// stand-ins that depend on nothing but the root filesystem and are ready as soon as they run
+static std::string generate_providers(unsigned int count) noexcept
+{
+  std::string text = "# generated by bootbench -p\n";
+  char section[256];
+  for(unsigned int index = 1; index <= count; ++index)
+  {
+    std::snprintf(section, sizeof(section),
+                  "\n[" STANDIN_STEP " %u]\n"
+                  "bin       = " STANDIN_FILE "\n"
+                  "arguments = " STANDIN_FILE " name=standin%u\n"
+                  "depends   = /\n"
+                  "provides  = /standin/%u\n",
+                  index, index, index);
+    text += section;
+  }
+  return text;
+}
+
+// pairs each "spawn" trace event (its value is the pid) with the time the stand-in was executed
+static void record_spawns(const std::string& trace, const std::string& execs, std::vector<double>& latencies) noexcept
+{
+  std::string origin;
+  size_t footer = trace.rfind("\"otherData\"");
+  if(footer == std::string::npos || !trace_field(trace.substr(footer), "origin", origin))
+    return;
+  double base = std::strtod(origin.c_str(), nullptr); // trace timestamps are microseconds since this
+
+  size_t next;
+  for(size_t pos = 0; pos < trace.size(); pos = next + 1)
+  {
+    next = trace.find('\n', pos);
+    if(next == std::string::npos)
+      next = trace.size();
+    std::string line = trace.substr(pos, next - pos), phase, category, ts, value;
+    if(!trace_field(line, "ph", phase) || phase != "X" ||
+       !trace_field(line, "cat", category) || category != "spawn" ||
+       !trace_field(line, "ts", ts) ||
+       !trace_field(line, "value", value))
+      continue;
+
+    std::string pid = value + ' ';
+    for(size_t found = execs.find(pid); found != std::string::npos; found = execs.find(pid, found + 1))
+      if(!found || execs[found - 1] == '\n')
+      {
+        double executed = std::strtod(execs.c_str() + found + pid.size(), nullptr);
+        latencies.push_back(executed - (base + std::strtod(ts.c_str(), nullptr)));
+        break;
+      }
+  }
+}
+
+static bool boot_once(const options_t& options, std::vector<step_time_t>& steps, std::vector<double>& wall,
+                      std::vector<double>& spawns) noexcept
+{
+  char root_template[] = "/tmp/bootbench.XXXXXX";
+  if(::mkdtemp(root_template) == nullptr)
+  {
+    std::fprintf(stderr, "unable to create sandbox: %s\n", std::strerror(errno));
+    return false;
+  }
+
+  sandbox_t sandbox = { &options, root_template, { -1, -1 } };
+  bool ok = false;
+  if(!populate(options, sandbox.root) || ::pipe2(sandbox.sync, O_CLOEXEC) == -1)
+  {
+    std::fprintf(stderr, "unable to populate sandbox: %s\n", std::strerror(errno));
+    remove_tree(sandbox.root);
+    return false;
+  }
+
+  static std::vector<char> stack(STACK_SIZE);
+  uint64_t start = now_ms();
+  pid_t pid = ::clone(sandbox_main, stack.data() + stack.size(), CLONE_NEWUSER | CLONE_NEWPID | CLONE_NEWNS | SIGCHLD, &sandbox);
+  ::close(sandbox.sync[0]);
+  if(pid == -1)
+  {
+    std::fprintf(stderr, "unable to create namespaces: %s\n", std::strerror(errno));
+    ::close(sandbox.sync[1]);
+    remove_tree(sandbox.root);
+    return false;
+  }
+
+  char map[64];
+  std::snprintf(map, sizeof(map), "0 %u 1\n", unsigned(::getuid()));
+  write_id_map(pid, "setgroups", "deny"); // missing on old kernels
+  bool mapped = write_id_map(pid, "uid_map", map);
+  std::snprintf(map, sizeof(map), "0 %u 1\n", unsigned(::getgid()));
+  mapped = mapped && write_id_map(pid, "gid_map", map);
+  if(mapped)
+    (void)!::write(sandbox.sync[1], "", 1);
+  ::close(sandbox.sync[1]);
+
+  // the trace is written once every step has settled
+  std::string trace;
+  const std::string trace_path = sandbox.root + TRACE_FILE;
+  int status = 0;
+  bool exited = false;
+  while(mapped && !(exited = ::waitpid(pid, &status, WNOHANG) == pid) && now_ms() - start < options.timeout)
+  {
+    if(read_file(trace_path, trace) &&
+       trace.size() > 2 && !trace.compare(trace.size() - 2, 2, "}\n"))
+    {
+      ok = true;
+      break;
+    }
+    sleep_ms(5);
+  }
+  uint64_t elapsed = now_ms() - start;
+
+  if(!exited)
+  {
+    ::kill(pid, SIGKILL); // takes everything in the PID namespace with it
+    ::waitpid(pid, &status, 0);
+  }
+
+  if(ok)
+  {
+    std::string execs;
+    read_file(sandbox.root + EXEC_FILE, execs);
+    record_trace(trace, steps);
+    record_spawns(trace, execs, spawns);
+    wall.push_back(double(elapsed));
+  }
+  else
+  {
+    std::string console;
+    read_file(sandbox.root + CONSOLE_FILE, console);
+    std::fprintf(stderr, "%s\n%s", !mapped ? "unable to write id maps" :
+                                   exited ? "sxinit exited before the trace was written" :
+                                   "timed out waiting for the boot trace (is sxinit built with WANT_BOOT_TRACE?)",
+                 console.c_str());
+  }
+  remove_tree(sandbox.root);
+  return ok;
+}
+
+// nearest rank
+static double percentile(const std::vector<double>& sorted, double rank) noexcept
+{
+  size_t index = size_t(rank / 100.0 * double(sorted.size()) + 0.5);
+  return sorted[index ? std::min(index, sorted.size()) - 1 : 0];
+}
+
+static void print_row(const char* name, std::vector<double> times, unsigned int failures, unsigned int runs) noexcept
+{
+  if(times.empty())
+    return;
+  std::sort(times.begin(), times.end());
+  std::printf("%-28s %5zu %5u %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+              name, times.size(), failures + (runs - unsigned(times.size())),
+              times.front(), percentile(times, 50), percentile(times, 90), percentile(times, 99), times.back());
+}
+
+static void report(const options_t& options, const std::vector<step_time_t>& steps, const std::vector<double>& wall,
+                   const std::vector<double>& spawns) noexcept
+{
+  std::printf("%-28s %5s %5s %9s %9s %9s %9s %9s\n", "step (ms from exec)", "runs", "fail", "min", "p50", "p90", "p99", "max");
+  for(const step_time_t& step : steps)
+    print_row(step.name.c_str(), step.times, step.failures, options.runs);
+
+  std::printf("\n");
+  for(const step_time_t& step : steps)
+    if(step.name == options.ready_step)
+      print_row("ready", step.times, step.failures, options.runs);
+  print_row("trace written (wall)", wall, 0, options.runs);
+
+  if(spawns.empty())
+    return;
+  std::printf("\n%-28s %5s %5s %9s %9s %9s %9s %9s\n", "spawn to exec (us)", "count", "", "min", "p50", "p90", "p99", "max");
+  print_row("providers", spawns, 0, unsigned(spawns.size()));
+}
+
+struct cmdline_rule_t
+{
+  const char* key;
+  BootOptions::Option option;
+  const char* implied; // value when none is given
+  bool fixed;          // implied even when a value is given
+};
+
+static const cmdline_rule_t s_cmdline_rules[] =
+{
+  { "root",         BootOptions::Option::Root,        nullptr,    false },
+  { "rootdelay",    BootOptions::Option::RootDelay,   nullptr,    false },
+  { "rootwait",     BootOptions::Option::RootWait,    "yes",      false },
+  { "rootfstype",   BootOptions::Option::RootFsType,  nullptr,    false },
+  { "rootflags",    BootOptions::Option::RootFlags,   nullptr,    false },
+  { "ro",           BootOptions::Option::Mode,        "ro",       true  },
+  { "rw",           BootOptions::Option::Mode,        "rw",       true  },
+  { "init",         BootOptions::Option::Init,        nullptr,    false },
+  { "debug",        BootOptions::Option::Debug,       "yes",      false },
+  { "break",        BootOptions::Option::Break,       "premount", false },
+  { "noresume",     BootOptions::Option::NoResume,    "premount", false },
+  { "fsck.mode",    BootOptions::Option::FsckMode,    nullptr,    false },
+  { "fastboot",     BootOptions::Option::FsckMode,    "skip",     false },
+  { "forcefsck",    BootOptions::Option::FsckMode,    "force",    false },
+  { "fsck.repair",  BootOptions::Option::FsckRepair,  nullptr,    false },
+  { "fsckfix",      BootOptions::Option::FsckRepair,  "yes",      false },
+};
+
+// fragments the fuzzer splices into corpus lines
+static const char* const s_cmdline_tokens[] =
+{
+  "\"", "=", "\"\"", "==", "--", " -- ", "\"--\"", "--=", " ", "\t", "\n", "\"root=", "=\"",
+  "root=", "ROOT=", "ro", "rw", "init=", "rootwait", "rootflags=", "break", "fsck.mode=", "fastboot", "forcefsck",
+};
+
+struct cmdline_result_t
+{
+  bool given[size_t(BootOptions::Option::Count)] = {};
+  std::string value[size_t(BootOptions::Option::Count)];
+};
+
+// what BootOptions should make of input, written for clarity rather than speed
+static void reference_parse(std::string input, cmdline_result_t& result) noexcept
+{
+  result = cmdline_result_t();
+  input.resize(std::min(input.size(), size_t(CMDLINE_CAPACITY))); // truncated
+  input.resize(std::min(input.size(), input.find('\0'))); // embedded NUL ends it
+
+  for(size_t pos = 0; pos < input.size();)
+  {
+    if(std::isspace(uint8_t(input[pos])))
+    {
+      ++pos;
+      continue;
+    }
+
+    std::string key, value;
+    bool has_value = false;
+    bool quoted = false;
+    for(; pos < input.size() && (quoted || !std::isspace(uint8_t(input[pos]))); ++pos)
+    {
+      char c = input[pos];
+      if(c == '"')
+        quoted = !quoted;
+      else if(!has_value && c == '=')
+        has_value = true;
+      else if(has_value)
+        value.push_back(c);
+      else
+        key.push_back(char(std::tolower(uint8_t(c))));
+    }
+    if(!has_value && key == "--")
+      break;
+
+    for(const cmdline_rule_t& rule : s_cmdline_rules)
+    {
+      if(key != rule.key)
+        continue;
+      size_t index = size_t(rule.option);
+      if(!rule.fixed && !value.empty())
+      {
+        result.given[index] = true;
+        result.value[index] = value;
+      }
+      else if(rule.implied != nullptr)
+      {
+        result.given[index] = true;
+        result.value[index] = rule.implied;
+      }
+    }
+  }
+}
+
+// compares the options last parsed by BootOptions
+static bool cmdline_matches(const cmdline_result_t& expected) noexcept
+{
+  for(size_t index = 0; index < size_t(BootOptions::Option::Count); ++index)
+  {
+    const char* value = BootOptions::get(BootOptions::Option(index));
+    if(expected.given[index] ? value == nullptr || expected.value[index] != value : value != nullptr)
+      return false;
+  }
+  return true;
+}
+
+static std::string mutate(const std::vector<std::pair<std::string, std::string>>& corpus, std::mt19937& random) noexcept
+{
+  std::string input = corpus[random() % corpus.size()].second;
+  for(unsigned int count = 1 + random() % 4; count; --count)
+  {
+    size_t pos = random() % (input.size() + 1);
+    switch(random() % 6)
+    {
+      case 0: input.insert(pos, s_cmdline_tokens[random() % (sizeof(s_cmdline_tokens) / sizeof(*s_cmdline_tokens))]); break;
+      case 1: input.insert(pos, 1, char(random())); break; // any byte (NUL included)
+      case 2: input.erase(pos, random() % 16); break;
+      case 3: input.insert(pos, input.substr(pos, random() % 64)); break; // repeat a slice
+      case 4:
+        if(pos < input.size())
+          input[pos] = char(input[pos] ^ (1 << (random() % 8)));
+        break;
+      case 5: // end near or beyond the capacity so tokens straddle it
+        if(input.empty())
+          input = "rootwait ";
+        while(input.size() <= CMDLINE_CAPACITY)
+          input += input;
+        input.resize(CMDLINE_CAPACITY - 4 + random() % 9);
+        break;
+    }
+  }
+  return input;
+}
+
+static void print_escaped(const std::string& input) noexcept
+{
+  for(size_t pos = 0; pos < input.size() && pos < 512; ++pos)
+  {
+    uint8_t c = uint8_t(input[pos]);
+    if(c == '\\' || !std::isprint(c))
+      std::fprintf(stderr, "\\x%02x", c);
+    else
+      std::fputc(c, stderr);
+  }
+  std::fprintf(stderr, input.size() > 512 ? "... (%zu bytes)\n" : "\n", input.size());
+}
+
+static int cmdline_main(int argc, char* argv[]) noexcept
+{
+  unsigned long parses = 100000, inputs = 100000, seed = 1;
+  int opt;
+  optind = 2;
+  while((opt = ::getopt(argc, argv, "n:f:s:")) != -1)
+    switch(opt)
+    {
+      case 'n': parses = std::strtoul(optarg, nullptr, 10); break;
+      case 'f': inputs = std::strtoul(optarg, nullptr, 10); break;
+      case 's': seed = std::strtoul(optarg, nullptr, 10); break;
+      default: optind = argc + 1; break;
+    }
+
+  if(argc - optind != 1 || parses < CMDLINE_SAMPLE)
+  {
+    std::fprintf(stderr, "usage: %s --cmdline [-n parses] [-f inputs] [-s seed] <corpus>\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<std::pair<std::string, std::string>> corpus; // file name and contents
+  DIR* directory = ::opendir(argv[optind]);
+  if(directory == nullptr)
+  {
+    std::fprintf(stderr, "unable to open %s: %s\n", argv[optind], std::strerror(errno));
+    return 1;
+  }
+  for(struct dirent* entry; (entry = ::readdir(directory)) != nullptr;)
+  {
+    std::string path = std::string(argv[optind]) + '/' + entry->d_name, data;
+    struct stat state;
+    if(::stat(path.c_str(), &state) == 0 && S_ISREG(state.st_mode) && read_file(path, data))
+      corpus.emplace_back(entry->d_name, data);
+  }
+  ::closedir(directory);
+  if(corpus.empty())
+  {
+    std::fprintf(stderr, "no command lines in %s\n", argv[optind]);
+    return 1;
+  }
+  std::sort(corpus.begin(), corpus.end());
+
+  int status = 0;
+  cmdline_result_t expected;
+  std::printf("%-28s %5s %5s %9s %9s %9s %9s %9s\n", "cmdline (ns per parse)", "runs", "fail", "min", "p50", "p90", "p99", "max");
+  for(const auto& file : corpus)
+  {
+    std::vector<double> samples;
+    for(unsigned long count = 0; count + CMDLINE_SAMPLE <= parses; count += CMDLINE_SAMPLE)
+    {
+      uint64_t start = now_ns();
+      for(unsigned int index = 0; index < CMDLINE_SAMPLE; ++index)
+        BootOptions::parse(file.second.data(), file.second.size());
+      samples.push_back(double(now_ns() - start) / CMDLINE_SAMPLE);
+    }
+
+    reference_parse(file.second, expected);
+    bool matched = cmdline_matches(expected);
+    print_row(file.first.c_str(), samples, matched ? 0 : unsigned(samples.size()), unsigned(samples.size()));
+    if(!matched)
+      status = 1;
+  }
+
+  std::mt19937 random(static_cast<uint32_t>(seed)); // the same seed mutates the same inputs
+  unsigned long mismatches = 0;
+  for(unsigned long count = 0; count < inputs; ++count)
+  {
+    std::string input = mutate(corpus, random);
+    BootOptions::parse(input.data(), input.size());
+    reference_parse(input, expected);
+    if(!cmdline_matches(expected) && !mismatches++)
+    {
+      std::fprintf(stderr, "first mismatch: ");
+      print_escaped(input);
+    }
+  }
+  std::printf("\n%lu mutated inputs (seed %lu): %lu parsed differently from the reference\n", inputs, seed, mismatches);
+  return mismatches ? 1 : status;
+}
+
+// plain decoder of the splashgen encoding
+static bool splash_decode(std::vector<uint8_t>& raw) noexcept
+{
+  raw.clear();
+  for(size_t pos = 0; pos < sizeof(splash::data);)
+  {
+    uint8_t code = splash::data[pos++];
+    size_t count = code >= 0x80 ? size_t(code) - 0x7D : size_t(code) + 1;
+    if(pos + (code >= 0x80 ? 1 : count) > sizeof(splash::data))
+      return false;
+    if(code >= 0x80)
+      raw.insert(raw.end(), count, splash::data[pos++]);
+    else
+    {
+      raw.insert(raw.end(), splash::data + pos, splash::data + pos + count);
+      pos += count;
+    }
+  }
+  return raw.size() == size_t(splash::width) * splash::height;
+}
+
+static int splash_main(int argc, char* argv[]) noexcept
+{
+  unsigned long draws = 2000;
+  int opt;
+  optind = 2;
+  while((opt = ::getopt(argc, argv, "n:")) != -1)
+    switch(opt)
+    {
+      case 'n': draws = std::strtoul(optarg, nullptr, 10); break;
+      default: optind = argc + 1; break;
+    }
+
+  if(argc != optind || !draws)
+  {
+    std::fprintf(stderr, "usage: %s --splash [-n draws]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<uint8_t> raw;
+  if(!splash_decode(raw))
+  {
+    std::fprintf(stderr, "splash.h is corrupt\n");
+    return 1;
+  }
+  std::printf("splash %ux%u: %zu bytes run length encoded, %zu bytes raw (%.1f%%)\n\n",
+              splash::width, splash::height, sizeof(splash::data), raw.size(),
+              100.0 * double(sizeof(splash::data)) / double(raw.size()));
+
+  static const struct { const char* name; FrameBuffer::PixelFormat format; } formats[] =
+  {
+    { "XRGB8888", FrameBuffer::PixelFormat::XRGB8888 },
+    { "RGB888"  , FrameBuffer::PixelFormat::RGB888   },
+    { "RGB565"  , FrameBuffer::PixelFormat::RGB565   },
+  };
+
+  int status = 0;
+  std::vector<uint8_t> page(size_t(splash::width) * splash::height * 4), drawn;
+  std::printf("%-28s %5s %5s %9s %9s %9s %9s %9s\n", "splash (us per draw)", "runs", "fail", "min", "p50", "p90", "p99", "max");
+  for(const auto& entry : formats)
+  {
+    FrameBuffer fb;
+    if(!fb.attach(page.data(), splash::width, splash::height, entry.format))
+      return 1;
+
+    std::vector<double> raw_times, rle_times;
+    unsigned int raw_failures = 0, rle_failures = 0;
+    for(unsigned long count = 0; count < draws; ++count)
+    {
+      uint64_t start = now_ns();
+      if(!fb.load(raw.data(), splash::width, splash::height))
+        ++raw_failures;
+      else
+        raw_times.push_back(double(now_ns() - start) / 1000);
+    }
+    drawn = page;
+
+    for(unsigned long count = 0; count < draws; ++count)
+    {
+      uint64_t start = now_ns();
+      if(!fb.loadRLE(splash::data, sizeof(splash::data), splash::width, splash::height))
+        ++rle_failures;
+      else
+        rle_times.push_back(double(now_ns() - start) / 1000);
+    }
+    if(page != drawn)
+    {
+      std::fprintf(stderr, "%s: loadRLE and load drew different pixels\n", entry.name);
+      rle_failures = unsigned(draws);
+      rle_times.clear();
+    }
+
+    std::string name = std::string("load ") + entry.name;
+    print_row(name.c_str(), raw_times, raw_failures, unsigned(draws));
+    name = std::string("loadRLE ") + entry.name;
+    print_row(name.c_str(), rle_times, rle_failures, unsigned(draws));
+    if(raw_failures || rle_failures)
+      status = 1;
+  }
+  return status;
+}
+
+static int standin_main(int argc, char* argv[]) noexcept
+{
+  char executed[64]; // first so that it is as close to execve as possible
+  int length = std::snprintf(executed, sizeof(executed), "%d %llu\n", int(::getpid()), (unsigned long long)now_us());
+  int log = ::open(EXEC_FILE, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if(log != -1)
+  {
+    (void)!::write(log, executed, size_t(length)); // one write per line: stand-ins start concurrently
+    ::close(log);
+  }
+
+  const char* name = "standin";
+  const char* mount_spec = nullptr;
+  const char* bind_path = nullptr;
+  unsigned long delay = 0, crash = 0, bind_delay = 0, notify = 0;
+  for(int index = 2; index < argc; ++index)
+  {
+    char* value = std::strchr(argv[index], '=');
+    if(value == nullptr)
+      continue;
+    *value++ = '\0';
+    if(!std::strcmp(argv[index], "name"))             name = value;
+    else if(!std::strcmp(argv[index], "delay"))       delay = std::strtoul(value, nullptr, 10);
+    else if(!std::strcmp(argv[index], "crash"))       crash = std::strtoul(value, nullptr, 10);
+    else if(!std::strcmp(argv[index], "mount"))       mount_spec = value;
+    else if(!std::strcmp(argv[index], "bind"))        bind_path = value;
+    else if(!std::strcmp(argv[index], "bind_delay"))  bind_delay = std::strtoul(value, nullptr, 10);
+    else if(!std::strcmp(argv[index], "notify"))      notify = std::strtoul(value, nullptr, 10);
+  }
+
+  // count starts across restarts
+  std::string counter_path = std::string("/bench/") + name + ".starts", counter;
+  unsigned long starts = (read_file(counter_path, counter) ? std::strtoul(counter.c_str(), nullptr, 10) : 0) + 1;
+  counter = std::to_string(starts);
+  write_file(counter_path, counter.data(), counter.size());
+
+  sleep_ms(delay); // startup cost
+  if(starts <= crash)
+    return 1;
+
+  if(mount_spec != nullptr)
+  {
+    std::string source = mount_spec, path = "/";
+    size_t colon = source.find(':');
+    if(colon != std::string::npos)
+    {
+      path = source.substr(colon + 1);
+      source.resize(colon);
+    }
+    make_path(path);
+    if(::mount(source.c_str(), path.c_str(), "tmpfs", 0, nullptr) == -1)
+    {
+      std::fprintf(stderr, "%s: unable to mount %s: %s\n", name, path.c_str(), std::strerror(errno));
+      return 1;
+    }
+  }
+
+  if(bind_path != nullptr)
+  {
+    sleep_ms(bind_delay);
+    std::string directory = bind_path;
+    directory.resize(directory.rfind('/'));
+    make_path(directory);
+
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, bind_path, sizeof(address.sun_path) - 1);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ::unlink(bind_path);
+    if(fd == -1 ||
+       ::bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == -1 ||
+       ::listen(fd, 8) == -1)
+    {
+      std::fprintf(stderr, "%s: unable to bind %s: %s\n", name, bind_path, std::strerror(errno));
+      return 1;
+    }
+  }
+
+  const char* notify_fd = std::getenv("NOTIFY_FD");
+  if(notify && notify_fd != nullptr)
+  {
+    int fd = int(std::strtol(notify_fd, nullptr, 10));
+    (void)!::write(fd, "READY=1\n", 8);
+    ::close(fd);
+  }
+
+  for(;;)
+    ::pause();
+}
+
+int main(int argc, char* argv[])
+{
+  if(argc > 1 && !std::strcmp(argv[1], "--standin"))
+    return standin_main(argc, argv);
+  if(argc > 1 && !std::strcmp(argv[1], "--cmdline"))
+    return cmdline_main(argc, argv);
+  if(argc > 1 && !std::strcmp(argv[1], "--splash"))
+    return splash_main(argc, argv);
+
+  options_t options;
+  int opt;
+  while((opt = ::getopt(argc, argv, "n:t:r:c:p:")) != -1)
+    switch(opt)
+    {
+      case 'n': options.runs = unsigned(std::strtoul(optarg, nullptr, 10)); break;
+      case 't': options.timeout = unsigned(std::strtoul(optarg, nullptr, 10)); break;
+      case 'r': options.ready_step = optarg; break;
+      case 'c': options.manifestc = optarg; break;
+      case 'p': options.providers = unsigned(std::strtoul(optarg, nullptr, 10)); break;
+      default: optind = argc + 1; break;
+    }
+  if(options.ready_step == nullptr)
+    options.ready_step = options.providers ? STANDIN_STEPS : "Director Service";
+
+  if(argc - optind != 2 || !options.runs)
+  {
+    std::fprintf(stderr, "usage: %s [-n runs] [-t timeout_ms] [-r ready_step] [-c manifestc] [-p providers] <sxinit> <scenario>\n"
+                         "       %s --standin [name=id] [delay=ms] [crash=count] [mount=source:path] [bind=path] [bind_delay=ms] [notify=1]\n"
+                         "       %s --cmdline [-n parses] [-f inputs] [-s seed] <corpus>\n"
+                         "       %s --splash [-n draws]\n",
+                 argv[0], argv[0], argv[0], argv[0]);
+    return 1;
+  }
+
+  char path[PATH_MAX];
+  if(::realpath(argv[optind], path) == nullptr)
+  {
+    std::fprintf(stderr, "unable to find %s: %s\n", argv[optind], std::strerror(errno));
+    return 1;
+  }
+  options.sxinit = path;
+  if(::realpath(argv[optind + 1], path) == nullptr)
+  {
+    std::fprintf(stderr, "unable to find %s: %s\n", argv[optind + 1], std::strerror(errno));
+    return 1;
+  }
+  options.scenario = path;
+  if(::realpath("/proc/self/exe", path) == nullptr)
+    return 1;
+  options.self = path;
+  if(options.manifestc.empty()) // built next to this tool
+    options.manifestc = options.self.substr(0, options.self.rfind('/')) + "/manifestc";
+
+  std::string providers = options.scenario + "/providers.txt";
+  char generated[] = "/tmp/bootbench-providers.XXXXXX";
+  if(options.providers)
+  {
+    std::string text = generate_providers(options.providers);
+    int fd = ::mkstemp(generated);
+    if(fd == -1)
+      return 1;
+    ::close(fd);
+    providers = generated;
+    if(!write_file(providers, text.data(), text.size()))
+    {
+      ::unlink(generated);
+      return 1;
+    }
+  }
+
+  if(exists(providers))
+  {
+    char manifest[] = "/tmp/bootbench-manifest.XXXXXX";
+    int fd = ::mkstemp(manifest);
+    bool compiled = fd != -1;
+    if(compiled)
+    {
+      ::close(fd);
+      options.manifest = manifest;
+      compiled = run({ options.manifestc, providers, options.manifest });
+      if(!compiled)
+        ::unlink(manifest);
+    }
+    if(options.providers)
+      ::unlink(generated);
+    if(!compiled)
+      return 1;
+  }
+
+  std::vector<step_time_t> steps;
+  std::vector<double> wall;
+  std::vector<double> spawns;
+  for(unsigned int index = 0; index < options.runs; ++index)
+    if(!boot_once(options, steps, wall, spawns))
+      std::fprintf(stderr, "run %u failed\n", index + 1);
+
+  if(!options.manifest.empty())
+    ::unlink(options.manifest.c_str());
+
+  if(wall.empty())
+    return 1;
+  report(options, steps, wall, spawns);
+  return wall.size() == options.runs ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+// Generates font.h from font.txt, the glyphs the framebuffer draws text with.
+//
+// font.txt holds every printable ASCII character in order, each as its code
+// in hex followed by 8 rows of 8 pixels ('#' lit, '.' unlit).  Rows are
+// doubled so glyphs fill the 8x16 cells of a regular text console.  Every
+// row is stored as one byte with the leftmost pixel in the top bit.
+
+// STL
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+static const uint32_t source_height = 8;
+static const uint32_t scale = 2;
+static const int first_char = 0x20;
+static const int last_char = 0x7E;
+
+// next line that isn't blank or a comment
+static bool read_line(FILE* file, char* line, size_t size, uint32_t& number) noexcept
+{
+  while(std::fgets(line, int(size), file) != nullptr)
+  {
+    ++number;
+    line[std::strcspn(line, "\r\n")] = '\0';
+    if(*line && std::strncmp(line, "//", 2))
+      return true;
+  }
+  return false;
+}
+
+int main(int argc, char* argv[])
+{
+  if(argc != 3)
+  {
+    std::fprintf(stderr, "usage: %s <font.txt> <font.h>\n", argv[0]);
+    return 1;
+  }
+
+  FILE* input = std::fopen(argv[1], "r");
+  if(input == nullptr)
+  {
+    std::fprintf(stderr, "unable to open %s: %s\n", argv[1], std::strerror(errno));
+    return 1;
+  }
+
+  std::vector<uint8_t> glyphs;
+  char line[256];
+  uint32_t number = 0;
+  for(int expected = first_char; expected <= last_char; ++expected)
+  {
+    char* end = nullptr;
+    if(!read_line(input, line, sizeof(line), number) ||
+       std::strtol(line, &end, 16) != expected || *end)
+    {
+      std::fprintf(stderr, "%s:%u: expected glyph 0x%02X\n", argv[1], number, expected);
+      return 1;
+    }
+
+    for(uint32_t row = 0; row < source_height; ++row)
+    {
+      if(!read_line(input, line, sizeof(line), number) || std::strlen(line) != 8 ||
+         std::strspn(line, "#.") != 8)
+      {
+        std::fprintf(stderr, "%s:%u: expected 8 pixels of glyph 0x%02X\n", argv[1], number, expected);
+        return 1;
+      }
+
+      uint8_t bits = 0;
+      for(uint32_t column = 0; column < 8; ++column)
+        if(line[column] == '#')
+          bits |= uint8_t(0x80 >> column);
+      glyphs.insert(glyphs.end(), scale, bits);
+    }
+  }
+  if(read_line(input, line, sizeof(line), number))
+  {
+    std::fprintf(stderr, "%s:%u: unexpected data after glyph 0x%02X\n", argv[1], number, last_char);
+    return 1;
+  }
+  std::fclose(input);
+
+  FILE* output = std::fopen(argv[2], "w");
+  if(output == nullptr)
+  {
+    std::fprintf(stderr, "unable to create %s: %s\n", argv[2], std::strerror(errno));
+    return 1;
+  }
+
+  std::fprintf(output,
+               "// generated by tools/fontgen: do not edit\n"
+               "#ifndef FONT_H\n"
+               "#define FONT_H\n"
+               "\n"
+               "#include <cstdint>\n"
+               "\n"
+               "namespace font\n"
+               "{\n"
+               "  static const uint32_t width = 8;\n"
+               "  static const uint32_t height = %u;\n"
+               "  static const char first = 0x%02X;\n"
+               "  static const char last = 0x%02X;\n"
+               "\n"
+               "  // height rows per glyph, the leftmost pixel is the top bit\n"
+               "  static const uint8_t glyphs[] =\n"
+               "  {",
+               source_height * scale, first_char, last_char);
+  for(size_t pos = 0; pos < glyphs.size(); ++pos)
+    std::fprintf(output, "%s0x%02x,", pos % (source_height * scale) ? " " : "\n    ", glyphs[pos]);
+  std::fprintf(output,
+               "\n  };\n"
+               "}\n"
+               "\n"
+               "#endif // FONT_H\n");
+  std::fclose(output);
+
+  std::printf("font: %d glyphs, %zu bytes\n", last_char - first_char + 1, glyphs.size());
+  return 0;
+}
@@ -0,0 +1,264 @@
+// Compiles a text provider description into the binary manifest sxinit maps at boot (see manifest.h).
+//
+// Each provider is a section named after its step, followed by key = value lines:
+//   [Director Service]
+//   bin       = /sbin/sxdirector
+//   arguments = /sbin/sxdirector -f      (optional, whitespace separated argv)
+//   username  = director                 (optional)
+//   fatal     = yes                      (optional, yes/no)
+//   depends   = / /svc /config/io        (optional, whitespace separated)
+//   provides  = /director/io             (optional, whitespace separated)
+//   ready     = socket /svc/director/io  (none, socket <path> or mount <source>)
+//   deadline  = 5000                     (optional, milliseconds)
+// Blank lines and lines starting with '#' are ignored.
+
+// STL
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+// Project
+#include "../manifest.h"
+
+struct source_t
+{
+  std::string step_id;
+  std::string bin;
+  std::string arguments;
+  std::string username;
+  std::string socket_path;
+  std::string mount_source;
+  std::vector<std::string> depends;
+  std::vector<std::string> provides;
+  Manifest::Ready ready = Manifest::Ready::None;
+  bool fatal = false;
+  uint32_t deadline = 0;
+  unsigned int line = 0;
+};
+
+struct string_table_t
+{
+  std::string data = std::string(1, '\0'); // offset 0 is the empty string
+  std::unordered_map<std::string, uint32_t> offsets;
+
+  uint32_t add(const std::string& value)
+  {
+    if(value.empty())
+      return 0;
+    auto pos = offsets.find(value);
+    if(pos != offsets.end())
+      return pos->second;
+    uint32_t offset = uint32_t(data.size());
+    data.append(value).push_back('\0');
+    offsets.emplace(value, offset);
+    return offset;
+  }
+};
+
+static std::string trim(const std::string& value)
+{
+  size_t first = value.find_first_not_of(" \t\r");
+  if(first == std::string::npos)
+    return std::string();
+  return value.substr(first, value.find_last_not_of(" \t\r") - first + 1);
+}
+
+static std::vector<std::string> split(const std::string& value)
+{
+  std::vector<std::string> items;
+  for(size_t pos = value.find_first_not_of(" \t"); pos != std::string::npos; pos = value.find_first_not_of(" \t", pos))
+  {
+    size_t end = value.find_first_of(" \t", pos);
+    items.push_back(value.substr(pos, end - pos));
+    pos = end;
+  }
+  return items;
+}
+
+static bool set_key(source_t& source, const std::string& key, const std::string& value)
+{
+  if(key == "bin")
+    source.bin = value;
+  else if(key == "arguments")
+    source.arguments = value;
+  else if(key == "username")
+    source.username = value;
+  else if(key == "fatal")
+  {
+    if(value != "yes" && value != "no")
+      return false;
+    source.fatal = value == "yes";
+  }
+  else if(key == "depends")
+    source.depends = split(value);
+  else if(key == "provides")
+    source.provides = split(value);
+  else if(key == "deadline")
+  {
+    char* end = nullptr;
+    source.deadline = uint32_t(std::strtoul(value.c_str(), &end, 10));
+    return end != value.c_str() && *end == '\0';
+  }
+  else if(key == "ready")
+  {
+    std::vector<std::string> items = split(value);
+    if(items.size() == 1 && items[0] == "none")
+      source.ready = Manifest::Ready::None;
+    else if(items.size() == 2 && items[0] == "socket")
+    {
+      source.ready = Manifest::Ready::Socket;
+      source.socket_path = items[1];
+    }
+    else if(items.size() == 2 && items[0] == "mount")
+    {
+      source.ready = Manifest::Ready::Mount;
+      source.mount_source = items[1];
+    }
+    else
+      return false;
+  }
+  else
+    return false;
+  return true;
+}
+
+static bool parse(FILE* input, const char* name, std::vector<source_t>& sources)
+{
+  char buffer[4096];
+  unsigned int line = 0;
+  while(std::fgets(buffer, sizeof(buffer), input) != nullptr)
+  {
+    ++line;
+    std::string text = trim(std::string(buffer, std::strcspn(buffer, "\n")));
+    if(text.empty() || text[0] == '#')
+      continue;
+
+    if(text[0] == '[')
+    {
+      if(text.back() != ']' || text.size() < 3)
+      {
+        std::fprintf(stderr, "%s:%u: malformed section name\n", name, line);
+        return false;
+      }
+      sources.emplace_back();
+      sources.back().step_id = trim(text.substr(1, text.size() - 2));
+      sources.back().line = line;
+      continue;
+    }
+
+    size_t equals = text.find('=');
+    if(sources.empty() || equals == std::string::npos)
+    {
+      std::fprintf(stderr, "%s:%u: expected [Step Name] or key = value\n", name, line);
+      return false;
+    }
+
+    std::string key = trim(text.substr(0, equals));
+    std::string value = trim(text.substr(equals + 1));
+    if(!set_key(sources.back(), key, value))
+    {
+      std::fprintf(stderr, "%s:%u: invalid %s: \"%s\"\n", name, line, key.c_str(), value.c_str());
+      return false;
+    }
+  }
+
+  for(const source_t& source : sources)
+    if(source.bin.empty())
+    {
+      std::fprintf(stderr, "%s:%u: [%s] has no bin\n", name, source.line, source.step_id.c_str());
+      return false;
+    }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  if(argc != 3)
+  {
+    std::fprintf(stderr, "usage: %s <providers.txt> <manifest.bin>\n", argv[0]);
+    return 1;
+  }
+
+  FILE* input = std::fopen(argv[1], "r");
+  if(input == nullptr)
+  {
+    std::fprintf(stderr, "unable to open %s: %s\n", argv[1], std::strerror(errno));
+    return 1;
+  }
+
+  std::vector<source_t> sources;
+  bool ok = parse(input, argv[1], sources);
+  std::fclose(input);
+  if(!ok)
+    return 1;
+  if(sources.size() > UINT16_MAX)
+  {
+    std::fprintf(stderr, "%s: too many providers\n", argv[1]);
+    return 1;
+  }
+
+  string_table_t strings;
+  std::vector<uint32_t> lists;
+  std::vector<Manifest::provider_t> providers;
+  for(const source_t& source : sources)
+  {
+    Manifest::provider_t entry = {};
+    entry.step_id      = strings.add(source.step_id);
+    entry.bin          = strings.add(source.bin);
+    entry.arguments    = strings.add(source.arguments);
+    entry.username     = strings.add(source.username);
+    entry.socket_path  = strings.add(source.socket_path);
+    entry.mount_source = strings.add(source.mount_source);
+    entry.deadline     = source.deadline;
+    entry.ready        = source.ready;
+    entry.fatal        = source.fatal ? 1 : 0;
+
+    entry.depends = uint32_t(lists.size());
+    entry.depends_count = uint16_t(source.depends.size());
+    for(const std::string& item : source.depends)
+      lists.push_back(strings.add(item));
+
+    entry.provides = uint32_t(lists.size());
+    entry.provides_count = uint16_t(source.provides.size());
+    for(const std::string& item : source.provides)
+      lists.push_back(strings.add(item));
+
+    providers.push_back(entry);
+  }
+
+  Manifest::header_t header = {};
+  header.magic          = MANIFEST_MAGIC;
+  header.version        = MANIFEST_VERSION;
+  header.provider_count = uint16_t(providers.size());
+  header.providers      = sizeof(header);
+  header.lists          = header.providers + uint32_t(providers.size() * sizeof(Manifest::provider_t));
+  header.list_count     = uint32_t(lists.size());
+  header.strings        = header.lists + uint32_t(lists.size() * sizeof(uint32_t));
+  header.strings_size   = uint32_t(strings.data.size());
+  header.size           = header.strings + header.strings_size;
+
+  FILE* output = std::fopen(argv[2], "wb");
+  if(output == nullptr)
+  {
+    std::fprintf(stderr, "unable to create %s: %s\n", argv[2], std::strerror(errno));
+    return 1;
+  }
+
+  std::fwrite(&header, sizeof(header), 1, output);
+  std::fwrite(providers.data(), sizeof(Manifest::provider_t), providers.size(), output);
+  std::fwrite(lists.data(), sizeof(uint32_t), lists.size(), output);
+  std::fwrite(strings.data.data(), 1, strings.data.size(), output);
+  if(std::fclose(output))
+  {
+    std::fprintf(stderr, "unable to write %s: %s\n", argv[2], std::strerror(errno));
+    return 1;
+  }
+
+  std::printf("manifest: %zu providers, %u bytes\n", providers.size(), header.size);
+  return 0;
+}
@@ -0,0 +1,142 @@
+// Generates splash.h from a binary (P5) 8-bit grayscale PGM image.
+//
+// The image is stored with PackBits style run length encoding where runs
+// never cross row boundaries so the decoder can stream rows directly into
+// the framebuffer:
+//   0x00-0x7F: n + 1 literal bytes follow
+//   0x80-0xFF: the next byte repeats n - 0x7D times (3 to 130)
+
+// STL
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+static bool read_token(FILE* file, char* token, size_t size) noexcept
+{
+  int c;
+  do
+  {
+    c = std::fgetc(file);
+    if(c == '#') // skip comments
+      while(c != EOF && c != '\n')
+        c = std::fgetc(file);
+  } while(c == ' ' || c == '\t' || c == '\r' || c == '\n');
+
+  size_t length = 0;
+  for(; c != EOF && c != ' ' && c != '\t' && c != '\r' && c != '\n' && length + 1 < size; c = std::fgetc(file))
+    token[length++] = char(c);
+  token[length] = '\0';
+  return length != 0;
+}
+
+static void encode_row(std::vector<uint8_t>& output, const uint8_t* row, uint32_t width) noexcept
+{
+  uint32_t pos = 0;
+  while(pos < width)
+  {
+    uint32_t run = 1;
+    while(pos + run < width && run < 130 && row[pos + run] == row[pos])
+      ++run;
+
+    if(run >= 3)
+    {
+      output.push_back(uint8_t(run + 0x7D));
+      output.push_back(row[pos]);
+      pos += run;
+      continue;
+    }
+
+    // gather literals until a run of three begins
+    uint32_t literal = 0;
+    while(pos + literal < width && literal < 128 &&
+          !(pos + literal + 2 < width &&
+            row[pos + literal] == row[pos + literal + 1] &&
+            row[pos + literal] == row[pos + literal + 2]))
+      ++literal;
+    if(!literal) // a repeat run shorter than three at the end of the row
+      literal = 1;
+
+    output.push_back(uint8_t(literal - 1));
+    output.insert(output.end(), row + pos, row + pos + literal);
+    pos += literal;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  if(argc != 3)
+  {
+    std::fprintf(stderr, "usage: %s <image.pgm> <splash.h>\n", argv[0]);
+    return 1;
+  }
+
+  FILE* input = std::fopen(argv[1], "rb");
+  if(input == nullptr)
+  {
+    std::fprintf(stderr, "unable to open %s: %s\n", argv[1], std::strerror(errno));
+    return 1;
+  }
+
+  char magic[4], width_str[16], height_str[16], maxval_str[16];
+  if(!read_token(input, magic, sizeof(magic)) || std::strcmp(magic, "P5") ||
+     !read_token(input, width_str, sizeof(width_str)) ||
+     !read_token(input, height_str, sizeof(height_str)) ||
+     !read_token(input, maxval_str, sizeof(maxval_str)) || std::strcmp(maxval_str, "255"))
+  {
+    std::fprintf(stderr, "%s is not an 8-bit binary PGM image\n", argv[1]);
+    return 1;
+  }
+
+  uint32_t width = uint32_t(std::strtoul(width_str, nullptr, 10));
+  uint32_t height = uint32_t(std::strtoul(height_str, nullptr, 10));
+  std::vector<uint8_t> image(size_t(width) * height);
+  if(!width || !height || std::fread(image.data(), 1, image.size(), input) != image.size())
+  {
+    std::fprintf(stderr, "%s is truncated\n", argv[1]);
+    return 1;
+  }
+  std::fclose(input);
+
+  std::vector<uint8_t> encoded;
+  for(uint32_t row = 0; row < height; ++row)
+    encode_row(encoded, image.data() + size_t(row) * width, width);
+
+  FILE* output = std::fopen(argv[2], "w");
+  if(output == nullptr)
+  {
+    std::fprintf(stderr, "unable to create %s: %s\n", argv[2], std::strerror(errno));
+    return 1;
+  }
+
+  std::fprintf(output,
+               "// generated by tools/splashgen: do not edit\n"
+               "#ifndef SPLASH_H\n"
+               "#define SPLASH_H\n"
+               "\n"
+               "#include <cstdint>\n"
+               "\n"
+               "namespace splash\n"
+               "{\n"
+               "  static const uint32_t width = %u;\n"
+               "  static const uint32_t height = %u;\n"
+               "\n"
+               "  // run length encoded rows (see tools/splashgen.cpp)\n"
+               "  static const uint8_t data[] =\n"
+               "  {",
+               width, height);
+  for(size_t pos = 0; pos < encoded.size(); ++pos)
+    std::fprintf(output, "%s0x%02x,", pos % 24 ? " " : "\n    ", encoded[pos]);
+  std::fprintf(output,
+               "\n  };\n"
+               "}\n"
+               "\n"
+               "#endif // SPLASH_H\n");
+  std::fclose(output);
+
+  std::printf("splash: %ux%u, %zu bytes raw, %zu bytes encoded (%.1f%%)\n",
+              width, height, image.size(), encoded.size(), 100.0 * double(encoded.size()) / double(image.size()));
+  return 0;
+}
@@ -0,0 +1,180 @@
+#include "tracer.h"
+
+#if defined(WANT_BOOT_TRACE)
+
+// STL
+#include <array>
+#include <atomic>
+
+// Project
+#include "timer.h"
+
+#ifndef TRACE_CAPACITY
+#define TRACE_CAPACITY        4096 // events
+#endif
+
+#ifndef TRACE_SAVE_INTERVAL
+#define TRACE_SAVE_INTERVAL   10000 // milliseconds
+#endif
+
+#ifndef TRACE_SAVE_ATTEMPTS
+#define TRACE_SAVE_ATTEMPTS   30
+#endif
+
+namespace Tracer
+{
+  enum Phase : char
+  {
+    Begin     = 'b', // async begin
+    End       = 'e', // async end
+    Instant   = 'i',
+    Complete  = 'X',
+  };
+
+  struct event_t
+  {
+    uint64_t timestamp; // nanoseconds
+    uint64_t duration;  // nanoseconds (Complete only)
+    string_literal category;
+    const char* name;
+    string_literal detail;
+    int64_t value;
+    uint32_t thread;
+    Phase phase;
+  };
+
+  static std::array<event_t, TRACE_CAPACITY> s_events; // preallocated so recording never allocates
+  static std::atomic<uint32_t> s_head(0);
+  static std::atomic<uint32_t> s_threads(0);
+  static uint64_t s_origin = Timer::monotonic();
+  static Timer::id_t s_save_timer = posix::error_response;
+  static uint16_t s_save_attempts = 0;
+
+  void record(Phase phase, string_literal category, const char* name, string_literal detail,
+              int64_t value, uint64_t timestamp, uint64_t duration) noexcept;
+  bool write_string(posix::fd_t fd, const char* str) noexcept;
+}
+
+uint64_t Tracer::now(void) noexcept
+  { return Timer::monotonic(); }
+
+void Tracer::record(Phase phase, string_literal category, const char* name, string_literal detail,
+                    int64_t value, uint64_t timestamp, uint64_t duration) noexcept
+{
+  static thread_local uint32_t thread = ++s_threads;
+  event_t& event = s_events[s_head++ % TRACE_CAPACITY]; // oldest events are overwritten
+  event.timestamp = timestamp;
+  event.duration = duration;
+  event.category = category;
+  event.name = name;
+  event.detail = detail;
+  event.value = value;
+  event.thread = thread;
+  event.phase = phase;
+}
+
+void Tracer::begin(string_literal category, const char* name, string_literal detail) noexcept
+  { record(Begin, category, name, detail, 0, now(), 0); }
+
+void Tracer::end(string_literal category, const char* name, string_literal detail) noexcept
+  { record(End, category, name, detail, 0, now(), 0); }
+
+void Tracer::instant(string_literal category, const char* name, string_literal detail, int64_t value) noexcept
+  { record(Instant, category, name, detail, value, now(), 0); }
+
+void Tracer::complete(string_literal category, const char* name, uint64_t start, string_literal detail, int64_t value) noexcept
+  { uint64_t finish = now(); record(Complete, category, name, detail, value, start, finish - start); }
+
+bool Tracer::write_string(posix::fd_t fd, const char* str) noexcept
+{
+  char buffer[256];
+  posix::size_t length = 0;
+  buffer[length++] = '"';
+  for(; str != nullptr && *str && length < sizeof(buffer) - 3; ++str)
+  {
+    if(*str == '"' || *str == '\\')
+      buffer[length++] = '\\';
+    buffer[length++] = posix::isgraph(*str) ? *str : ' ';
+  }
+  buffer[length++] = '"';
+  return posix::write(fd, buffer, length) == posix::ssize_t(length);
+}
+
+bool Tracer::dump(const char* path) noexcept
+{
+  posix::fd_t fd = posix::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP);
+  if(fd == posix::error_response)
+    return false;
+
+  uint32_t head = s_head;
+  uint32_t first = head > TRACE_CAPACITY ? head - TRACE_CAPACITY : 0;
+  bool ok = posix::write(fd, "{\"traceEvents\":[", 16) == 16;
+
+  for(uint32_t pos = first; ok && pos < head; ++pos)
+  {
+    const event_t& event = s_events[pos % TRACE_CAPACITY];
+    uint64_t ts = event.timestamp > s_origin ? event.timestamp - s_origin : 0;
+    char buffer[256];
+    int length = posix::snprintf(buffer, sizeof(buffer),
+                                 "%s\n{\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%llu.%03llu,",
+                                 pos == first ? "" : ",",
+                                 char(event.phase),
+                                 event.thread,
+                                 (unsigned long long)(ts / 1000), (unsigned long long)(ts % 1000));
+    if(event.phase == Complete)
+      length += posix::snprintf(buffer + length, sizeof(buffer) - posix::size_t(length),
+                                "\"dur\":%llu.%03llu,",
+                                (unsigned long long)(event.duration / 1000), (unsigned long long)(event.duration % 1000));
+    else if(event.phase == Instant)
+      length += posix::snprintf(buffer + length, sizeof(buffer) - posix::size_t(length), "\"s\":\"t\",");
+    else // async events pair up by name
+      length += posix::snprintf(buffer + length, sizeof(buffer) - posix::size_t(length),
+                                "\"id\":\"0x%lx\",", (unsigned long)(uintptr_t)event.name);
+
+    length += posix::snprintf(buffer + length, sizeof(buffer) - posix::size_t(length),
+                              "\"args\":{\"value\":%lld},\"cat\":", (long long)event.value);
+
+    ok = posix::write(fd, buffer, posix::size_t(length)) == length &&
+         write_string(fd, event.category) &&
+         posix::write(fd, ",\"name\":", 8) == 8 &&
+         write_string(fd, event.name) &&
+         (event.detail == nullptr ||
+          (posix::write(fd, ",\"detail\":", 10) == 10 &&
+           write_string(fd, event.detail))) &&
+         posix::write(fd, "}", 1) == 1;
+  }
+
+  char footer[96]; // the origin lets timestamps be compared with CLOCK_MONOTONIC readings of other processes
+  int length = posix::snprintf(footer, sizeof(footer), "\n],\"otherData\":{\"origin\":%llu},\"displayTimeUnit\":\"ms\"}\n",
+                               (unsigned long long)(s_origin / 1000));
+  ok = ok && posix::write(fd, footer, posix::size_t(length)) == length;
+  posix::close(fd);
+  return ok;
+}
+
+void Tracer::save(const char* path) noexcept
+{
+  if(dump(path))
+  {
+    Timer::stop(s_save_timer);
+    return;
+  }
+
+  if(errno != EROFS && errno != ENOENT && errno != EACCES) // not a problem that mounting will solve
+  {
+    Timer::stop(s_save_timer);
+    terminal::write("%s Unable to save boot trace to %s: %s\n", terminal::warning, path, posix::strerror(errno));
+    return;
+  }
+
+  if(s_save_timer == posix::error_response && s_save_attempts < TRACE_SAVE_ATTEMPTS)
+    s_save_timer = Timer::start(TRACE_SAVE_INTERVAL,
+                                [path]() noexcept
+                                {
+                                  if(++s_save_attempts >= TRACE_SAVE_ATTEMPTS)
+                                    Timer::stop(s_save_timer); // give up
+                                  save(path);
+                                }, true);
+}
+
+#endif
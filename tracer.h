@@ -0,0 +1,31 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+// PUT
+#include <put/cxxutils/vterm.h>
+
+namespace Tracer
+{
+#if defined(WANT_BOOT_TRACE)
+  // NOTE: category, name and detail must outlive the trace (string literals or static storage)
+  extern void begin   (string_literal category, const char* name, string_literal detail = nullptr) noexcept;
+  extern void end     (string_literal category, const char* name, string_literal detail = nullptr) noexcept;
+  extern void instant (string_literal category, const char* name, string_literal detail = nullptr, int64_t value = 0) noexcept;
+  extern void complete(string_literal category, const char* name, uint64_t start, string_literal detail = nullptr, int64_t value = 0) noexcept;
+  extern uint64_t now(void) noexcept; // nanoseconds
+
+  extern bool dump(const char* path) noexcept; // write Chrome trace-event JSON
+  extern void save(const char* path) noexcept; // dump now or once the filesystem becomes writable
+#else
+  static inline void begin   (string_literal, const char*, string_literal = nullptr) noexcept { }
+  static inline void end     (string_literal, const char*, string_literal = nullptr) noexcept { }
+  static inline void instant (string_literal, const char*, string_literal = nullptr, int64_t = 0) noexcept { }
+  static inline void complete(string_literal, const char*, uint64_t, string_literal = nullptr, int64_t = 0) noexcept { }
+  static inline uint64_t now(void) noexcept { return 0; }
+
+  static inline bool dump(const char*) noexcept { return false; }
+  static inline void save(const char*) noexcept { }
+#endif
+}
+
+#endif // TRACER_H